@@ -0,0 +1,273 @@
+#!/bin/bash
+# Side by side comparison of solver variants.
+# Every study runs ./elastic for each variant and refinement
+# and keeps the iteration counts and the timer summary.
+FILE=compare.txt
+RFNMT="3 4 5 6"
+STUDY=""
+# Direct solver threshold, the iterative studies keep it off
+DIRECT_DOFS=0
+
+usage(){
+    echo "Usage: $0 <study> [refinements]"
+    echo "Studies:"
+    echo "  inner    nested FGMRES vs fixed cost inner solvers"
+    echo "  concurrent  sequential vs concurrent displacement blocks (-c 0)"
+    echo "  adaptive fixed vs adaptive inner tolerances"
+    echo "  rigid    constant modes vs rigid body modes in the displacement AMG"
+    echo "  share    one AMG per displacement component vs one shared AMG (-c 0)"
+    echo "  3d       split vs coupled displacement blocks in 3d"
+    echo "  amgsetup sequential vs concurrent AMG setup"
+    echo "  tune     default vs tuned AMG settings (tuning run and cached run)"
+    echo "  al       element Schur vs augmented Lagrangian for poisson 0.2 - 0.4999"
+    echo "  schur    Schur complement approximations"
+    echo "  condensed continuous pressure vs condensed discontinuous pressure"
+    echo "  displacement mixed vs displacement formulation (-e)"
+    echo "  minres   FGMRES block triangular vs MINRES block diagonal (-e)"
+    echo "  single   double vs single precision inner solves"
+    echo "  direct   iterative vs sparse direct solver"
+    echo "  mg       block preconditioners vs monolithic multigrid"
+    echo "  recycle  load steps with and without Krylov subspace recycling"
+    echo "  cgs2     modified Gram-Schmidt vs fused CGS2 FGMRES, outer and inner"
+    echo "  disc     fixed tolerance vs stopping at the discretization error"
+    echo "  store    Poisson ratio sweep, cold vs warm started from the solution store"
+    echo "  checkpoint  uninterrupted run vs checkpointed run and its restart"
+    echo "  ensemble Poisson ratio sweep, one run each vs one concurrent ensemble"
+}
+
+# Run one variant: caption followed by the arguments for ./elastic
+run(){
+    caption=$1
+    shift
+    for refine in $RFNMT
+    do
+        echo "Arg Refinements $refine Variant $caption"
+        ./elastic -r $refine --direct_dofs $DIRECT_DOFS "$@" | grep -E "iterations|memory|Errors|Total|AMG|Schur|System solver|Assembling|Degrees|recovery|workspace|Direct|Multigrid|Load steps|Recycled|per iteration|Discretization|Warm start|Checkpoint|Ensemble"
+    done
+}
+
+inner(){
+    run fgmres    --inner FGMRES
+    run vcycle1   --inner VCYCLE    --cycles 1
+    run vcycle2   --inner VCYCLE    --cycles 2
+    run chebyshev --inner CHEBYSHEV --cycles 3
+}
+
+concurrent(){
+    for ompt in 1 2 4
+    do
+        export OMP_NUM_THREADS=$ompt
+        run sequential-$ompt -c 0 --concurrent 0
+        run concurrent-$ompt -c 0 --concurrent 1
+    done
+}
+
+adaptive(){
+    for blocks in 1 0
+    do
+        run fixed-c$blocks    -c $blocks --adaptive 0
+        run adaptive-c$blocks -c $blocks --adaptive 1
+    done
+}
+
+rigid(){
+    if [[ -z $USER_RFNMT ]]; then
+        RFNMT="4 5 6 7"
+    fi
+    run constant -c 1 --rigid 0
+    run rigid    -c 1 --rigid 1
+}
+
+share(){
+    run separate -c 0 --share 0
+    run shared   -c 0 --share 1
+}
+
+threed(){
+    if [[ -z $USER_RFNMT ]]; then
+        RFNMT="1 2 3"
+    fi
+    run 3d-split   -d 3 -c 0
+    run 3d-coupled -d 3 -c 1
+}
+
+amgsetup(){
+    for blocks in 1 0
+    do
+        run sequential-c$blocks -c $blocks --amg_concurrent 0
+        run concurrent-c$blocks -c $blocks --amg_concurrent 1
+    done
+}
+
+tune(){
+    rm -f amg_tune.txt
+    run default -c 1 --tune 0
+    run tuning  -c 1 --tune 1
+    run cached  -c 1 --tune 1
+}
+
+al(){
+    for nu in 0.2 0.3 0.4 0.45 0.49 0.499 0.4999
+    do
+        run schur-$nu -c 1 -p $nu --al 0
+        for gamma in 1 10
+        do
+            run al$gamma-$nu -c 1 -p $nu --al 1 -g $gamma
+        done
+    done
+}
+
+schur(){
+    for type in ELEMENT MASS LUMPED SIMPLE HMATRIX
+    do
+        run $type -c 1 --schur $type
+    done
+}
+
+condensed(){
+    for nu in 0.2 0.4 0.49
+    do
+        run continuous-$nu -c 1 -p $nu --dgp 0
+        run condensed-$nu  -p $nu --dgp 1
+    done
+}
+
+displacement(){
+    for nu in 0.2 0.3 0.4
+    do
+        run mixed-$nu        -e -c 1 -p $nu --formulation MIXED
+        run displacement-$nu -e -p $nu --formulation DISPLACEMENT
+    done
+}
+
+minres(){
+    for blocks in 1 0
+    do
+        run fgmres-c$blocks -e -c $blocks --minres 0 --inner VCYCLE --cycles 2
+        run minres-c$blocks -e -c $blocks --minres 1 --inner VCYCLE --cycles 2
+    done
+}
+
+single(){
+    for inner in FGMRES VCYCLE
+    do
+        for blocks in 1 0
+        do
+            run double-$inner-c$blocks -c $blocks --inner $inner --single 0
+            run single-$inner-c$blocks -c $blocks --inner $inner --single 1
+        done
+    done
+}
+
+direct(){
+    if [[ -z $USER_RFNMT ]]; then
+        RFNMT="2 3 4 5"
+    fi
+    run iterative -c 1
+    DIRECT_DOFS=100000000
+    run direct    -c 1
+    DIRECT_DOFS=0
+}
+
+mg(){
+    run block-schur -c 0 --mg 0
+    run 2-blocks    -c 1 --mg 0
+    run monolithic  --mg 1
+}
+
+recycle(){
+    run plain -c 1 --steps 8 --recycle 0
+    for size in 5 10 20
+    do
+        run recycle-$size -c 1 --steps 8 --recycle 1 --recycle_size $size
+    done
+}
+
+cgs2(){
+    for ompt in 1 4
+    do
+        export OMP_NUM_THREADS=$ompt
+        run mgs-$ompt        -c 1 --cgs2 0 --inner_cgs2 0
+        run cgs2-outer-$ompt -c 1 --cgs2 1 --inner_cgs2 0
+        run cgs2-both-$ompt  -c 1 --cgs2 1 --inner_cgs2 1
+    done
+}
+
+disc(){
+    run fixed -c 1 --disc_stop 0
+    for fraction in 0.1 0.01
+    do
+        run disc-$fraction -c 1 --disc_stop 1 --disc_fraction $fraction
+    done
+}
+
+store(){
+    for nu in 0.2 0.25 0.3 0.35 0.4
+    do
+        run cold-$nu -c 1 -p $nu --store 0
+    done
+    rm -f solutions.bin
+    for nu in 0.2 0.25 0.3 0.35 0.4
+    do
+        run warm-$nu -c 1 -p $nu --store 1
+    done
+}
+
+checkpoint(){
+    run plain -c 1 --checkpoint 0
+    # The restart has to find the checkpoint of its own refinement
+    ALL_RFNMT=$RFNMT
+    for RFNMT in $ALL_RFNMT
+    do
+        rm -f checkpoint.bin
+        run checkpoint -c 1 --checkpoint 1
+        run restart    -c 1 --checkpoint 1 --restart 1
+    done
+    RFNMT=$ALL_RFNMT
+}
+
+ensemble(){
+    for nu in 0.2 0.25 0.3 0.35
+    do
+        run single-$nu -c 1 -p $nu
+    done
+    run ensemble -c 1 --ensemble 0.2,0.25,0.3,0.35
+}
+
+if [[ $# -lt 1 ]]; then
+    usage
+    exit 1
+fi
+STUDY=$1
+USER_RFNMT=""
+if [[ $# -eq 2 ]]; then
+    RFNMT=$2
+    USER_RFNMT=$2
+fi
+
+echo "CAPTION:$STUDY" | tee -a ${FILE}
+case $STUDY in
+    inner) inner | tee -a ${FILE} ;;
+    concurrent) concurrent | tee -a ${FILE} ;;
+    adaptive) adaptive | tee -a ${FILE} ;;
+    rigid) rigid | tee -a ${FILE} ;;
+    share) share | tee -a ${FILE} ;;
+    3d) threed | tee -a ${FILE} ;;
+    amgsetup) amgsetup | tee -a ${FILE} ;;
+    tune) tune | tee -a ${FILE} ;;
+    al) al | tee -a ${FILE} ;;
+    schur) schur | tee -a ${FILE} ;;
+    condensed) condensed | tee -a ${FILE} ;;
+    displacement) displacement | tee -a ${FILE} ;;
+    minres) minres | tee -a ${FILE} ;;
+    single) single | tee -a ${FILE} ;;
+    direct) direct | tee -a ${FILE} ;;
+    mg) mg | tee -a ${FILE} ;;
+    recycle) recycle | tee -a ${FILE} ;;
+    cgs2) cgs2 | tee -a ${FILE} ;;
+    disc) disc | tee -a ${FILE} ;;
+    store) store | tee -a ${FILE} ;;
+    checkpoint) checkpoint | tee -a ${FILE} ;;
+    ensemble) ensemble | tee -a ${FILE} ;;
+    *) usage; exit 1 ;;
+esac
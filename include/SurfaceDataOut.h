@@ -17,9 +17,7 @@
 template<int dim>
 class SurfaceDataOut : public DataOutFaces<dim> {
 public:
-    SurfaceDataOut(){
-        par = parameters::getInstance();
-    }
+    SurfaceDataOut(parameters *_par) : par(_par) {}
 
     virtual typename DataOutFaces<dim>::FaceDescriptor
     first_face (){
@@ -0,0 +1,339 @@
+/*! TODO
+ */
+
+#ifndef AMG_TUNER_H
+#define AMG_TUNER_H
+
+#include <deal.II/base/thread_management.h>
+#include <deal.II/base/timer.h>
+#include <deal.II/lac/solver_control.h>
+#include <deal.II/lac/solver_gmres.h>
+#include <deal.II/lac/trilinos_precondition.h>
+#include <deal.II/lac/trilinos_sparse_matrix.h>
+#include <deal.II/lac/trilinos_vector.h>
+
+#include <Teuchos_ParameterList.hpp>
+#include <ml_MultiLevelPreconditioner.h>
+
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <string>
+
+#include "inner_solver.h"
+#include "parameters.h"
+
+using namespace std;
+using namespace dealii;
+namespace Elastic
+{
+
+/*!
+ * Applies an InnerSolver as a preconditioner, the tuning counts how
+ * many applications of a fixed cost inner solver a candidate needs.
+ */
+template <class PreconditionerType>
+class InnerPreconditioner : public Subscriptor
+{
+public:
+    InnerPreconditioner (const InnerSolver<PreconditionerType> &_inverse,
+                         const double                          _tol)
+        :
+          inverse (_inverse),
+          tol     (_tol)
+    {}
+
+    void vmult (TrilinosWrappers::Vector       &dst,
+                const TrilinosWrappers::Vector &src) const
+    {
+        inverse.solve (dst, src, tol);
+    }
+
+private:
+    const InnerSolver<PreconditionerType> &inverse;
+    const double tol;
+};
+
+/*!
+ * Picks the AMG aggregation threshold, smoother, number of sweeps,
+ * the elliptic and the higher order elements flags of one block from
+ * a small grid of candidates. Every candidate is timed with the AMG
+ * setup and a solve to the inner tolerance with the configured inner
+ * solver, the solve is weighted with par->tune_weight expected
+ * applications. The fastest one is stored in par->tune_file under the
+ * problem signature and the block name, later runs read it back.
+ */
+class AMGTuner
+{
+public:
+    AMGTuner (parameters *_par, const std::string &_signature);
+
+    /*!
+     * Set threshold, smoother, sweeps and the elliptic and higher order
+     * flags of data for block M, from the cache if possible, otherwise
+     * with trial solves.
+     * Returns true if the settings were read from the cache.
+     */
+    bool tune (TrilinosWrappers::PreconditionAMG::AdditionalData &data,
+               const TrilinosWrappers::SparseMatrix             &M,
+               const std::string                                &block) const;
+
+    /*!
+     * Build the candidates with n_modes near null space vectors, stored
+     * one after the other, instead of the constant modes of data.
+     */
+    void set_null_space (std::vector<double> &modes, const unsigned int n_modes);
+
+    /*!
+     * ML parameters with the settings of data
+     * and the near null space modes.
+     */
+    static void parameter_list (const TrilinosWrappers::PreconditionAMG::AdditionalData &data,
+                                std::vector<double>                                     &modes,
+                                const unsigned int                                      n_modes,
+                                Teuchos::ParameterList                                  &list);
+
+    /*!
+     * ML communicates while it builds a hierarchy and MPI only allows
+     * one thread at a time (MPI_THREAD_SERIALIZED). Every
+     * PreconditionAMG::initialize of the process holds this lock.
+     */
+    static Threads::Mutex & setup_mutex ();
+
+private:
+    bool lookup (TrilinosWrappers::PreconditionAMG::AdditionalData &data,
+                 const std::string                                &block) const;
+
+    void store (const TrilinosWrappers::PreconditionAMG::AdditionalData &data,
+                const std::string                                      &block) const;
+
+    // Smoothers of the candidate grid, smoother_type is a plain pointer
+    // and has to point into this table
+    static const char *smoother (const unsigned int s);
+    static const unsigned int n_smoothers = 2;
+
+    // Setup time plus weighted solve time, infinity if it fails
+    double trial (const TrilinosWrappers::PreconditionAMG::AdditionalData &data,
+                  const TrilinosWrappers::SparseMatrix                   &M) const;
+
+    // pointer to parameter object
+    parameters *par;
+    const std::string signature;
+
+    std::vector<double>	*null_space;
+    unsigned int		n_modes;
+};
+
+}
+
+/*
+     ------------- IMPLEMENTATION --------------
+*/
+inline
+Elastic::AMGTuner::AMGTuner (parameters *_par, const std::string &_signature)
+    :
+      par        (_par),
+      signature  (_signature),
+      null_space (0),
+      n_modes    (0)
+{}
+
+inline
+void
+Elastic::AMGTuner::set_null_space (std::vector<double> &modes, const unsigned int _n_modes)
+{
+    null_space = &modes;
+    n_modes = _n_modes;
+}
+
+inline
+void
+Elastic::AMGTuner::parameter_list (const TrilinosWrappers::PreconditionAMG::AdditionalData &data,
+                                   std::vector<double>                                     &modes,
+                                   const unsigned int                                      n_modes,
+                                   Teuchos::ParameterList                                  &list)
+{
+    // Same choices as PreconditionAMG::initialize with AdditionalData
+    list = Teuchos::ParameterList();
+    if (data.elliptic)
+        ML_Epetra::SetDefaults("SA", list);
+    else{
+        ML_Epetra::SetDefaults("NSSA", list);
+        list.set("aggregation: block scaling", true);
+    }
+    if (data.higher_order_elements)
+        list.set("aggregation: type", "Uncoupled");
+    list.set("smoother: type", data.smoother_type);
+    list.set("smoother: sweeps", static_cast<int>(data.smoother_sweeps));
+    list.set("smoother: pre or post", "both");
+    list.set("coarse: type", "Amesos-KLU");
+    list.set("coarse: max size", 2000);
+    list.set("aggregation: threshold", data.aggregation_threshold);
+    list.set("ML output", 0);
+
+    list.set("null space: type", "pre-computed");
+    list.set("null space: dimension", static_cast<int>(n_modes));
+    list.set("null space: vectors", &modes[0]);
+}
+
+inline
+bool
+Elastic::AMGTuner::tune (TrilinosWrappers::PreconditionAMG::AdditionalData &data,
+                         const TrilinosWrappers::SparseMatrix             &M,
+                         const std::string                                &block) const
+{
+    if (lookup (data, block))
+        return true;
+
+    // Candidate grid, the smoothers are in smoother()
+    static const double       tune_thresholds[] = {0.0, 0.02, 0.08};
+    static const unsigned int tune_sweeps[]     = {1, 2, 3};
+
+    TrilinosWrappers::PreconditionAMG::AdditionalData candidate = data, best = data;
+    double best_time = std::numeric_limits<double>::max();
+
+    const unsigned int n_thresholds = sizeof(tune_thresholds)/sizeof(tune_thresholds[0]),
+            n_sweeps = sizeof(tune_sweeps)/sizeof(tune_sweeps[0]);
+
+    for (unsigned int e = 0; e < 2; ++e)
+        for (unsigned int h = 0; h < 2; ++h)
+            for (unsigned int t = 0; t < n_thresholds; ++t)
+                for (unsigned int s = 0; s < n_smoothers; ++s)
+                    for (unsigned int k = 0; k < n_sweeps; ++k){
+                        candidate.elliptic = (e == 0);
+                        candidate.higher_order_elements = (h == 1);
+                        candidate.aggregation_threshold = tune_thresholds[t];
+                        candidate.smoother_type = smoother (s);
+                        candidate.smoother_sweeps = tune_sweeps[k];
+
+                        const double time = trial (candidate, M);
+                        if (time < best_time){
+                            best_time = time;
+                            best = candidate;
+                        }
+                    }
+
+    data = best;
+    store (data, block);
+    return false;
+}
+
+inline
+const char *
+Elastic::AMGTuner::smoother (const unsigned int s)
+{
+    static const char *const smoothers[n_smoothers] = {"Chebyshev", "symmetric Gauss-Seidel"};
+    return smoothers[s];
+}
+
+/*!
+ * Cache lines are "signature block threshold sweeps elliptic
+ * higher_order smoother", the smoother name is the rest of the line.
+ */
+inline
+bool
+Elastic::AMGTuner::lookup (TrilinosWrappers::PreconditionAMG::AdditionalData &data,
+                           const std::string                                &block) const
+{
+    std::ifstream ifs (par->tune_file.c_str());
+    std::string line;
+
+    while (std::getline (ifs, line)){
+        std::istringstream iss (line);
+        std::string sig, blk, smoother_name;
+        double threshold;
+        unsigned int sweeps;
+        bool elliptic, higher_order;
+
+        if (!(iss >> sig >> blk >> threshold >> sweeps >> elliptic >> higher_order))
+            continue;
+        if (sig != signature || blk != block)
+            continue;
+        std::getline (iss >> std::ws, smoother_name);
+
+        // smoother_type is a plain pointer, map back to the candidate
+        for (unsigned int s = 0; s < n_smoothers; ++s)
+            if (smoother_name == smoother (s)){
+                data.aggregation_threshold = threshold;
+                data.smoother_sweeps = sweeps;
+                data.elliptic = elliptic;
+                data.higher_order_elements = higher_order;
+                data.smoother_type = smoother (s);
+                return true;
+            }
+    }
+    return false;
+}
+
+inline
+void
+Elastic::AMGTuner::store (const TrilinosWrappers::PreconditionAMG::AdditionalData &data,
+                          const std::string                                      &block) const
+{
+    std::ofstream ofs (par->tune_file.c_str(), std::ios::app);
+    ofs << signature << " " << block << " "
+        << data.aggregation_threshold << " "
+        << data.smoother_sweeps << " "
+        << data.elliptic << " "
+        << data.higher_order_elements << " "
+        << data.smoother_type << std::endl;
+}
+
+inline
+Threads::Mutex &
+Elastic::AMGTuner::setup_mutex ()
+{
+    static Threads::Mutex mutex;
+    return mutex;
+}
+
+inline
+double
+Elastic::AMGTuner::trial (const TrilinosWrappers::PreconditionAMG::AdditionalData &data,
+                          const TrilinosWrappers::SparseMatrix                   &M) const
+{
+    Timer timer;
+    timer.start ();
+
+    TrilinosWrappers::PreconditionAMG preconditioner;
+    {
+        Threads::Mutex::ScopedLock lock (setup_mutex ());
+        // Waiting for another build is not part of the setup time
+        timer.restart ();
+        if (null_space){
+            Teuchos::ParameterList list;
+            parameter_list (data, *null_space, n_modes, list);
+            preconditioner.initialize (M, list);
+        }else
+            preconditioner.initialize (M, data);
+    }
+    const double setup_time = timer.wall_time ();
+
+    // Right hand side with all components excited
+    TrilinosWrappers::Vector x (M.m()), b (M.m());
+    for (unsigned int i = 0; i < b.size(); ++i)
+        b(i) = 1.0 + (i%7)*0.1;
+
+    // The configured inner solver, FGMRES solves to the inner tolerance
+    // itself, the fixed cost ones are counted by an outer FGMRES
+    const InnerSolver<TrilinosWrappers::PreconditionAMG> inverse (par, M, preconditioner, "Tune");
+
+    timer.restart ();
+    try{
+        if (par->inner_solver == iFlags::FGMRES)
+            inverse.solve (x, b, par->InvMatPreTOL);
+        else{
+            SolverControl control (200, par->InvMatPreTOL*b.l2_norm(), false, false);
+            SolverFGMRES<TrilinosWrappers::Vector> solver (control);
+            solver.solve (M, x, b, InnerPreconditioner<TrilinosWrappers::PreconditionAMG>
+                          (inverse, par->InvMatPreTOL));
+        }
+    }catch (const SolverControl::NoConvergence &){
+        return std::numeric_limits<double>::max();
+    }
+    timer.stop ();
+
+    return setup_time + par->tune_weight*timer.wall_time ();
+}
+
+#endif // AMG_TUNER_H
@@ -23,7 +23,7 @@ namespace Elastic
     class BoundaryValues: public Function<dim>
 	{
     public:
-        BoundaryValues () : Function<dim>(dim+1){ par = parameters::getInstance();}
+        BoundaryValues (parameters *_par) : Function<dim>(dim+1), par(_par) {}
 		
 		virtual double value (const Point<dim>   &p, const unsigned int  component = 0) const;
 		
@@ -42,7 +42,8 @@ Elastic::BoundaryValues<dim>::value (const Point<dim>  &p, const unsigned int co
 {
     Assert (component < this->n_components, ExcIndexRange (component, 0, this->n_components));
 
-    if (component == 1)
+    // vertical component
+    if (component == dim-1)
         return par->load;
     return 0;
 }
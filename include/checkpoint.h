@@ -0,0 +1,102 @@
+/*! TODO
+ */
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <deal.II/lac/trilinos_block_sparse_matrix.h>
+#include <deal.II/lac/trilinos_block_vector.h>
+
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/serialization/string.hpp>
+#include <boost/serialization/vector.hpp>
+
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace dealii;
+namespace Elastic
+{
+
+/*!
+ * Binary checkpoints of a run.
+ * The file holds the phase reached, the problem signature, the
+ * triangulation, the DoF numbering and, depending on the phase, the
+ * assembled matrices and right hand sides, the current solution and
+ * the outer iterations spent on it. Matrices are stored as
+ * (row, column, value) triples per block, the sparsity pattern is
+ * rebuilt from the DoF numbering on restart.
+ */
+namespace Checkpoint
+{
+enum Phase { NONE = 0, GEOMETRY = 1, ASSEMBLED = 2, SOLVING = 3, SOLVED = 4 };
+
+inline std::string phase2str (const int phase)
+{
+    switch (phase){
+    case GEOMETRY:  return "geometry";
+    case ASSEMBLED: return "assembled";
+    case SOLVING:   return "solving";
+    case SOLVED:    return "solved";
+    default:        return "none";
+    }
+}
+
+template <class Archive>
+void save_matrix (Archive &ar, const TrilinosWrappers::BlockSparseMatrix &M)
+{
+    for (unsigned int i = 0; i < M.n_block_rows(); ++i)
+        for (unsigned int j = 0; j < M.n_block_cols(); ++j){
+            std::vector<unsigned int> rows, cols;
+            std::vector<double> values;
+            for (TrilinosWrappers::SparseMatrix::const_iterator it = M.block(i,j).begin();
+                 it != M.block(i,j).end(); ++it){
+                rows.push_back (it->row());
+                cols.push_back (it->column());
+                values.push_back (it->value());
+            }
+            ar << rows << cols << values;
+        }
+}
+
+// M has to be initialized with the sparsity pattern of the saved matrix
+template <class Archive>
+void load_matrix (Archive &ar, TrilinosWrappers::BlockSparseMatrix &M)
+{
+    M = 0;
+    for (unsigned int i = 0; i < M.n_block_rows(); ++i)
+        for (unsigned int j = 0; j < M.n_block_cols(); ++j){
+            std::vector<unsigned int> rows, cols;
+            std::vector<double> values;
+            ar >> rows >> cols >> values;
+            for (unsigned int k = 0; k < values.size(); ++k)
+                M.block(i,j).set (rows[k], cols[k], values[k]);
+        }
+    M.compress (VectorOperation::insert);
+}
+
+template <class Archive>
+void save_vector (Archive &ar, const TrilinosWrappers::BlockVector &v)
+{
+    std::vector<double> x (v.size());
+    for (unsigned int i = 0; i < x.size(); ++i)
+        x[i] = v(i);
+    ar << x;
+}
+
+template <class Archive>
+void load_vector (Archive &ar, TrilinosWrappers::BlockVector &v)
+{
+    std::vector<double> x;
+    ar >> x;
+    AssertThrow (x.size() == v.size(), ExcDimensionMismatch (x.size(), v.size()));
+    for (unsigned int i = 0; i < x.size(); ++i)
+        v(i) = x[i];
+    v.compress (VectorOperation::insert);
+}
+}
+}
+
+#endif // CHECKPOINT_H
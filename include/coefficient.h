@@ -25,7 +25,7 @@ namespace Elastic
 	public:
 		double mu, beta;
 		
-        Coefficients (double E, double v)  : Function<dim>(), mu( get_mu(E,v) ), beta( get_beta(E,v) ) {par = parameters::getInstance();}
+        Coefficients (double E, double v)  : Function<dim>(), mu( get_mu(E,v) ), beta( get_beta(E,v) ) {}
 		
 		double get_mu(double E, double v);
 		
@@ -43,9 +43,6 @@ namespace Elastic
 		virtual void beta_value_list (const std::vector<Point<dim> > &points,
 									  std::vector<double>            &values,
 									  const unsigned int              component = 0) const;
-	private:
-		// pointer to parameter object
-        parameters *par;
 	};
 }
 /*
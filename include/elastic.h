@@ -44,6 +44,7 @@
 #include <deal.II/numerics/matrix_tools.h>
 #include <deal.II/numerics/vector_tools.h>
 
+#include <algorithm>
 #include <fstream>
 #include <sstream>
 #include <string>
@@ -55,6 +56,7 @@
 #include "exact.h"
 #include "parameters.h"
 #include "preconditioner.h"
+#include "preconditioner_diagonal.h"
 #include "rhs.h"
 #include "SurfaceDataOut.h"
 
@@ -65,7 +67,8 @@ namespace Elastic
 template <int dim>
 class ElasticProblem : public ElasticBase<dim> {
 public:
-    ElasticProblem (const unsigned int degree, const int _info);
+    ElasticProblem (parameters *_par, const unsigned int degree, const int _info,
+                    std::ostream &out = std::cout);
 
 private:
     // Setup Algebraic multigrid(AMG)
@@ -73,9 +76,12 @@ private:
     // Solve the system
     virtual void solve ();
 
-    std_cxx1x::shared_ptr<TrilinosWrappers::PreconditionAMG> A0_preconditioner;
-    std_cxx1x::shared_ptr<TrilinosWrappers::PreconditionAMG> A1_preconditioner;
+    // One AMG per displacement component, Schur complement AMG
+    std::vector<std_cxx1x::shared_ptr<TrilinosWrappers::PreconditionAMG> > A_preconditioner;
     std_cxx1x::shared_ptr<TrilinosWrappers::PreconditionAMG> S_preconditioner;
+
+    // Average of the displacement blocks, fine level of the shared AMG
+    TrilinosWrappers::SparseMatrix shared_block;
 };
 }
 
@@ -83,68 +89,80 @@ private:
  ------------- IMPLEMENTATION --------------
  */
 template <int dim>
-Elastic::ElasticProblem<dim>::ElasticProblem (const unsigned int degree, const int _info)
-    : Elastic::ElasticBase<dim>(degree, _info, dim+1){}
+Elastic::ElasticProblem<dim>::ElasticProblem (parameters *_par, const unsigned int degree, const int _info,
+                                               std::ostream &out)
+    : Elastic::ElasticBase<dim>(_par, degree, _info, dim+1, out){}
 
 /**
- * Setup preconditioners
+ * Setup preconditioners, one AMG for each of the dim displacement
+ * blocks and one for the Schur complement approximation.
  */
 template <int dim>
 void
 Elastic::ElasticProblem<dim>::setup_AMG ()
 {
     // Reset preconditioners and matrices
-    A0_preconditioner.reset ();
-    A1_preconditioner.reset ();
+    A_preconditioner.clear ();
     S_preconditioner.reset ();
 
-    A0_preconditioner
-            = std_cxx1x::shared_ptr<TrilinosWrappers::PreconditionAMG>(new TrilinosWrappers::PreconditionAMG);
-
-    A1_preconditioner
-            = std_cxx1x::shared_ptr<TrilinosWrappers::PreconditionAMG>(new TrilinosWrappers::PreconditionAMG);
-    
     S_preconditioner
             = std_cxx1x::shared_ptr<TrilinosWrappers::PreconditionAMG>(new TrilinosWrappers::PreconditionAMG);
 
     std::vector<std::vector<bool> > constant_modes;
     std::vector<bool>  displacement_components (dim+1,false);
-    
-    // A00
-    displacement_components[0] = true;
-    DoFTools::extract_constant_modes (ElasticBase<dim>::dof_handler,
-                                      displacement_components,
-                                      constant_modes);
-    
-    TrilinosWrappers::PreconditionAMG::AdditionalData amg_A0;
-    amg_A0.constant_modes = constant_modes;
-    
-    amg_A0.elliptic = true;
-    amg_A0.higher_order_elements = false;
-    amg_A0.smoother_sweeps = 2;
-    amg_A0.aggregation_threshold = ElasticBase<dim>::par->threshold;
-    
-    
-    A0_preconditioner->initialize( ElasticBase<dim>::system_preconditioner.block(0,0),amg_A0);
-    //
-    
-    //A11
-    displacement_components[0] = false;
-    displacement_components[1] = true;
-    DoFTools::extract_constant_modes (ElasticBase<dim>::dof_handler,
-                                      displacement_components,
-                                      constant_modes);
-    
-    TrilinosWrappers::PreconditionAMG::AdditionalData amg_A1;
-    amg_A1.constant_modes = constant_modes;
-    
-    amg_A1.elliptic = true;
-    amg_A1.higher_order_elements = false;
-    amg_A1.smoother_sweeps = 2;
-    amg_A1.aggregation_threshold = ElasticBase<dim>::par->threshold;
-    
-    A1_preconditioner->initialize( ElasticBase<dim>::system_preconditioner.block(1,1),amg_A1);
-    //
+
+    // The hierarchies are independent, with par->amg_concurrent
+    // they are built on separate threads
+    Threads::TaskGroup<void> tasks;
+    std::vector<TrilinosWrappers::PreconditionAMG::AdditionalData> amg_A (dim);
+
+    for(unsigned int i=0; i<dim; ++i){
+        amg_A[i].elliptic = true;
+        amg_A[i].higher_order_elements = false;
+        amg_A[i].smoother_sweeps = 2;
+        amg_A[i].aggregation_threshold = ElasticBase<dim>::par->threshold;
+    }
+
+    if(ElasticBase<dim>::par->share_amg){
+        // The displacement blocks have the same sparsity pattern and
+        // nearly the same scalar elliptic structure, aggregate once on
+        // their average and use the hierarchy for every component.
+        shared_block.copy_from (ElasticBase<dim>::system_preconditioner.block(0,0));
+        for(unsigned int i=1; i<dim; ++i)
+            shared_block.add (1.0, ElasticBase<dim>::system_preconditioner.block(i,i));
+        shared_block *= 1.0/dim;
+
+        displacement_components[0] = true;
+        DoFTools::extract_constant_modes (ElasticBase<dim>::dof_handler,
+                                          displacement_components,
+                                          constant_modes);
+        amg_A[0].constant_modes = constant_modes;
+        ElasticBase<dim>::tune_AMG (amg_A[0], shared_block, "A_shared");
+
+        std_cxx1x::shared_ptr<TrilinosWrappers::PreconditionAMG>
+                shared_preconditioner (new TrilinosWrappers::PreconditionAMG);
+        ElasticBase<dim>::setup_block_AMG (tasks, *shared_preconditioner,
+                                           shared_block, amg_A[0], "A shared");
+        A_preconditioner.resize (dim, shared_preconditioner);
+    }else{
+        // A_ii
+        for(unsigned int i=0; i<dim; ++i){
+            std::fill (displacement_components.begin(), displacement_components.end(), false);
+            displacement_components[i] = true;
+            DoFTools::extract_constant_modes (ElasticBase<dim>::dof_handler,
+                                              displacement_components,
+                                              constant_modes);
+            amg_A[i].constant_modes = constant_modes;
+            ElasticBase<dim>::tune_AMG (amg_A[i], ElasticBase<dim>::system_preconditioner.block(i,i),
+                                        "A"+Utilities::int_to_string(i+1));
+
+            A_preconditioner.push_back (std_cxx1x::shared_ptr<TrilinosWrappers::PreconditionAMG>
+                                        (new TrilinosWrappers::PreconditionAMG));
+            ElasticBase<dim>::setup_block_AMG (tasks, *A_preconditioner[i],
+                                               ElasticBase<dim>::system_preconditioner.block(i,i),
+                                               amg_A[i], "A"+Utilities::int_to_string(i+1));
+        }
+    }
     
     TrilinosWrappers::PreconditionAMG::AdditionalData amg_S;
     
@@ -152,48 +170,69 @@ Elastic::ElasticProblem<dim>::setup_AMG ()
     amg_S.higher_order_elements = false;
     amg_S.smoother_sweeps = 2;
     amg_S.aggregation_threshold = ElasticBase<dim>::par->threshold;
-    
-    // elem-by-elem Schur
-    S_preconditioner->initialize( ElasticBase<dim>::system_preconditioner.block(2,2), amg_S);
+    ElasticBase<dim>::tune_AMG (amg_S, ElasticBase<dim>::schur_operator(),
+                                "S_"+ElasticBase<dim>::par->schur2str(ElasticBase<dim>::par->schur_type));
+    
+    // Schur approximation selected with par->schur_type
+    ElasticBase<dim>::setup_block_AMG (tasks, *S_preconditioner,
+                                       ElasticBase<dim>::schur_operator(),
+                                       amg_S, "S");
+    tasks.join_all ();
+
+    ElasticBase<dim>::amg_memory = S_preconditioner->memory_consumption();
+    if(ElasticBase<dim>::par->share_amg)
+        ElasticBase<dim>::amg_memory += A_preconditioner[0]->memory_consumption()
+                + shared_block.memory_consumption();
+    else
+        for(unsigned int i=0; i<dim; ++i)
+            ElasticBase<dim>::amg_memory += A_preconditioner[i]->memory_consumption();
 }
 
 template <int dim>
 void
 Elastic::ElasticProblem<dim>::solve ()
 {
-    
+    std::vector<const TrilinosWrappers::PreconditionAMG*> A_preconditioners;
+    for(unsigned int i=0; i<dim; ++i)
+        A_preconditioners.push_back (A_preconditioner[i].get());
+
+    if(ElasticBase<dim>::par->minres){
+        SolverControl solver_control (ElasticBase<dim>::system_matrix.m(),
+                                      ElasticBase<dim>::par->TOL*ElasticBase<dim>::system_rhs.l2_norm());
+
+        ElasticBase<dim>::timer.enter_section("Preconditioner workspace");
+        const BlockDiagonalPreconditioner<TrilinosWrappers::PreconditionAMG,
+                                          TrilinosWrappers::PreconditionAMG>
+                preconditioner( ElasticBase<dim>::par,
+                                ElasticBase<dim>::system_preconditioner,
+                                ElasticBase<dim>::schur_operator(),
+                                A_preconditioners,
+                                *S_preconditioner);
+        ElasticBase<dim>::timer.exit_section("Preconditioner workspace");
+
+        ElasticBase<dim>::minres_solve (preconditioner, solver_control);
+        ElasticBase<dim>::workspace = preconditioner.workspace_statistics();
+        return;
+    }
+
+    OuterSolverControl solver_control (ElasticBase<dim>::par,
+                                       ElasticBase<dim>::system_matrix.m(),
+                                       ElasticBase<dim>::par->TOL*ElasticBase<dim>::system_rhs.l2_norm());
+
+    // Inner solvers allocate their Krylov workspaces here
+    ElasticBase<dim>::timer.enter_section("Preconditioner workspace");
     const BlockSchurPreconditioner<TrilinosWrappers::PreconditionAMG,
                                    TrilinosWrappers::PreconditionAMG>
-            preconditioner( ElasticBase<dim>::system_preconditioner,
-                            *A0_preconditioner,
-                            *A1_preconditioner,
-                            *S_preconditioner); // system_matrix
-    
-    SolverControl solver_control (ElasticBase<dim>::system_matrix.m(),
-                                  ElasticBase<dim>::par->TOL*ElasticBase<dim>::system_rhs.l2_norm());
-
-#ifdef LOG_RUN
-    solver_control.enable_history_data();
-    solver_control.log_history(true);
-    solver_control.log_result(true);
-#endif
-    
-    SolverFGMRES<TrilinosWrappers::BlockVector>
-            solver (solver_control,
-                    SolverFGMRES<TrilinosWrappers::BlockVector >::AdditionalData(100));
-    
-#ifdef LOG_RUN
-    deallog.push("Outer");
-#endif
-    solver.solve(ElasticBase<dim>::system_matrix,
-                 ElasticBase<dim>::solution,
-                 ElasticBase<dim>::system_rhs,
-                 preconditioner);
-#ifdef LOG_RUN
-    deallog.pop();
-#endif
-    
-    ElasticBase<dim>::par->system_iter = solver_control.last_step();
+            preconditioner( ElasticBase<dim>::par,
+                            ElasticBase<dim>::system_preconditioner,
+                            ElasticBase<dim>::schur_operator(),
+                            A_preconditioners,
+                            *S_preconditioner,
+                            &solver_control); // system_matrix
+    ElasticBase<dim>::timer.exit_section("Preconditioner workspace");
+
+    ElasticBase<dim>::outer_solve (preconditioner, solver_control);
+    ElasticBase<dim>::workspace = preconditioner.workspace_statistics();
 }
 
 #endif
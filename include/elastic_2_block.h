@@ -46,8 +46,10 @@
 #include <typeinfo>
 
 #include "elastic_base.h"
+#include "hmatrix.h"
 #include "parameters.h"
 #include "preconditioner_2block.h"
+#include "preconditioner_diagonal.h"
 
 using namespace std;
 using namespace dealii;
@@ -56,7 +58,8 @@ namespace Elastic
 template <int dim>
 class Elastic2Blocks : public ElasticBase<dim> {
 public:
-    Elastic2Blocks (const unsigned int degree, const int _info);
+    Elastic2Blocks (parameters *_par, const unsigned int degree, const int _info,
+                    std::ostream &out = std::cout);
 
 private:
     // Setup Algebraic multigrid(AMG)
@@ -66,6 +69,11 @@ private:
 
     std_cxx1x::shared_ptr<TrilinosWrappers::PreconditionAMG> A_preconditioner;
     std_cxx1x::shared_ptr<TrilinosWrappers::PreconditionAMG> S_preconditioner;
+    // Block low-rank Schur complement with par->schur_type == HMATRIX
+    std_cxx1x::shared_ptr<HMatrixSchur<dim> > S_hmatrix;
+
+    // Build and factorize S_hmatrix, needs the AMG of A
+    void setup_hmatrix ();
 };
 }
 
@@ -73,8 +81,9 @@ private:
  ------------- IMPLEMENTATION --------------
  */
 template <int dim>
-Elastic::Elastic2Blocks<dim>::Elastic2Blocks (const unsigned int degree, const int _info)
-    : Elastic::ElasticBase<dim>(degree, _info, 2){}
+Elastic::Elastic2Blocks<dim>::Elastic2Blocks (parameters *_par, const unsigned int degree, const int _info,
+                                               std::ostream &out)
+    : Elastic::ElasticBase<dim>(_par, degree, _info, 2, out){}
 
 /**
  * Setup preconditioners
@@ -89,27 +98,22 @@ Elastic::Elastic2Blocks<dim>::setup_AMG ()
     S_preconditioner
             = std_cxx1x::shared_ptr<TrilinosWrappers::PreconditionAMG>(new TrilinosWrappers::PreconditionAMG());
 
-    std::vector<std::vector<bool> > constant_modes;
-    std::vector<bool>  displacement_components (ElasticBase<dim>::n_components,true);
+    // The hierarchies are independent, with par->amg_concurrent
+    // they are built on separate threads
+    Threads::TaskGroup<void> tasks;
 
     // A
-    //    displacement_components[0] = true;
-    displacement_components[ElasticBase<dim>::n_components-1] = false;
-    DoFTools::extract_constant_modes (ElasticBase<dim>::dof_handler,
-                                      displacement_components,
-                                      constant_modes);
-
-    TrilinosWrappers::PreconditionAMG::AdditionalData amg_A;
-
-    amg_A.constant_modes = constant_modes;
-    amg_A.elliptic = true;
-    amg_A.higher_order_elements = false;
-    amg_A.smoother_sweeps = 2;
-    amg_A.aggregation_threshold = ElasticBase<dim>::par->threshold;
-//    amg_A.output_details = true;
+    ElasticBase<dim>::setup_displacement_AMG (tasks, *A_preconditioner,
+                                              ElasticBase<dim>::system_preconditioner.block(0,0), "A");
 
+    // The columns of the H-matrix are computed with A solves
+    if(ElasticBase<dim>::par->schur_type == sFlags::HMATRIX){
+        tasks.join_all ();
+        setup_hmatrix ();
+        ElasticBase<dim>::amg_memory = A_preconditioner->memory_consumption();
+        return;
+    }
 
-    A_preconditioner->initialize( ElasticBase<dim>::system_preconditioner.block(0,0),amg_A);
     //
     TrilinosWrappers::PreconditionAMG::AdditionalData amg_S;
 
@@ -117,44 +121,108 @@ Elastic::Elastic2Blocks<dim>::setup_AMG ()
     amg_S.higher_order_elements = false;
     amg_S.smoother_sweeps = 2;
     amg_S.aggregation_threshold = ElasticBase<dim>::par->threshold;
+    ElasticBase<dim>::tune_AMG (amg_S, ElasticBase<dim>::schur_operator(),
+                                "S_"+ElasticBase<dim>::par->schur2str(ElasticBase<dim>::par->schur_type));
 
-    // elem-by-elem Schur
-    S_preconditioner->initialize( ElasticBase<dim>::system_preconditioner.block(1,1), amg_S);
+    // Schur approximation selected with par->schur_type
+    ElasticBase<dim>::setup_block_AMG (tasks, *S_preconditioner,
+                                       ElasticBase<dim>::schur_operator(),
+                                       amg_S, "S");
+    tasks.join_all ();
+
+    ElasticBase<dim>::amg_memory = A_preconditioner->memory_consumption()
+            + S_preconditioner->memory_consumption();
+}
+
+template <int dim>
+void
+Elastic::Elastic2Blocks<dim>::setup_hmatrix ()
+{
+    std::vector<Point<dim> > points;
+    ElasticBase<dim>::pressure_support_points (points);
+
+    S_hmatrix = std_cxx1x::shared_ptr<HMatrixSchur<dim> >(new HMatrixSchur<dim>(ElasticBase<dim>::par));
+
+    ElasticBase<dim>::timer.enter_section("H-matrix build");
+    S_hmatrix->build (ElasticBase<dim>::system_matrix, *A_preconditioner, points);
+    ElasticBase<dim>::timer.exit_section("H-matrix build");
+
+    ElasticBase<dim>::timer.enter_section("H-LU");
+    S_hmatrix->factorize ();
+    ElasticBase<dim>::timer.exit_section("H-LU");
+
+    ElasticBase<dim>::oout << GREEN << " | H-matrix: low-rank blocks = " << S_hmatrix->n_low_rank()
+                           << ", max rank = " << S_hmatrix->max_rank()
+                           << ", A solves = " << S_hmatrix->n_solves()
+                           << ", memory = " << S_hmatrix->memory_consumption()/(1024.0*1024.0)
+                           << " MB, peak S entries = " << S_hmatrix->peak_storage()/(1024.0*1024.0)
+                           << " MB" << RESET << flush;
+    if(S_hmatrix->n_unconverged() > 0)
+        ElasticBase<dim>::oout << RED << " | " << S_hmatrix->n_unconverged()
+                               << " A solves did not converge" << RESET << flush;
 }
 
 template <int dim>
 void
 Elastic::Elastic2Blocks<dim>::solve ()
 {
+    if(ElasticBase<dim>::par->minres){
+        std::vector<const TrilinosWrappers::PreconditionAMG*> A_preconditioners
+                (1, A_preconditioner.get());
+
+        SolverControl solver_control (ElasticBase<dim>::system_matrix.m(),
+                                      ElasticBase<dim>::par->TOL*ElasticBase<dim>::system_rhs.l2_norm());
+
+        ElasticBase<dim>::timer.enter_section("Preconditioner workspace");
+        const BlockDiagonalPreconditioner<TrilinosWrappers::PreconditionAMG,
+                                          TrilinosWrappers::PreconditionAMG>
+                preconditioner( ElasticBase<dim>::par,
+                                ElasticBase<dim>::system_preconditioner,
+                                ElasticBase<dim>::schur_operator(),
+                                A_preconditioners,
+                                *S_preconditioner);
+        ElasticBase<dim>::timer.exit_section("Preconditioner workspace");
+
+        ElasticBase<dim>::minres_solve (preconditioner, solver_control);
+        ElasticBase<dim>::workspace = preconditioner.workspace_statistics();
+        return;
+    }
+
+    OuterSolverControl solver_control (ElasticBase<dim>::par,
+                                       ElasticBase<dim>::system_matrix.m(),
+                                       ElasticBase<dim>::par->TOL*ElasticBase<dim>::system_rhs.l2_norm());
+
+    if(ElasticBase<dim>::par->schur_type == sFlags::HMATRIX){
+        ElasticBase<dim>::timer.enter_section("Preconditioner workspace");
+        const Preconditioner2Blocks< TrilinosWrappers::PreconditionAMG, // A, H-LU of the Schur
+                HMatrixSchur<dim> >
+                preconditioner( ElasticBase<dim>::par,
+                                ElasticBase<dim>::system_preconditioner,
+                                ElasticBase<dim>::schur_operator(),
+                                *A_preconditioner,
+                                *S_hmatrix,
+                                &solver_control);
+        ElasticBase<dim>::timer.exit_section("Preconditioner workspace");
+
+        ElasticBase<dim>::outer_solve (preconditioner, solver_control);
+        ElasticBase<dim>::workspace = preconditioner.workspace_statistics();
+        return;
+    }
+
+    // Inner solvers allocate their Krylov workspaces here
+    ElasticBase<dim>::timer.enter_section("Preconditioner workspace");
     const Preconditioner2Blocks< TrilinosWrappers::PreconditionAMG, // A, schur
             TrilinosWrappers::PreconditionAMG>
-            preconditioner( ElasticBase<dim>::system_preconditioner, *A_preconditioner, *S_preconditioner); // system_matrix
-
-    SolverControl solver_control (ElasticBase<dim>::system_matrix.m(),
-                                  ElasticBase<dim>::par->TOL*ElasticBase<dim>::system_rhs.l2_norm());
-
-#ifdef LOGRUN
-    solver_control.enable_history_data();
-    solver_control.log_history(true);
-    solver_control.log_result(true);
-#endif
-
-    SolverFGMRES<TrilinosWrappers::BlockVector>
-            solver (solver_control,
-                    SolverFGMRES<TrilinosWrappers::BlockVector >::AdditionalData(100)); // With restart of 100
-
-#ifdef LOGRUN
-    deallog.push("Outer");
-#endif
-    solver.solve(ElasticBase<dim>::system_matrix,
-                 ElasticBase<dim>::solution,
-                 ElasticBase<dim>::system_rhs,
-                 preconditioner);
-#ifdef LOGRUN
-    deallog.pop();
-#endif
-
-    ElasticBase<dim>::par->system_iter = solver_control.last_step();
+            preconditioner( ElasticBase<dim>::par,
+                            ElasticBase<dim>::system_preconditioner,
+                            ElasticBase<dim>::schur_operator(),
+                            *A_preconditioner,
+                            *S_preconditioner,
+                            &solver_control); // system_matrix
+    ElasticBase<dim>::timer.exit_section("Preconditioner workspace");
+
+    ElasticBase<dim>::outer_solve (preconditioner, solver_control);
+    ElasticBase<dim>::workspace = preconditioner.workspace_statistics();
 }
 
 
@@ -0,0 +1,90 @@
+/*! TODO
+ */
+
+#ifndef ELASTIC_API_H
+#define ELASTIC_API_H
+
+#include <deal.II/base/std_cxx1x/shared_ptr.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "parameters.h"
+
+namespace Elastic
+{
+
+/*!
+ * Configuration of an in-memory solve. The parameters are read once,
+ * from default.cfg if it is in the working directory, the file given
+ * with -f and options, which are written as on the command line.
+ * Without default.cfg the built-in defaults are used. The fields below override them for
+ * every solve, so repeated solves do not parse files again. Invalid
+ * options throw a ParameterException.
+ */
+struct Configuration
+{
+    Configuration (const std::vector<std::string> &options = std::vector<std::string>());
+
+    // Poisson ratio, negative keeps the configured value
+    double			poisson;
+    // Global refinements, negative keeps the configured value
+    int				refinements;
+    // Write solution_*.vtu and surface_*.gnuplot like the executable
+    bool			output_files;
+
+    std_cxx1x::shared_ptr<const parameters>	base;
+};
+
+/*!
+ * Result of an in-memory solve. Displacements are numbered first and
+ * component wise, the pressure last. Surface values are given at the
+ * vertices of the ice and upper boundary, dim values per vertex, in the
+ * scaled coordinates of the mesh.
+ */
+struct Result
+{
+    Result ();
+
+    unsigned int				dimension;
+    std::vector<unsigned int>	dofs_per_component;
+    std::vector<double>			solution;
+
+    std::vector<double>			surface_points;
+    std::vector<double>			surface_displacement;
+
+    // Outer iterations and the total inner iterations of the solve
+    unsigned int				iterations, inner_iterations, schur_iterations;
+
+    // Options changed because they do not fit together, see parameters::warnings
+    std::vector<std::string>	warnings;
+};
+
+/*!
+ * Solve the problem given by config. The terminal output goes to out,
+ * or is discarded. deallog is left as the caller configured it, the
+ * solvers log to it like in the executable. MPI has to be
+ * initialized by the caller, with Utilities::MPI::MPI_InitFinalize as
+ * in main.cc.
+ */
+Result solve (const Configuration &config, std::ostream &out);
+Result solve (const Configuration &config);
+
+/*!
+ * Solve the problem configured in par as the executable does, result
+ * is filled if given. All statistics are written to par.
+ */
+void run (parameters *par, std::ostream &out, Result *result = 0);
+
+/*!
+ * Solve one problem per Poisson ratio of par->ensemble as tasks on the
+ * thread pool, see parameters::ensemble. MPI is initialized with
+ * MPI_THREAD_SERIALIZED, so the members build their AMG hierarchies
+ * one at a time under AMGTuner::setup_mutex, the rest of the solves
+ * overlaps.
+ */
+void run_ensemble (parameters *par, std::ostream &out);
+}
+
+#endif // ELASTIC_API_H
@@ -8,6 +8,9 @@
 #include <deal.II/base/function.h>
 #include <deal.II/base/logstream.h>
 #include <deal.II/base/quadrature_lib.h>
+#include <deal.II/base/std_cxx1x/bind.h>
+#include <deal.II/base/std_cxx1x/function.h>
+#include <deal.II/base/thread_management.h>
 #include <deal.II/base/timer.h>
 #include <deal.II/base/utilities.h>
 #include <deal.II/dofs/block_info.h>
@@ -15,9 +18,11 @@
 #include <deal.II/dofs/dof_handler.h>
 #include <deal.II/dofs/dof_renumbering.h>
 #include <deal.II/dofs/dof_tools.h>
+#include <deal.II/fe/fe_dgp.h>
 #include <deal.II/fe/fe_q.h>
 #include <deal.II/fe/fe_system.h>
 #include <deal.II/fe/fe_values.h>
+#include <deal.II/fe/mapping_q1.h>
 #include <deal.II/grid/grid_generator.h>
 #include <deal.II/grid/tria.h>
 #include <deal.II/grid/tria_accessor.h>
@@ -30,6 +35,7 @@
 #include <deal.II/lac/precondition.h>
 #include <deal.II/lac/solver_cg.h>
 #include <deal.II/lac/solver_gmres.h>
+#include <deal.II/lac/solver_minres.h>
 #include <deal.II/lac/sparse_direct.h>
 #include <deal.II/lac/sparse_ilu.h>
 #include <deal.II/lac/trilinos_block_sparse_matrix.h>
@@ -43,6 +49,12 @@
 #include <deal.II/numerics/matrix_tools.h>
 #include <deal.II/numerics/vector_tools.h>
 
+#include <Teuchos_ParameterList.hpp>
+#include <ml_MultiLevelPreconditioner.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
 #include <fstream>
 #include <sstream>
 #include <string>
@@ -51,9 +63,17 @@
 #include "boundary.h"
 #include "coefficient.h"
 #include "exact.h"
+#include "inner_solver.h"
+#include "outer_control.h"
 #include "parameters.h"
 #include "rhs.h"
 #include "SurfaceDataOut.h"
+#include "amg_tuner.h"
+#include "vector_pool.h"
+#include "recycling_solver.h"
+#include "solver_cgs2.h"
+#include "solution_store.h"
+#include "checkpoint.h"
 
 using namespace dealii;
 namespace Elastic
@@ -62,9 +82,31 @@ namespace Elastic
 template <int dim>
 class ElasticBase {
 public:
-    ElasticBase (const unsigned int degree, const int _info, const int _n_blocks);
+    /*!
+     * All configuration is read from and all statistics are written to
+     * _par, the terminal output goes to out. Problems with their own
+     * parameters and streams share no mutable state and can run
+     * concurrently.
+     */
+    ElasticBase (parameters         *_par,
+                 const unsigned int degree,
+                 const int          _info,
+                 const int          _n_blocks,
+                 std::ostream       &out = std::cout);
     void run ();
 
+    // Solution after run(), numbered as the DoFs
+    void solution_values (std::vector<double> &values) const;
+
+    /*!
+     * Displacements at the vertices of the ice and upper boundary,
+     * dim coordinates and dim values per vertex.
+     */
+    void surface_values (std::vector<double> &points,
+                         std::vector<double> &displacements) const;
+
+    const std::vector<unsigned int> & get_dofs_per_component () const;
+
 protected:
     // pointer to parameter object
     parameters *par;
@@ -89,6 +131,96 @@ protected:
     TrilinosWrappers::BlockVector			solution;
     TrilinosWrappers::BlockVector			system_rhs, load, body_force, precond_rhs;
 
+    // Usage of the preconditioner workspaces in the last solve
+    WorkspaceStatistics						workspace;
+    // Usage of the outer Krylov workspace in the last solve
+    WorkspaceStatistics						outer_workspace;
+    // Memory of the AMG hierarchies
+    std::size_t								amg_memory;
+
+    // Schur complement approximation when it does not fit the block pattern
+    TrilinosWrappers::SparseMatrix			schur_matrix;
+    // Time spent building the Schur approximation, local and global
+    Timer									schur_timer;
+
+    // Sparse direct factorization of system_matrix, reused for
+    // further right hand sides until the system is assembled again
+    BlockSparseMatrix<double>				direct_matrix;
+    SparseDirectUMFPACK						direct_solver;
+    bool									direct_factorized;
+    unsigned int							direct_solves;
+
+    // Outer solver keeping its recycled subspace between the load steps
+    RecyclingFGMRES<TrilinosWrappers::BlockVector>	recycler;
+    // Outer iterations of every load step
+    std::vector<unsigned int>				step_iterations;
+
+    // Outcome of the solves stopped at the discretization error
+    struct DiscretizationStop
+    {
+        DiscretizationStop () : stages(0), discretization(0), algebraic(0),
+            tolerance(0), saved_iterations(0), saved_time(0),
+            active(false), stopped(false), initial(0), previous_residual(0) {}
+
+        unsigned int	stages;
+        double			discretization, algebraic, tolerance;
+        double			saved_iterations, saved_time;
+
+        // State of the restart check during the solve
+        bool							active, stopped;
+        double							initial, previous_residual;
+        TrilinosWrappers::BlockVector	previous;
+    }										disc_stop;
+
+    // Initial guess taken from the solution store
+    struct WarmStart
+    {
+        WarmStart () : used(false), residual(1), cold_iterations(0) {}
+
+        bool			used;
+        std::string		origin;
+        // ||b - A x_0||/||b|| of the initial guess
+        double			residual;
+        unsigned int	cold_iterations;
+    }										warm;
+
+    // Shape functions at one quadrature point, for add_cell_matrix
+    struct CellShapes
+    {
+        CellShapes (const unsigned int dofs_per_cell)
+            : symgrad_phi_u(dofs_per_cell), grad_phi(dofs_per_cell), phi_u(dofs_per_cell),
+              div_phi_u(dofs_per_cell), phi_p(dofs_per_cell) {}
+
+        void reinit (const FEValues<dim> &fe_values, const unsigned int q)
+        {
+            const FEValuesExtractors::Vector displacements (0);
+            const FEValuesExtractors::Scalar pressure (dim);
+            for (unsigned int k=0; k < phi_p.size(); ++k)
+            {
+                symgrad_phi_u[k] = fe_values[displacements].symmetric_gradient (k, q);
+                grad_phi[k]		 = fe_values[displacements].gradient (k, q);
+                phi_u[k]		 = fe_values[displacements].value (k, q);
+                div_phi_u[k]     = fe_values[displacements].divergence (k, q);
+                phi_p[k]         = fe_values[pressure].value (k, q);
+            }
+        }
+
+        std::vector<SymmetricTensor<2,dim> > symgrad_phi_u;
+        std::vector<Tensor<2,dim> >          grad_phi;
+        std::vector<Tensor<1,dim> >			 phi_u;
+        std::vector<double>                  div_phi_u;
+        std::vector<double>                  phi_p;
+    };
+
+    // Checkpoint being restored, open from the geometry to the state
+    std_cxx1x::shared_ptr<std::ifstream>					restart_stream;
+    std_cxx1x::shared_ptr<boost::archive::binary_iarchive>	restart_archive;
+    // DoF numbering relative to distribute_dofs, restored or recorded
+    std::vector<types::global_dof_index>	dof_numbering;
+    // Outer iterations spent before the restored checkpoint
+    unsigned int							checkpoint_iterations;
+    unsigned int							checkpoints_written;
+
     /*!
      * Purly virtual methods.
      * Need to be implemented in the child class
@@ -98,7 +230,209 @@ protected:
 
     void create_geometry();
     void setup_dofs ();
-    void assemble_system ();
+    virtual void assemble_system ();
+
+    /*!
+     * Adds the weak form of the system at one quadrature point to
+     * cell_matrix. With displacement the Bt block is replaced by
+     * mu^2/beta (div u, div v), the pressure eliminated operator.
+     */
+    void add_cell_matrix (const CellShapes   &shapes,
+                          const double       mu,
+                          const double       beta,
+                          const double       JxW,
+                          const bool         displacement,
+                          FullMatrix<double> &cell_matrix) const;
+
+    /*!
+     * Build the global part of the Schur approximation, for
+     * par->schur_type == SIMPLE the sparse product C - B diag(A)^{-1} Bt.
+     */
+    void setup_schur ();
+
+    /*!
+     * Matrix approximating the Schur complement, the last diagonal
+     * block of system_preconditioner or schur_matrix.
+     * With par->minres it is the positive definite -S.
+     */
+    const TrilinosWrappers::SparseMatrix & schur_operator () const;
+
+    /*!
+     * Solve the system with the outer FGMRES preconditioned with
+     * preconditioner, stopping criterion in solver_control.
+     */
+    template <class PreconditionerType>
+    void outer_solve (const PreconditionerType &preconditioner,
+                      OuterSolverControl       &solver_control);
+
+    /*!
+     * Solve the symmetric system with MINRES, preconditioner has to be
+     * a fixed symmetric positive definite operator.
+     */
+    template <class PreconditionerType>
+    void minres_solve (const PreconditionerType &preconditioner,
+                       SolverControl            &solver_control);
+
+    /*!
+     * True if the mixed system can be factorized, the condensed and
+     * displacement formulations have no regular monolithic matrix.
+     */
+    bool direct_possible () const;
+
+    /*!
+     * True if a stagnated outer solve may fall back to the direct
+     * solver, only up to par->fallback_dofs.
+     */
+    bool fallback_possible () const;
+
+    /*!
+     * Solve system_matrix*dst = rhs with UMFPACK, factorizes
+     * system_matrix on the first call after the assembly.
+     */
+    void direct_solve (TrilinosWrappers::BlockVector       &dst,
+                       const TrilinosWrappers::BlockVector &rhs);
+
+    /*!
+     * Solve for system_rhs with solve() or the direct solver, falls back
+     * to the direct solver when the outer iteration stagnates.
+     */
+    void solve_system (const bool direct);
+
+    /*!
+     * solve() with the fallback to the direct solver, false if the
+     * direct solver took over.
+     */
+    bool solve_iterative ();
+
+    /*!
+     * With par->disc_stop solve() ends at the first restart of the outer
+     * FGMRES where the algebraic error is below par->disc_fraction
+     * times the discretization error, or at par->TOL.
+     */
+    void solve_to_discretization ();
+
+    /*!
+     * Restart check of the outer solve with par->disc_stop, solution
+     * holds the iterate of the restart and residual its true residual.
+     */
+    bool discretization_reached (const unsigned int step, const double residual);
+
+    /*!
+     * Discretization error of solution, the L2 error of the displacement
+     * when the exact solution is known, the Kelly estimate otherwise.
+     */
+    double discretization_error (const bool exact) const;
+
+    /*!
+     * Norm of the displacement of v matching discretization_error(),
+     * L2 norm or H1 seminorm.
+     */
+    double displacement_norm (const TrilinosWrappers::BlockVector &v, const bool exact) const;
+
+    /*!
+     * Solve par->load_steps systems, step k with the body force and k/n
+     * of the ice load, starting from the solution of the previous step.
+     */
+    void solve_load_steps (const bool direct);
+
+    /*!
+     * Parameters the checkpoint is valid for.
+     */
+    std::string checkpoint_signature () const;
+
+    /*!
+     * Open par->checkpoint_file, load the triangulation and the DoF
+     * numbering. Returns the phase reached, NONE if there is no usable
+     * checkpoint.
+     */
+    int read_checkpoint_geometry ();
+
+    /*!
+     * After setup_dofs() load the assembled system and the solution
+     * the checkpoint holds for phase. Returns the phase restored.
+     */
+    int read_checkpoint_state (const int phase);
+
+    /*!
+     * Write the state of phase to par->checkpoint_file, through a
+     * temporary file so a killed job leaves the last checkpoint intact.
+     */
+    void write_checkpoint (const int phase);
+
+    /*!
+     * SOLVING checkpoint at outer step, called from OuterSolverControl
+     * at a restart. solution holds the iterate of that step.
+     */
+    void solving_checkpoint (const unsigned int step);
+
+    /*!
+     * Mesh and DoF signature under which solutions are stored.
+     */
+    std::string store_signature () const;
+
+    /*!
+     * Initial guess from par->store_file, the nearest or an extrapolated
+     * stored solution of the same signature.
+     */
+    void warm_start ();
+
+    /*!
+     * Append solution to par->store_file.
+     */
+    void store_solution () const;
+
+    /*!
+     * Rigid body modes of the displacement block (translations and
+     * rotations), stored vector after vector as ML expects them.
+     * Returns the number of modes.
+     */
+    unsigned int rigid_body_modes (std::vector<double> &modes) const;
+
+    /*!
+     * Support points of the pressure dofs, numbered within the
+     * pressure block.
+     */
+    void pressure_support_points (std::vector<Point<dim> > &points) const;
+
+    /*!
+     * Pressure element, FE_DGP with par->dg_pressure, FE_Q otherwise.
+     */
+    static std_cxx1x::shared_ptr<FiniteElement<dim> > pressure_element (const unsigned int degree,
+                                                                        const bool dg_pressure);
+
+    /*!
+     * With par->amg_tune set threshold, smoother and sweeps of data
+     * for block M, cached under the signature of this problem.
+     */
+    void tune_AMG (TrilinosWrappers::PreconditionAMG::AdditionalData &data,
+                   const TrilinosWrappers::SparseMatrix             &M,
+                   const std::string                                &name,
+                   std::vector<double>                              *modes = 0,
+                   const unsigned int                               n_modes = 0);
+
+    /*!
+     * AMG of a coupled displacement block M, with constant modes or with
+     * rigid body modes (par->rigid_modes) as near null space, tuned with
+     * tune_AMG. Added to tasks like setup_block_AMG.
+     */
+    void setup_displacement_AMG (Threads::TaskGroup<void>             &tasks,
+                                 TrilinosWrappers::PreconditionAMG    &prec,
+                                 const TrilinosWrappers::SparseMatrix &M,
+                                 const std::string                    &name);
+
+    /*!
+     * Build the AMG hierarchy of M in prec, timed in section "AMG name".
+     * With par->amg_concurrent the setup is added to tasks and runs on
+     * its own thread, M and data must stay alive until tasks are joined.
+     * The ML builds themselves run one at a time, see
+     * AMGTuner::setup_mutex.
+     */
+    template <class DataType>
+    void setup_block_AMG (Threads::TaskGroup<void>             &tasks,
+                          TrilinosWrappers::PreconditionAMG    &prec,
+                          const TrilinosWrappers::SparseMatrix &M,
+                          const DataType                       &data,
+                          const std::string                    &name);
 
     std::string to_upper(const std::string str);
     void generate_matlab_study();
@@ -114,6 +448,18 @@ protected:
     void output_surface ();
 
 private:
+    // Settings of the displacement AMG, alive until the setup tasks are joined
+    TrilinosWrappers::PreconditionAMG::AdditionalData	displacement_data;
+    Teuchos::ParameterList								displacement_list;
+    // Near null space handed to ML, must live as long as the AMG
+    std::vector<double>									null_space;
+
+    template <class DataType>
+    void initialize_AMG (TrilinosWrappers::PreconditionAMG    *prec,
+                         const TrilinosWrappers::SparseMatrix *M,
+                         const DataType                       *data,
+                         const std::string                    section);
+
     std::vector<unsigned int> dofs_per_component;
     std::vector<unsigned int> dofs_per_block;
 };
@@ -122,9 +468,14 @@ private:
 // ------------- IMPLEMENTATION --------------
 
 template <int dim>
-Elastic::ElasticBase<dim>::ElasticBase (const unsigned int degree, const int _info, const int _n_blocks)
+Elastic::ElasticBase<dim>::ElasticBase (parameters         *_par,
+                                        const unsigned int degree,
+                                        const int          _info,
+                                        const int          _n_blocks,
+                                        std::ostream       &out)
     :
-      oout(std::cout),
+      par(_par),
+      oout(out),
       timer (oout,
              TimerOutput::summary,
              TimerOutput::wall_times),
@@ -133,21 +484,39 @@ Elastic::ElasticBase<dim>::ElasticBase (const unsigned int degree, const int _in
       n_components(dim+1),
       triangulation (Triangulation<dim>::maximum_smoothing),
       fe (FE_Q<dim>(degree+1), dim,
-          FE_Q<dim>(degree), 1),
+          *pressure_element(degree, _par->dg_pressure), 1),
       dof_handler (triangulation),
+      amg_memory (0),
+      direct_factorized (false),
+      direct_solves (0),
+      checkpoint_iterations (0),
+      checkpoints_written (0),
       dofs_per_component(std::vector<unsigned int>(n_components)),
       dofs_per_block(std::vector<unsigned int>(n_blocks))
 {
-    par = parameters::getInstance();
+    recycler.set_max_subspace (par->recycle_size);
+}
+
+template <int dim>
+std_cxx1x::shared_ptr<FiniteElement<dim> >
+Elastic::ElasticBase<dim>::pressure_element (const unsigned int degree,
+                                             const bool dg_pressure)
+{
+    if(dg_pressure)
+        return std_cxx1x::shared_ptr<FiniteElement<dim> >(new FE_DGP<dim>(degree));
+    return std_cxx1x::shared_ptr<FiniteElement<dim> >(new FE_Q<dim>(degree));
 }
 
 template <int dim>
 void
 Elastic::ElasticBase<dim>::create_geometry(){
-    // Number of initial subdivisions for each axis
-    std::vector<unsigned int> subdivisions (dim, 1);
-    subdivisions[0] = par->xdivisions;
-    subdivisions[1] = par->ydivisions;
+    // Number of initial subdivisions for each axis, depth is the last
+    // coordinate. In 3d the second axis spans [0,1] and is divided
+    // with the cell size of the depth direction y1-y2.
+    std::vector<unsigned int> subdivisions (dim, par->xdivisions);
+    subdivisions[dim-1] = par->ydivisions;
+    if(dim == 3)
+        subdivisions[1] = std::max (1, (int) std::floor (par->ydivisions/std::fabs(par->y2 - par->y1) + 0.5));
 
     const Point<dim> bottom_left = (dim == 2 ?
                                         Point<dim>(par->x1,par->y1) :
@@ -178,11 +547,11 @@ Elastic::ElasticBase<dim>::create_geometry(){
 
                 // If x component of the face's center is on the left boundary,
                 // the face is one the left boundary
-                if (face_center[dim-2] == par->x1)
+                if (face_center[0] == par->x1)
                     cell->face(f)->set_boundary_indicator(par->b_left);
                 // If x component of the face's center is on the right boundary,
                 // the face is on the right boundary.
-                else if (face_center[dim-2] == par->x2)
+                else if (face_center[0] == par->x2)
                     cell->face(f)->set_boundary_indicator(par->b_right);
                 // If y component of the face's center is on the bottom boundary,
                 // the face is on the bottom boundary.
@@ -208,29 +577,48 @@ Elastic::ElasticBase<dim>::setup_dofs (){
 
     dof_handler.distribute_dofs (fe);
 
-    // Renumber to reduce sparsity band
-    DoFRenumbering::Cuthill_McKee (dof_handler);
-
-    // Renumber component wise
     std::vector<unsigned int> block_component (n_components,0);
     for(int i=0; i<n_components; ++i)
         block_component[i] = i;
 
-    // DOF renumbering
-    DoFRenumbering::component_wise (dof_handler, block_component);
+    if(dof_numbering.size() == dof_handler.n_dofs()){
+        // Numbering restored from a checkpoint
+        dof_handler.renumber_dofs (dof_numbering);
+    }else{
+        // Indices before renumbering, cell by cell, to record the numbering
+        std::vector<types::global_dof_index> initial, local (fe.dofs_per_cell);
+        typename DoFHandler<dim>::active_cell_iterator cell;
+        if(par->checkpoint)
+            for(cell = dof_handler.begin_active(); cell != dof_handler.end(); ++cell){
+                cell->get_dof_indices (local);
+                initial.insert (initial.end(), local.begin(), local.end());
+            }
+
+        // Renumber to reduce sparsity band
+        DoFRenumbering::Cuthill_McKee (dof_handler);
+
+        // DOF renumbering, component wise
+        DoFRenumbering::component_wise (dof_handler, block_component);
+
+        if(par->checkpoint){
+            dof_numbering.resize (dof_handler.n_dofs());
+            unsigned int k = 0;
+            for(cell = dof_handler.begin_active(); cell != dof_handler.end(); ++cell){
+                cell->get_dof_indices (local);
+                for(unsigned int i = 0; i < local.size(); ++i, ++k)
+                    dof_numbering[initial[k]] = local[i];
+            }
+        }
+    }
 
     //Interpolate boudaries using constraint matrix
     {
         std::vector<bool> ns_mask (dim+1, true); // NO_SLIP
-        std::vector<bool> vs_mask (dim+1, true); // V_SLIP
-
-        ns_mask[0] = true;
-        ns_mask[1] = true;
-        ns_mask[2] = false;
+        std::vector<bool> vs_mask (dim+1, false); // V_SLIP
 
+        // NO_SLIP fixes all displacements, V_SLIP only the normal one
+        ns_mask[dim] = false;
         vs_mask[0] = true;
-        vs_mask[1] = false;
-        vs_mask[2] = false;
 
         constraints.clear();
         VectorTools::interpolate_boundary_values (dof_handler,
@@ -273,13 +661,27 @@ Elastic::ElasticBase<dim>::setup_dofs (){
 
 
         bcsp.collect_sizes();
-        DoFTools::make_sparsity_pattern (dof_handler, bcsp, constraints, true);
+        if(par->dg_pressure || par->formulation == fFlags::DISPLACEMENT){
+            // The displacements couple only with each other, the pressure
+            // is condensed cell by cell or recovered from C p = B u
+            Table<2,DoFTools::Coupling> coupling (n_components, n_components);
+            for(unsigned int c=0; c<n_components; ++c)
+                for(unsigned int d=0; d<n_components; ++d)
+                    if(c < dim)
+                        coupling[c][d] = (d < dim) ? DoFTools::always : DoFTools::none;
+                    else
+                        coupling[c][d] = par->dg_pressure ? DoFTools::none : DoFTools::always;
+            DoFTools::make_sparsity_pattern (dof_handler, coupling, bcsp, constraints, true);
+        }else{
+            DoFTools::make_sparsity_pattern (dof_handler, bcsp, constraints, true);
+        }
 
         sparsity_pattern.copy_from(bcsp);
     }
 
     system_matrix.reinit (sparsity_pattern);
-    system_preconditioner.reinit (sparsity_pattern);
+    if(!par->dg_pressure && par->formulation == fFlags::MIXED)
+        system_preconditioner.reinit (sparsity_pattern);
 
     solution.reinit (n_blocks);
     system_rhs.reinit (n_blocks);
@@ -308,6 +710,9 @@ Elastic::ElasticBase<dim>::assemble_system ()
 {
     system_matrix=0;
     system_rhs=0;
+    load=0;
+    body_force=0;
+    schur_timer.reset();
 
     QGauss<dim>   quadrature_formula(degree+2);
     QGauss<dim-1> face_quadrature_formula(degree+2);
@@ -368,6 +773,8 @@ Elastic::ElasticBase<dim>::assemble_system ()
     FullMatrix<double>	cell_matrix  (dofs_per_cell, dofs_per_cell),
             cell_ordered (dofs_per_cell, dofs_per_cell),
             cell_precond (dofs_per_cell, dofs_per_cell),
+            cell_mass    (dofs_per_cell, dofs_per_cell), // scaled pressure mass
+            cell_al      (dofs_per_cell, dofs_per_cell), // grad-div of the preconditioner
             l_A          (dim_u,dim_u),
             l_Bt         (dim_u,dim_p),
             l_B          (dim_p,dim_u),
@@ -378,12 +785,13 @@ Elastic::ElasticBase<dim>::assemble_system ()
 
     // Dummy cell matrix for preconditioner, it is allways zero
     Vector<double>      cell_rhs (dofs_per_cell),
-            cell_pre_rhs(dofs_per_cell);
+            cell_pre_rhs(dofs_per_cell),
+            cell_load (dofs_per_cell), cell_body (dofs_per_cell);
 
     std::vector<unsigned int> local_dof_indices (dofs_per_cell);
 
-    const RightHandSide<dim>			right_hand_side;
-    const BoundaryValues<dim>			boundaries;
+    const RightHandSide<dim>			right_hand_side (par);
+    const BoundaryValues<dim>			boundaries (par);
     std::vector<Vector<double> >		rhs_values (n_q_points, Vector<double>(dim+1));
     std::vector<Vector<double> >		boundary_values (n_face_q_points, Vector<double>(dim+1));
 
@@ -391,9 +799,6 @@ Elastic::ElasticBase<dim>::assemble_system ()
     std::vector<double>     		  	 mu_values (n_q_points);
     std::vector<double>     		  	 beta_values (n_q_points);	// mu^2/alpha
 
-    const FEValuesExtractors::Vector displacements (0);
-    const FEValuesExtractors::Scalar pressure (dim);
-
     /*! @todo check if this works correctly for 3d as well.
      */
     // Set everything to zero
@@ -401,15 +806,14 @@ Elastic::ElasticBase<dim>::assemble_system ()
     Tensor<1,dim> e(0);
     e[dim-1] = 1.0;
 
-    std::vector<SymmetricTensor<2,dim> > symgrad_phi_u	(dofs_per_cell);
-    std::vector<Tensor<2,dim> >          grad_phi		(dofs_per_cell);
-    std::vector<Tensor<1,dim> >			 phi_u			(dofs_per_cell);
-    std::vector<double>                  div_phi_u		(dofs_per_cell);
-    std::vector<double>                  phi_p			(dofs_per_cell);
+    CellShapes shapes (dofs_per_cell);
+    const std::vector<Tensor<1,dim> > &phi_u     = shapes.phi_u;
+    const std::vector<double>         &div_phi_u = shapes.div_phi_u;
+    const std::vector<double>         &phi_p     = shapes.phi_p;
 
     bool first = true;
     unsigned int counter = 0;
-    double h;
+    double h, gamma, mass_scale;
 
     typename DoFHandler<dim>::active_cell_iterator
             cell = dof_handler.begin_active(),
@@ -420,7 +824,10 @@ Elastic::ElasticBase<dim>::assemble_system ()
         cell_matrix		= 0;
         cell_rhs		= 0;
         cell_pre_rhs    = 0;
+        cell_load		= 0;
         cell_precond	= 0;
+        cell_mass		= 0;
+        cell_al			= 0;
         l_Adiag			= 0;
 
         right_hand_side.vector_value_list(fe_values.get_quadrature_points(),
@@ -431,33 +838,25 @@ Elastic::ElasticBase<dim>::assemble_system ()
 
         for (unsigned int q=0; q<n_q_points; ++q)
         {
-            for (unsigned int k=0; k < dofs_per_cell; ++k)
-            {
-                symgrad_phi_u[k] = fe_values[displacements].symmetric_gradient (k, q);
-                grad_phi[k]		 = fe_values[displacements].gradient (k, q);
-                phi_u[k]		 = fe_values[displacements].value (k, q);
-                div_phi_u[k]     = fe_values[displacements].divergence (k, q);
-                phi_p[k]         = fe_values[pressure].value (k, q);
-            }
+            shapes.reinit (fe_values, q);
+            add_cell_matrix (shapes, mu_values[q], beta_values[q], fe_values.JxW(q),
+                             false, cell_matrix);
+
+            /* Augmented Lagrangian: the A block of the preconditioner gets
+             * gamma*mu*(div u, div v), the system itself is not changed.
+             * The Schur complement of the preconditioner is then close to
+             * -(beta + mu/(1+gamma)) times the pressure mass, without
+             * augmentation (gamma = 0) to -(beta + mu) times the mass.
+             */
+            gamma = (par->al_enabled ? par->al_gamma : 0);
+            mass_scale = beta_values[q] + mu_values[q]/(1 + gamma);
 
             for (unsigned int i=0; i<dofs_per_cell; ++i)
             {
-                const unsigned int component_i =
-                        fe.system_to_component_index(i).first;
-
                 for (unsigned int j=0; j < dofs_per_cell; ++j)
                 {
-                    const unsigned int component_j =
-                            fe.system_to_component_index(j).first;
-
-                    cell_matrix(i,j) += (
-                                symgrad_phi_u[i] * symgrad_phi_u[j] * 2 * mu_values[q]         // A
-                                - grad_phi[j]  * e * phi_u[i] * par->scale3 * par->adv_enabled	// A-adv
-                                + div_phi_u[j] * e * phi_u[i] * par->scale3 * par->div_enabled	// A-div
-                                + div_phi_u[i] * phi_p[j] * mu_values[q]                       // Bt
-                                + phi_p[i] * div_phi_u[j] * mu_values[q]                       // B
-                                - phi_p[i] * phi_p[j] * beta_values[q]                         // C
-                                )* fe_values.JxW(q);
+                    cell_al(i,j) += div_phi_u[i] * div_phi_u[j] * gamma * mu_values[q] * fe_values.JxW(q);
+                    cell_mass(i,j) -= phi_p[i] * phi_p[j] * mass_scale * fe_values.JxW(q);
 
                     cell_precond(i,j) += (
                                 phi_p[i] * div_phi_u[j] * mu_values[q]				// B
@@ -485,12 +884,15 @@ Elastic::ElasticBase<dim>::assemble_system ()
                         const unsigned int
                                 component_i = fe.system_to_component_index(i).first;
 
-                        cell_rhs(i) +=  fe_face_values.shape_value(i, q) *
+                        cell_load(i) +=  fe_face_values.shape_value(i, q) *
                                 boundary_values[q](component_i) *
                                 fe_face_values.JxW(q);
                     }
             }// end if at boundary
         }// end face
+        // Ice load and body force are kept apart for the load steps
+        cell_body = cell_rhs;
+        cell_rhs += cell_load;
 
         // Local assemble and Schur generation
         // extract here using velocities, pressure
@@ -501,7 +903,7 @@ Elastic::ElasticBase<dim>::assemble_system ()
                 cell_ordered(i,j) = cell_matrix(order[i],order[j]); // local matrix ordered by u0,u1...un,v0,v1...vn,p0,p1...pm
 
                 if(i < dim_u && j < dim_u){
-                    l_A(i,j)  = cell_ordered(i,j);
+                    l_A(i,j)  = cell_ordered(i,j) + cell_al(order[i],order[j]);
                     l_Ainv(i,j) = l_A(i,j);
                 }else if(i < dim_u && j >= dim_u){
                     l_Bt(i,j-dim_u) = cell_ordered(i,j);
@@ -510,17 +912,32 @@ Elastic::ElasticBase<dim>::assemble_system ()
                 }else if(i >= dim_u && j >= dim_u){
                     l_C(i-dim_u,j-dim_u)  = cell_ordered(i,j);
                     l_S(i-dim_u,j-dim_u)  = l_C(i-dim_u,j-dim_u); // -C ... look at the sign
+                    if(par->schur_type == sFlags::MASS || par->schur_type == sFlags::LUMPED)
+                        l_S(i-dim_u,j-dim_u) = cell_mass(order[i],order[j]);
                 }
             }
         }
         // boundary conditions
 
         // Local Schur calculation	l_A(k,k) += h*h;// A(i,j) + h²I
-        h = cell->diameter();
-        l_Ainv.diagadd(h*h);
-        l_Ainv.gauss_jordan(); // Compute A inverse
-
-        l_S.triple_product 	(	l_Ainv,l_B,l_Bt,false,false, -1.0  );
+        schur_timer.start();
+        if(par->schur_type == sFlags::ELEMENT){
+            h = cell->diameter();
+            l_Ainv.diagadd(h*h);
+            l_Ainv.gauss_jordan(); // Compute A inverse
+
+            l_S.triple_product 	(	l_Ainv,l_B,l_Bt,false,false, -1.0  );
+        }else if(par->schur_type == sFlags::LUMPED){
+            // row sums on the diagonal
+            for (unsigned int i=0; i< dim_p; ++i){
+                for (unsigned int j=0; j < dim_p; ++j)
+                    if(i != j){
+                        l_S(i,i) += l_S(i,j);
+                        l_S(i,j) = 0;
+                    }
+            }
+        }
+        schur_timer.stop();
         // End Schur calculation
 
         // begin Schur assembly preconditioner
@@ -552,6 +969,8 @@ Elastic::ElasticBase<dim>::assemble_system ()
         constraints.distribute_local_to_global(cell_precond, cell_pre_rhs,
                                                local_dof_indices,
                                                system_preconditioner, precond_rhs);
+        constraints.distribute_local_to_global(cell_load, local_dof_indices, load);
+        constraints.distribute_local_to_global(cell_body, local_dof_indices, body_force);
         // end local-to-global
 
         first = false;
@@ -562,6 +981,687 @@ Elastic::ElasticBase<dim>::assemble_system ()
     free(order);
 }
 
+template <int dim>
+void
+Elastic::ElasticBase<dim>::add_cell_matrix (const CellShapes   &shapes,
+                                            const double       mu,
+                                            const double       beta,
+                                            const double       JxW,
+                                            const bool         displacement,
+                                            FullMatrix<double> &cell_matrix) const
+{
+    Tensor<1,dim> e;
+    e[dim-1] = 1.0;
+
+    const unsigned int dofs_per_cell = shapes.phi_p.size();
+    for (unsigned int i=0; i<dofs_per_cell; ++i)
+        for (unsigned int j=0; j < dofs_per_cell; ++j)
+            cell_matrix(i,j) += (
+                        shapes.symgrad_phi_u[i] * shapes.symgrad_phi_u[j] * 2 * mu                 // A
+                        - shapes.grad_phi[j]  * e * shapes.phi_u[i] * par->scale3 * par->adv_enabled	// A-adv
+                        + shapes.div_phi_u[j] * e * shapes.phi_u[i] * par->scale3 * par->div_enabled	// A-div
+                        + (displacement ? shapes.div_phi_u[i] * shapes.div_phi_u[j] * mu * mu / beta // Bt C^{-1} B
+                                        : shapes.div_phi_u[i] * shapes.phi_p[j] * mu)             // Bt
+                        + shapes.phi_p[i] * shapes.div_phi_u[j] * mu                               // B
+                        - shapes.phi_p[i] * shapes.phi_p[j] * beta                                 // C
+                        )* JxW;
+}
+
+template <int dim>
+void
+Elastic::ElasticBase<dim>::setup_schur ()
+{
+    const unsigned int n_u = n_blocks-1;
+
+    if(par->schur_type != sFlags::SIMPLE){
+        // MINRES needs the positive definite -S
+        if(par->minres){
+            schur_timer.start();
+            schur_matrix.copy_from (system_preconditioner.block(n_u,n_u));
+            schur_matrix *= -1.0;
+            schur_timer.stop();
+        }
+        return;
+    }
+
+    TrilinosWrappers::SparseMatrix product;
+
+    schur_timer.start();
+    // S = C - sum_i B_i diag(A_ii)^{-1} Bt_i, C is the negative pressure block.
+    // The products have a wider pattern than C, so they are summed first.
+    for(unsigned int i=0; i<n_u; ++i){
+        TrilinosWrappers::Vector inv_diag (dofs_per_block[i]);
+        for(unsigned int k=0; k<inv_diag.size(); ++k){
+            const double d = system_matrix.block(i,i).diag_element(k);
+            inv_diag(k) = (std::fabs(d) > ZERO) ? 1.0/d : 1.0;
+        }
+
+        system_matrix.block(n_u,i).mmult (product, system_matrix.block(i,n_u), inv_diag);
+        if(i == 0)
+            schur_matrix.copy_from (product);
+        else
+            schur_matrix.add (1.0, product);
+    }
+    schur_matrix *= -1.0;
+    schur_matrix.add (1.0, system_matrix.block(n_u,n_u));
+    if(par->minres)
+        schur_matrix *= -1.0;
+    schur_timer.stop();
+}
+
+template <int dim>
+const TrilinosWrappers::SparseMatrix &
+Elastic::ElasticBase<dim>::schur_operator () const
+{
+    if(par->schur_type == sFlags::SIMPLE || par->minres)
+        return schur_matrix;
+    return system_preconditioner.block(n_blocks-1,n_blocks-1);
+}
+
+template <int dim>
+template <class PreconditionerType>
+void
+Elastic::ElasticBase<dim>::outer_solve (const PreconditionerType &preconditioner,
+                                        OuterSolverControl       &solver_control)
+{
+#ifdef LOGRUN
+    solver_control.enable_history_data();
+    solver_control.log_history(true);
+    solver_control.log_result(true);
+#endif
+
+    VectorPool<TrilinosWrappers::BlockVector> pool;
+    SolverFGMRES<TrilinosWrappers::BlockVector>
+            solver (solver_control, pool,
+                    SolverFGMRES<TrilinosWrappers::BlockVector >::AdditionalData(100)); // With restart of 100
+
+    SolverCGS2FGMRES<TrilinosWrappers::BlockVector> cgs2 (solver_control, pool, 100);
+    Timer solve_timer;
+
+    if(par->checkpoint)
+        solver_control.set_checkpoint (std_cxx1x::bind (&ElasticBase<dim>::solving_checkpoint,
+                                                        this, std_cxx1x::_1));
+    solver_control.enable_fallback (fallback_possible ());
+    if(disc_stop.active)
+        solver_control.set_restart_check (std_cxx1x::bind (&ElasticBase<dim>::discretization_reached,
+                                                           this, std_cxx1x::_1, std_cxx1x::_2));
+
+#ifdef LOGRUN
+    deallog.push("Outer");
+#endif
+    if(par->recycle)
+        recycler.solve(solver_control,
+                       system_matrix,
+                       solution,
+                       system_rhs,
+                       preconditioner);
+    else if(par->outer_cgs2)
+        cgs2.solve(system_matrix,
+                   solution,
+                   system_rhs,
+                   preconditioner);
+    else
+        solver.solve(system_matrix,
+                     solution,
+                     system_rhs,
+                     preconditioner);
+#ifdef LOGRUN
+    deallog.pop();
+#endif
+
+    par->system_iter = solver_control.last_step();
+    outer_workspace.iterations += solver_control.last_step();
+    outer_workspace.solve_time += solve_timer.wall_time();
+    if(par->recycle){
+        outer_workspace.n_requests  = recycler.n_vectors();
+        outer_workspace.n_allocated = recycler.n_vectors();
+        outer_workspace.memory      = recycler.memory_consumption();
+        return;
+    }
+    outer_workspace.n_requests  = pool.n_requests();
+    outer_workspace.n_allocated = pool.n_allocated();
+    outer_workspace.memory      = pool.memory_consumption();
+}
+
+/**
+ * MINRES keeps a fixed number of vectors, the three term recurrence
+ * needs no restart and no stored basis.
+ */
+template <int dim>
+template <class PreconditionerType>
+void
+Elastic::ElasticBase<dim>::minres_solve (const PreconditionerType &preconditioner,
+                                         SolverControl            &solver_control)
+{
+#ifdef LOGRUN
+    solver_control.enable_history_data();
+    solver_control.log_history(true);
+    solver_control.log_result(true);
+#endif
+
+    VectorPool<TrilinosWrappers::BlockVector> pool;
+    SolverMinRes<TrilinosWrappers::BlockVector> solver (solver_control, pool);
+    Timer solve_timer;
+
+#ifdef LOGRUN
+    deallog.push("Outer");
+#endif
+    solver.solve(system_matrix,
+                 solution,
+                 system_rhs,
+                 preconditioner);
+#ifdef LOGRUN
+    deallog.pop();
+#endif
+
+    par->system_iter = solver_control.last_step();
+    outer_workspace.iterations += solver_control.last_step();
+    outer_workspace.solve_time += solve_timer.wall_time();
+    outer_workspace.n_requests  = pool.n_requests();
+    outer_workspace.n_allocated = pool.n_allocated();
+    outer_workspace.memory      = pool.memory_consumption();
+}
+
+template <int dim>
+void
+Elastic::ElasticBase<dim>::pressure_support_points (std::vector<Point<dim> > &points) const
+{
+    std::vector<Point<dim> > support_points (dof_handler.n_dofs());
+    DoFTools::map_dofs_to_support_points (MappingQ1<dim>(), dof_handler, support_points);
+
+    // The pressure block is numbered last
+    const unsigned int n_p = dofs_per_block[n_blocks-1],
+            offset = dof_handler.n_dofs() - n_p;
+    points.assign (support_points.begin()+offset, support_points.end());
+}
+
+template <int dim>
+bool
+Elastic::ElasticBase<dim>::direct_possible () const
+{
+    return !par->dg_pressure && par->formulation == fFlags::MIXED;
+}
+
+template <int dim>
+bool
+Elastic::ElasticBase<dim>::fallback_possible () const
+{
+    return par->direct_fallback && direct_possible ()
+            && dof_handler.n_dofs() <= static_cast<unsigned int>(par->fallback_dofs);
+}
+
+template <int dim>
+void
+Elastic::ElasticBase<dim>::direct_solve (TrilinosWrappers::BlockVector       &dst,
+                                         const TrilinosWrappers::BlockVector &rhs)
+{
+    if(!direct_factorized){
+        timer.enter_section("Direct factorization");
+        direct_matrix.reinit (sparsity_pattern);
+        for(unsigned int i=0; i<n_blocks; ++i)
+            for(unsigned int j=0; j<n_blocks; ++j)
+                direct_matrix.block(i,j).copy_from (system_matrix.block(i,j));
+
+        direct_solver.initialize (direct_matrix);
+        direct_factorized = true;
+        timer.exit_section("Direct factorization");
+    }
+
+    BlockVector<double> tmp_dst, tmp_rhs;
+    tmp_rhs = rhs;
+    tmp_dst.reinit (tmp_rhs);
+
+    direct_solver.vmult (tmp_dst, tmp_rhs);
+    dst = tmp_dst;
+    ++direct_solves;
+}
+
+template <int dim>
+void
+Elastic::ElasticBase<dim>::solve_system (const bool direct)
+{
+    if(direct){
+        // No outer iterations, the statistics must not keep an earlier count
+        par->system_iter = 0;
+        direct_solve (solution, system_rhs);
+    }else if(par->disc_stop)
+        solve_to_discretization ();
+    else
+        solve_iterative ();
+}
+
+/**
+ * Iterations of a restored checkpoint are added to the count, the
+ * checkpoints during the solve are written by solving_checkpoint.
+ */
+template <int dim>
+bool
+Elastic::ElasticBase<dim>::solve_iterative ()
+{
+    const unsigned int iterations = checkpoint_iterations;
+
+    try{
+        solve ();
+        checkpoint_iterations = 0;
+        par->system_iter += iterations;
+        return true;
+    }catch (const SolverControl::NoConvergence &e){
+        checkpoint_iterations = 0;
+        if(!fallback_possible ())
+            throw;
+
+        const unsigned int total = iterations + e.last_step;
+        oout << RED << " | Stagnated at step " << total
+             << ", direct solve" << RESET << flush;
+        par->system_iter = total;
+        direct_solve (solution, system_rhs);
+        return false;
+    }
+}
+
+/**
+ * The solve runs to par->TOL, discretization_reached ends it earlier.
+ * The iterations saved are extrapolated with the observed residual
+ * reduction per iteration down to par->TOL.
+ */
+template <int dim>
+void
+Elastic::ElasticBase<dim>::solve_to_discretization ()
+{
+    const double target = par->TOL;
+    Timer stop_timer;
+
+    TrilinosWrappers::BlockVector residual (solution);
+    const double initial = system_matrix.residual (residual, solution, system_rhs);
+
+    disc_stop = DiscretizationStop();
+    disc_stop.initial = initial;
+    disc_stop.previous_residual = initial;
+    disc_stop.previous = solution;
+
+    // The hook is only registered while this solve runs, also if it throws
+    struct Activation
+    {
+        Activation (bool &_flag) : flag(_flag) { flag = true; }
+        ~Activation () { flag = false; }
+        bool &flag;
+    } activation (disc_stop.active);
+
+    const bool iterative = solve_iterative ();
+    const unsigned int iterations = par->system_iter;
+    disc_stop.previous.reinit (0);
+
+    const double final_residual = system_matrix.residual (residual, solution, system_rhs);
+    disc_stop.tolerance = final_residual/system_rhs.l2_norm();
+    if(iterative && disc_stop.stopped && iterations > 0 && final_residual < initial){
+        const double decades = std::log10 (initial/final_residual),
+                full = std::log10 (initial/(target*system_rhs.l2_norm()));
+        disc_stop.saved_iterations = std::max (0.0, iterations*full/decades - iterations);
+        disc_stop.saved_time = disc_stop.saved_iterations*stop_timer.wall_time()/iterations;
+    }
+}
+
+/**
+ * With the residual reduced by rho over the last cycle the remaining
+ * algebraic error is about rho/(1-rho) times the correction of that
+ * cycle. Before the residual has dropped a hundredfold the estimate is
+ * not trusted.
+ */
+template <int dim>
+bool
+Elastic::ElasticBase<dim>::discretization_reached (const unsigned int, const double residual)
+{
+    ++disc_stop.stages;
+    const double rho = residual/disc_stop.previous_residual;
+    disc_stop.previous.sadd (-1.0, 1.0, solution);
+    const double correction = displacement_norm (disc_stop.previous, par->x2 == par->Ix);
+    disc_stop.previous = solution;
+    disc_stop.previous_residual = residual;
+
+    if(residual > 1e-2*disc_stop.initial || rho >= 1)
+        return false;
+
+    disc_stop.discretization = discretization_error (par->x2 == par->Ix);
+    disc_stop.algebraic      = rho/(1 - rho)*correction;
+    disc_stop.stopped = disc_stop.algebraic <= par->disc_fraction*disc_stop.discretization;
+    return disc_stop.stopped;
+}
+
+template <int dim>
+std::string
+Elastic::ElasticBase<dim>::store_signature () const
+{
+    std::ostringstream signature;
+    signature << "d" << dim << "_p" << degree << "_r" << par->refinements
+              << "_x" << par->xdivisions << "_y" << par->ydivisions
+              << "_" << par->formulation2str(par->formulation)
+              << "_dg" << par->dg_pressure;
+    for(unsigned int i = 0; i < n_blocks; ++i)
+        signature << "_" << dofs_per_block[i];
+    return signature.str();
+}
+
+template <int dim>
+void
+Elastic::ElasticBase<dim>::warm_start ()
+{
+    const SolutionStore store (par->store_file, store_signature());
+    std::vector<double> x (solution.size());
+
+    warm = WarmStart();
+    warm.used = store.initial_guess (par->POISSON, par->load, par->store_extrapolate,
+                                     x, warm.origin, warm.cold_iterations);
+    if(!warm.used)
+        return;
+
+    for(unsigned int i = 0; i < x.size(); ++i)
+        solution(i) = x[i];
+
+    TrilinosWrappers::BlockVector residual (solution);
+    warm.residual = system_matrix.residual (residual, solution, system_rhs)
+            /system_rhs.l2_norm();
+}
+
+template <int dim>
+void
+Elastic::ElasticBase<dim>::store_solution () const
+{
+    std::vector<double> x (solution.size());
+    for(unsigned int i = 0; i < x.size(); ++i)
+        x[i] = solution(i);
+
+    const unsigned int cold = warm.used ? warm.cold_iterations : par->system_iter;
+    SolutionStore (par->store_file, store_signature())
+            .store (par->POISSON, par->load, par->system_iter, cold, x);
+}
+
+template <int dim>
+std::string
+Elastic::ElasticBase<dim>::checkpoint_signature () const
+{
+    std::ostringstream signature;
+    signature << "d" << dim << "_p" << degree << "_r" << par->refinements
+              << "_x" << par->xdivisions << "_y" << par->ydivisions
+              << "_box" << par->x1 << "," << par->x2 << "," << par->y1 << "," << par->y2
+              << "_b" << par->b_left << par->b_right << par->b_bottom << par->b_ice << par->b_up
+              << "_nu" << par->POISSON << "_E" << par->YOUNG
+              << "_" << par->formulation2str(par->formulation)
+              << "_dg" << par->dg_pressure
+              << "_adv" << par->adv_enabled << "_div" << par->div_enabled
+              << "_al" << par->al_enabled << "_g" << par->al_gamma
+              << "_" << par->schur2str(par->schur_type)
+              << "_l" << par->load_enabled << par->load
+              << "_w" << par->weight_enabled << par->weight
+              << "_Ix" << par->Ix << "_h" << par->h;
+    return signature.str();
+}
+
+template <int dim>
+int
+Elastic::ElasticBase<dim>::read_checkpoint_geometry ()
+{
+    int phase = Checkpoint::NONE;
+    try{
+        restart_stream.reset (new std::ifstream (par->checkpoint_file.c_str(), std::ios::binary));
+        if(!*restart_stream){
+            restart_stream.reset ();
+            return Checkpoint::NONE;
+        }
+        restart_archive.reset (new boost::archive::binary_iarchive (*restart_stream));
+
+        std::string signature;
+        *restart_archive >> phase >> signature;
+        if(signature != checkpoint_signature()){
+            oout << RED << "Checkpoint " << par->checkpoint_file
+                 << " is for other parameters, starting over" << RESET << std::endl;
+            phase = Checkpoint::NONE;
+        }else{
+            triangulation.load (*restart_archive, 0);
+            *restart_archive >> dof_numbering;
+        }
+    }catch (std::exception &e){
+        oout << RED << "Checkpoint " << par->checkpoint_file
+             << " unreadable, starting over" << RESET << std::endl;
+        phase = Checkpoint::NONE;
+    }
+
+    if(phase == Checkpoint::NONE){
+        triangulation.clear ();
+        dof_numbering.clear ();
+        restart_archive.reset ();
+        restart_stream.reset ();
+    }
+    return phase;
+}
+
+template <int dim>
+int
+Elastic::ElasticBase<dim>::read_checkpoint_state (const int phase)
+{
+    int restored = phase;
+    try{
+        if(phase >= Checkpoint::ASSEMBLED){
+            Checkpoint::load_matrix (*restart_archive, system_matrix);
+            Checkpoint::load_matrix (*restart_archive, system_preconditioner);
+            Checkpoint::load_vector (*restart_archive, system_rhs);
+            Checkpoint::load_vector (*restart_archive, precond_rhs);
+            Checkpoint::load_vector (*restart_archive, load);
+            Checkpoint::load_vector (*restart_archive, body_force);
+        }
+        if(phase >= Checkpoint::SOLVING){
+            Checkpoint::load_vector (*restart_archive, solution);
+            *restart_archive >> checkpoint_iterations;
+        }
+    }catch (std::exception &e){
+        // The mesh and numbering are fine, everything after is redone
+        oout << RED << "Checkpoint " << par->checkpoint_file
+             << " truncated, restarting from the geometry" << RESET << std::endl;
+        system_matrix = 0;
+        system_preconditioner = 0;
+        solution = 0;
+        checkpoint_iterations = 0;
+        restored = Checkpoint::GEOMETRY;
+    }
+    restart_archive.reset ();
+    restart_stream.reset ();
+    return restored;
+}
+
+template <int dim>
+void
+Elastic::ElasticBase<dim>::write_checkpoint (const int phase)
+{
+    const std::string tmp_file = par->checkpoint_file + ".tmp";
+    {
+        std::ofstream ofs (tmp_file.c_str(), std::ios::binary);
+        boost::archive::binary_oarchive oa (ofs);
+
+        const std::string signature = checkpoint_signature();
+        oa << phase << signature;
+        triangulation.save (oa, 0);
+        oa << dof_numbering;
+
+        if(phase >= Checkpoint::ASSEMBLED){
+            Checkpoint::save_matrix (oa, system_matrix);
+            Checkpoint::save_matrix (oa, system_preconditioner);
+            Checkpoint::save_vector (oa, system_rhs);
+            Checkpoint::save_vector (oa, precond_rhs);
+            Checkpoint::save_vector (oa, load);
+            Checkpoint::save_vector (oa, body_force);
+        }
+        if(phase >= Checkpoint::SOLVING){
+            const unsigned int iterations = par->system_iter;
+            Checkpoint::save_vector (oa, solution);
+            oa << iterations;
+        }
+    }
+    std::rename (tmp_file.c_str(), par->checkpoint_file.c_str());
+    ++checkpoints_written;
+}
+
+template <int dim>
+void
+Elastic::ElasticBase<dim>::solving_checkpoint (const unsigned int step)
+{
+    par->system_iter = checkpoint_iterations + step;
+    write_checkpoint (Checkpoint::SOLVING);
+}
+
+template <int dim>
+double
+Elastic::ElasticBase<dim>::discretization_error (const bool exact) const
+{
+    if(exact){
+        double u_er = 0, p_er = 0;
+        compute_errors (u_er, p_er);
+        return u_er;
+    }
+
+    BlockVector<double> tmp;
+    tmp = solution;
+    Vector<float> cellwise_errors (triangulation.n_active_cells());
+    KellyErrorEstimator<dim>::estimate (dof_handler,
+                                        QGauss<dim-1>(degree+2),
+                                        typename FunctionMap<dim>::type(),
+                                        tmp,
+                                        cellwise_errors,
+                                        fe.component_mask (FEValuesExtractors::Vector(0)));
+    return cellwise_errors.l2_norm();
+}
+
+template <int dim>
+double
+Elastic::ElasticBase<dim>::displacement_norm (const TrilinosWrappers::BlockVector &v,
+                                              const bool                          exact) const
+{
+    const ComponentSelectFunction<dim>
+            velocity_mask(std::make_pair(0, dim), dim+1);
+    Vector<double> cellwise_norms (triangulation.n_active_cells());
+
+    VectorTools::integrate_difference (dof_handler, v, ZeroFunction<dim>(dim+1),
+                                       cellwise_norms, QGauss<dim>(degree+2),
+                                       exact ? VectorTools::L2_norm : VectorTools::H1_seminorm,
+                                       &velocity_mask);
+    return cellwise_norms.l2_norm();
+}
+
+template <int dim>
+void
+Elastic::ElasticBase<dim>::solve_load_steps (const bool direct)
+{
+    step_iterations.clear ();
+    for(int step = 1; step <= par->load_steps; ++step){
+        system_rhs = body_force;
+        system_rhs.add (static_cast<double>(step)/par->load_steps, load);
+
+        solve_system (direct);
+        step_iterations.push_back (par->system_iter);
+    }
+}
+
+template <int dim>
+void
+Elastic::ElasticBase<dim>::tune_AMG (TrilinosWrappers::PreconditionAMG::AdditionalData &data,
+                                     const TrilinosWrappers::SparseMatrix             &M,
+                                     const std::string                                &name,
+                                     std::vector<double>                              *modes,
+                                     const unsigned int                               n_modes)
+{
+    if(!par->amg_tune)
+        return;
+
+    // Problem signature: dim, degree, refinements, poisson ratio, adv, div
+    // and the augmented Lagrangian parameter, which changes the A block,
+    // and the near null space of the displacement block
+    std::ostringstream signature;
+    signature << "d" << dim << "_p" << degree << "_r" << par->refinements
+              << "_nu" << par->POISSON
+              << "_adv" << par->adv_enabled << "_div" << par->div_enabled
+              << "_al" << (par->al_enabled ? par->al_gamma : 0)
+              << "_rigid" << par->rigid_modes;
+
+    // The trials are built like the hierarchy that is used
+    AMGTuner tuner (par, signature.str());
+    if(modes)
+        tuner.set_null_space (*modes, n_modes);
+
+    timer.enter_section("AMG tuning");
+    tuner.tune (data, M, name);
+    timer.exit_section("AMG tuning");
+}
+
+template <int dim>
+void
+Elastic::ElasticBase<dim>::setup_displacement_AMG (Threads::TaskGroup<void>             &tasks,
+                                                   TrilinosWrappers::PreconditionAMG    &prec,
+                                                   const TrilinosWrappers::SparseMatrix &M,
+                                                   const std::string                    &name)
+{
+    std::vector<std::vector<bool> > constant_modes;
+    std::vector<bool>  displacement_components (n_components,true);
+
+    displacement_components[n_components-1] = false;
+    DoFTools::extract_constant_modes (dof_handler,
+                                      displacement_components,
+                                      constant_modes);
+
+    displacement_data = TrilinosWrappers::PreconditionAMG::AdditionalData();
+    displacement_data.constant_modes = constant_modes;
+    displacement_data.elliptic = true;
+    displacement_data.higher_order_elements = false;
+    displacement_data.smoother_sweeps = 2;
+    displacement_data.aggregation_threshold = par->threshold;
+
+    if(par->rigid_modes){
+        // Translations and rotations as near null space, AdditionalData
+        // only takes boolean modes. Tuned with the same modes.
+        const unsigned int n_modes = rigid_body_modes (null_space);
+        tune_AMG (displacement_data, M, name, &null_space, n_modes);
+        AMGTuner::parameter_list (displacement_data, null_space, n_modes, displacement_list);
+
+        setup_block_AMG (tasks, prec, M, displacement_list, name);
+    }else{
+        tune_AMG (displacement_data, M, name);
+        setup_block_AMG (tasks, prec, M, displacement_data, name);
+    }
+}
+
+template <int dim>
+template <class DataType>
+void
+Elastic::ElasticBase<dim>::setup_block_AMG (Threads::TaskGroup<void>             &tasks,
+                                            TrilinosWrappers::PreconditionAMG    &prec,
+                                            const TrilinosWrappers::SparseMatrix &M,
+                                            const DataType                       &data,
+                                            const std::string                    &name)
+{
+    const std::string section = "AMG " + name;
+
+    if(par->amg_concurrent)
+        tasks += Threads::new_task (std_cxx1x::function<void ()>
+                                    (std_cxx1x::bind (&ElasticBase<dim>::template initialize_AMG<DataType>,
+                                                      this, &prec, &M, &data, section)));
+    else
+        initialize_AMG (&prec, &M, &data, section);
+}
+
+template <int dim>
+template <class DataType>
+void
+Elastic::ElasticBase<dim>::initialize_AMG (TrilinosWrappers::PreconditionAMG    *prec,
+                                           const TrilinosWrappers::SparseMatrix *M,
+                                           const DataType                       *data,
+                                           const std::string                    section)
+{
+    // ML needs MPI from one thread at a time, the section starts once
+    // this build has the lock. TimerOutput locks its sections, so the
+    // tasks can time themselves.
+    Threads::Mutex::ScopedLock lock (AMGTuner::setup_mutex ());
+    timer.enter_section(section);
+    prec->initialize (*M, *data);
+    timer.exit_section(section);
+}
+
 template <int dim>
 void
 Elastic::ElasticBase<dim>::compute_errors (double &u_l2_error, double &p_l2_error) const
@@ -571,7 +1671,7 @@ Elastic::ElasticBase<dim>::compute_errors (double &u_l2_error, double &p_l2_erro
     const ComponentSelectFunction<dim>
             velocity_mask(std::make_pair(0, dim), dim+1);
 
-    ExactSolution<dim> exact_solution;
+    ExactSolution<dim> exact_solution (par);
     Vector<double> cellwise_errors (triangulation.n_active_cells());
 
 
@@ -608,12 +1708,23 @@ Elastic::ElasticBase<dim>::run ()
     // Printing application variable
     par->print_variables(oout);
 
-    create_geometry();
+    int restored = Checkpoint::NONE;
+    if(par->restart)
+        restored = read_checkpoint_geometry ();
+    if(restored == Checkpoint::NONE)
+        create_geometry();
 
     timer.enter_section("DOF setup");
     setup_dofs ();
     timer.exit_section("DOF setup");
 
+    if(restored != Checkpoint::NONE){
+        timer.enter_section("Restart");
+        restored = read_checkpoint_state (restored);
+        timer.exit_section("Restart");
+    }else if(par->checkpoint)
+        write_checkpoint (Checkpoint::GEOMETRY);
+
     /// Terminal output
     oout << "Active cells: "
          << triangulation.n_active_cells() << std::endl;
@@ -625,20 +1736,56 @@ Elastic::ElasticBase<dim>::run ()
               std::ostream_iterator<int>(oout,"+") );
     oout << "\b)" << std::endl;
 
-    oout << GREEN << "\tAssembling" << RESET << flush;
-    timer.enter_section("Assembling");
-    assemble_system ();
-    timer.exit_section();
+    // The local pressure recovery of the condensed system is not in
+    // the checkpoint, it is assembled again with the system
+    const bool reassemble = restored >= Checkpoint::ASSEMBLED && par->dg_pressure;
+    if(restored < Checkpoint::ASSEMBLED || reassemble){
+        oout << GREEN << (reassemble ? "\tReassembling" : "\tAssembling") << RESET << flush;
+        timer.enter_section("Assembling");
+        assemble_system ();
+        timer.exit_section();
+        if(par->checkpoint && !reassemble)
+            write_checkpoint (Checkpoint::ASSEMBLED);
+    }else
+        oout << GREEN << "\tRestored system" << RESET << flush;
+    direct_factorized = false;
+
+    // Small systems are cheaper to factorize than to precondition
+    const bool direct = direct_possible ()
+            && dof_handler.n_dofs() <= static_cast<unsigned int>(par->direct_dofs);
+
+    if(!direct){
+        timer.enter_section("Schur setup");
+        setup_schur ();
+        timer.exit_section("Schur setup");
+
+        oout << GREEN << " | Setup AMG" << RESET << flush;
+        timer.enter_section("Setup AMG");
+        setup_AMG ();
+        timer.exit_section();
+    }
 
-    oout << GREEN << " | Setup AMG" << RESET << flush;
-    timer.enter_section("Setup AMG");
-    setup_AMG ();
-    timer.exit_section();
+    if(par->store_enabled && !direct && restored < Checkpoint::SOLVING){
+        timer.enter_section("Warm start");
+        warm_start ();
+        timer.exit_section("Warm start");
+    }
 
-    oout << GREEN << " | Solve system" << RESET << flush;
-    timer.enter_section("System solver");
-    solve ();
-    timer.exit_section();
+    if(restored < Checkpoint::SOLVED){
+        oout << GREEN << " | Solve system" << RESET << flush;
+        timer.enter_section("System solver");
+        if(par->load_steps > 1)
+            solve_load_steps (direct);
+        else
+            solve_system (direct);
+        timer.exit_section();
+        if(par->checkpoint)
+            write_checkpoint (Checkpoint::SOLVED);
+    }else
+        par->system_iter = checkpoint_iterations;
+
+    if(par->store_enabled && restored < Checkpoint::SOLVED)
+        store_solution ();
 
     if(par->output_results){
         oout << GREEN << " | Extract results" << RESET << flush;
@@ -659,10 +1806,13 @@ Elastic::ElasticBase<dim>::run ()
         inv_iter   += par->inv_iterations[i];
         schur_iter += par->schur_iterations[i];
     }
+    const int inv_total = inv_iter, schur_total = schur_iter;
 
     // average inner iterations
-    inv_iter /= par->inv_iterations.size();
-    schur_iter /=par->schur_iterations.size();
+    if(par->inv_iterations.size() > 0){
+        inv_iter /= par->inv_iterations.size();
+        schur_iter /=par->schur_iterations.size();
+    }
 
     if(par->x2 == par->Ix ){
         double u_er = 0, p_er = 0;
@@ -672,9 +1822,106 @@ Elastic::ElasticBase<dim>::run ()
              << u_er << "," << p_er << std::endl;
     }
 
-    oout   << "FGMRES iterations: system(P_00,Schur) = "
+    oout   << (par->minres ? "MINRES" : "FGMRES")
+           << " iterations: system(P_00,Schur) = "
            << par->system_iter
            << "(" << inv_iter << ", " << schur_iter << ")"
+           << ", total inner = "
+           << inv_total << "+" << schur_total
+           << std::endl
+           << "\tworkspace: outer vectors = "
+           << outer_workspace.n_allocated << " ("
+           << outer_workspace.memory/(1024.0*1024.0) << " MB)"
+           << ", inner requests(allocations) = "
+           << workspace.n_requests
+           << "(" << workspace.n_allocated << ") ("
+           << workspace.memory/(1024.0*1024.0) << " MB)"
+           << std::endl;
+
+    if(step_iterations.size() > 1 && !direct){
+        unsigned int total = 0;
+        oout   << "Load steps: iterations =";
+        for(unsigned int i = 0; i < step_iterations.size(); ++i){
+            oout << " " << step_iterations[i];
+            total += step_iterations[i];
+        }
+        // Every step costs as much as the first one without recycling
+        const int saved = static_cast<int>(step_iterations[0]*step_iterations.size())
+                - static_cast<int>(total);
+        oout   << ", total = " << total
+               << ", saved vs first step = " << saved
+               << std::endl;
+        if(par->recycle)
+            oout   << "Recycled subspace: vectors = "
+                   << recycler.subspace_size()
+                   << std::endl;
+    }
+
+    if(par->store_enabled){
+        oout   << "Warm start: ";
+        if(warm.used){
+            oout << warm.origin << ", initial residual = " << warm.residual;
+            if(warm.cold_iterations > 0)
+                oout << ", iterations = " << par->system_iter
+                     << " vs " << warm.cold_iterations << " cold ("
+                     << 100.0*(1.0 - static_cast<double>(par->system_iter)/warm.cold_iterations)
+                     << "% fewer)";
+        }else
+            oout << "no stored solution, cold start";
+        oout   << std::endl;
+    }
+
+    if(disc_stop.stages > 0)
+        oout   << "Discretization stop: "
+               << (par->x2 == par->Ix ? "exact" : "Kelly") << " error = "
+               << disc_stop.discretization << ", algebraic = " << disc_stop.algebraic
+               << ", tolerance = " << disc_stop.tolerance
+               << ", restarts checked = " << disc_stop.stages
+               << ", saved ~ " << static_cast<int>(disc_stop.saved_iterations + 0.5)
+               << " iterations, " << disc_stop.saved_time << " s"
+               << std::endl;
+
+    if(par->checkpoint || par->restart)
+        oout   << "Checkpoint: restored "
+               << Checkpoint::phase2str (restored)
+               << ", written " << checkpoints_written
+               << std::endl;
+
+    if(direct_solves > 0)
+        oout   << "Direct solver: UMFPACK, solves = "
+               << direct_solves
+               << std::endl;
+
+    if(outer_workspace.iterations > 0)
+        oout   << "Outer solver: "
+               << (par->minres ? "MINRES" : par->recycle ? "recycling FGMRES"
+                                           : par->outer_cgs2 ? "FGMRES CGS2" : "FGMRES MGS")
+               << ", time per iteration = "
+               << 1e3*outer_workspace.solve_time/outer_workspace.iterations << " ms"
+               << std::endl;
+
+    if(workspace.iterations > 0)
+        oout   << "Inner FGMRES: " << (par->inner_cgs2 ? "CGS2" : "MGS")
+               << ", time per iteration = "
+               << 1e3*workspace.solve_time/workspace.iterations << " ms"
+               << std::endl;
+
+    if(workspace.single_memory > 0)
+        oout   << "Single precision matrices: added memory = "
+               << workspace.single_memory/(1024.0*1024.0) << " MB"
+               << ", application = " << 1e3*workspace.single_application << " ms"
+               << " (double " << 1e3*workspace.double_application << " ms"
+               << ", speedup " << workspace.double_application/workspace.single_application << ")"
+               << std::endl;
+
+    if(!par->dg_pressure && par->formulation == fFlags::MIXED)
+        oout   << "Schur " << par->schur2str(par->schur_type) << ": setup = "
+               << schur_timer.wall_time() << " s, memory = "
+               << schur_operator().memory_consumption()/(1024.0*1024.0) << " MB"
+               << std::endl;
+
+    oout   << (par->monolithic_mg ? "Multigrid memory: " : "AMG memory: ")
+           << amg_memory/(1024.0*1024.0) << " MB"
            << std::endl;
 }
 
@@ -706,6 +1953,75 @@ Elastic::ElasticBase<dim>::output_results ()
     data_out.write_vtu (output);
 }
 
+template <int dim>
+void
+Elastic::ElasticBase<dim>::solution_values (std::vector<double> &values) const
+{
+    values.resize (solution.size());
+    for(unsigned int i = 0; i < values.size(); ++i)
+        values[i] = solution(i);
+}
+
+/*!
+ * The face is evaluated at its vertices, every vertex shared by
+ * several surface faces is taken once.
+ */
+template <int dim>
+void
+Elastic::ElasticBase<dim>::surface_values (std::vector<double> &points,
+                                           std::vector<double> &displacements) const
+{
+    points.clear ();
+    displacements.clear ();
+
+    const QTrapez<dim-1> vertex_quadrature;
+    FEFaceValues<dim> fe_face_values (fe, vertex_quadrature,
+                                      update_values | update_quadrature_points);
+    const FEValuesExtractors::Vector displacement (0);
+    std::vector<Tensor<1,dim> > values (vertex_quadrature.size());
+    std::vector<bool> visited (triangulation.n_vertices(), false);
+
+    typename DoFHandler<dim>::active_cell_iterator
+            cell = dof_handler.begin_active(),
+            endc = dof_handler.end();
+    for(; cell != endc; ++cell)
+        for(unsigned int f = 0; f < GeometryInfo<dim>::faces_per_cell; ++f){
+            if(!cell->face(f)->at_boundary() ||
+                    (cell->face(f)->boundary_indicator() != par->b_ice &&
+                     cell->face(f)->boundary_indicator() != par->b_up))
+                continue;
+
+            fe_face_values.reinit (cell, f);
+            fe_face_values[displacement].get_function_values (solution, values);
+
+            for(unsigned int v = 0; v < GeometryInfo<dim>::vertices_per_face; ++v){
+                const unsigned int index = cell->face(f)->vertex_index(v);
+                if(visited[index])
+                    continue;
+                visited[index] = true;
+
+                // Quadrature point at this vertex
+                const Point<dim> vertex = cell->face(f)->vertex(v);
+                unsigned int q = 0;
+                while(q+1 < values.size() && fe_face_values.quadrature_point(q).distance(vertex)
+                      > 1e-10*cell->face(f)->diameter())
+                    ++q;
+
+                for(unsigned int d = 0; d < dim; ++d){
+                    points.push_back (vertex[d]);
+                    displacements.push_back (values[q][d]);
+                }
+            }
+        }
+}
+
+template <int dim>
+const std::vector<unsigned int> &
+Elastic::ElasticBase<dim>::get_dofs_per_component () const
+{
+    return dofs_per_component;
+}
+
 /*!
  * Output surface values to file.
  */
@@ -722,7 +2038,7 @@ Elastic::ElasticBase<dim>::output_surface() {
     data_component_interpretation
             .push_back (DataComponentInterpretation::component_is_scalar);
 
-    SurfaceDataOut<dim> data_out;
+    SurfaceDataOut<dim> data_out (par);
     data_out.attach_dof_handler (dof_handler);
     data_out.add_data_vector (solution, solution_names,
                               DataOutFaces<dim>::type_dof_data,
@@ -736,6 +2052,56 @@ Elastic::ElasticBase<dim>::output_surface() {
     data_out.write_gnuplot (output);
 }
 
+template <int dim>
+unsigned int
+Elastic::ElasticBase<dim>::rigid_body_modes (std::vector<double> &modes) const
+{
+    const unsigned int n_modes = (dim == 2 ? 3 : 6);
+
+    // Displacements are numbered first and component wise
+    unsigned int n_u = 0;
+    for(unsigned int c=0; c<dim; ++c)
+        n_u += dofs_per_component[c];
+
+    // Support points of the displacement element, the pressure
+    // element may have none (FE_DGP)
+    const Quadrature<dim> support_quadrature (fe.base_element(0).get_unit_support_points());
+    FEValues<dim> fe_values (MappingQ1<dim>(), fe, support_quadrature, update_quadrature_points);
+    std::vector<unsigned int> local_dof_indices (fe.dofs_per_cell);
+
+    modes.assign (n_modes*n_u, 0.0);
+    typename DoFHandler<dim>::active_cell_iterator
+            cell = dof_handler.begin_active(),
+            endc = dof_handler.end();
+    for (; cell!=endc; ++cell){
+        fe_values.reinit (cell);
+        cell->get_dof_indices (local_dof_indices);
+
+        for (unsigned int k=0; k<fe.dofs_per_cell; ++k){
+            const unsigned int c = fe.system_to_component_index(k).first;
+            if(c >= dim)
+                continue;
+
+            const unsigned int i = local_dof_indices[k];
+            const Point<dim> &p = fe_values.quadrature_point (fe.system_to_base_index(k).second);
+
+            // translation in direction c
+            modes[c*n_u + i] = 1.0;
+
+            // rotations, (-y,x) in 2d, around z, x and y in 3d
+            if(dim == 2){
+                modes[2*n_u + i] = (c == 0 ? -p[1] : p[0]);
+            }else{
+                modes[3*n_u + i] = (c == 0 ? -p[1] : (c == 1 ?  p[0] : 0.0));
+                modes[4*n_u + i] = (c == 0 ?  0.0  : (c == 1 ? -p[2] : p[1]));
+                modes[5*n_u + i] = (c == 0 ?  p[2] : (c == 1 ?  0.0  : -p[0]));
+            }
+        }
+    }
+
+    return n_modes;
+}
+
 // Change string to uppercase
 template <int dim>
 std::string
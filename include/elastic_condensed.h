@@ -0,0 +1,333 @@
+/* TODO
+
+ */
+
+#ifndef ELASTIC_CONDENSED_H
+#define ELASTIC_CONDENSED_H
+
+#include <deal.II/base/quadrature_lib.h>
+#include <deal.II/base/timer.h>
+#include <deal.II/dofs/dof_accessor.h>
+#include <deal.II/dofs/dof_handler.h>
+#include <deal.II/dofs/dof_tools.h>
+#include <deal.II/fe/fe_system.h>
+#include <deal.II/fe/fe_values.h>
+#include <deal.II/lac/full_matrix.h>
+#include <deal.II/lac/solver_cg.h>
+#include <deal.II/lac/solver_control.h>
+#include <deal.II/lac/solver_gmres.h>
+#include <deal.II/lac/trilinos_precondition.h>
+#include <deal.II/lac/trilinos_sparse_matrix.h>
+#include <deal.II/lac/trilinos_vector.h>
+#include <deal.II/lac/vector.h>
+
+#include <vector>
+
+#include "elastic_base.h"
+#include "boundary.h"
+#include "coefficient.h"
+#include "parameters.h"
+#include "rhs.h"
+
+using namespace std;
+using namespace dealii;
+namespace Elastic
+{
+/*!
+ * Discontinuous pressure (FE_DGP) eliminated cell by cell.
+ * On every cell K_pp is invertible for beta > 0, so
+ * p = K_pp^{-1}(g - B u) and the global system is the displacement
+ * block A - Bt K_pp^{-1} B only. It is symmetric positive definite
+ * without advection and divergence terms and is solved with AMG
+ * preconditioned CG (GMRES otherwise). The pressure is recovered
+ * locally after the solve, there is no Schur complement solve.
+ */
+template <int dim>
+class ElasticCondensed : public ElasticBase<dim> {
+public:
+    ElasticCondensed (parameters *_par, const unsigned int degree, const int _info,
+                      std::ostream &out = std::cout);
+
+private:
+    // Assemble the condensed displacement system
+    virtual void assemble_system ();
+    // Setup Algebraic multigrid(AMG)
+    virtual void setup_AMG ();
+    // Solve the system
+    virtual void solve ();
+
+    // p = recovery_matrix*u + recovery_rhs on every cell
+    void recover_pressure ();
+
+    std_cxx1x::shared_ptr<TrilinosWrappers::PreconditionAMG> A_preconditioner;
+
+    // Local pressure recovery, stored in cell order
+    std::vector<FullMatrix<double> >	recovery_matrix;
+    std::vector<Vector<double> >		recovery_rhs;
+
+    // Local displacement and pressure dofs of a cell
+    std::vector<unsigned int>			local_u, local_p;
+};
+}
+
+/*
+ ------------- IMPLEMENTATION --------------
+ */
+template <int dim>
+Elastic::ElasticCondensed<dim>::ElasticCondensed (parameters *_par, const unsigned int degree, const int _info,
+                                                   std::ostream &out)
+    : Elastic::ElasticBase<dim>(_par, degree, _info, 2, out){}
+
+/**
+ * Same weak form as ElasticBase::assemble_system, the pressure rows
+ * are eliminated before the local to global transfer.
+ */
+template <int dim>
+void
+Elastic::ElasticCondensed<dim>::assemble_system ()
+{
+    const FESystem<dim> &fe  = ElasticBase<dim>::fe;
+    parameters          *par = ElasticBase<dim>::par;
+
+    ElasticBase<dim>::system_matrix = 0;
+    ElasticBase<dim>::system_rhs = 0;
+
+    QGauss<dim>   quadrature_formula(ElasticBase<dim>::degree+2);
+    QGauss<dim-1> face_quadrature_formula(ElasticBase<dim>::degree+2);
+
+    FEValues<dim> fe_values (fe, quadrature_formula,
+                             update_values    |
+                             update_quadrature_points  |
+                             update_JxW_values |
+                             update_gradients);
+
+    FEFaceValues<dim> fe_face_values (fe, face_quadrature_formula,
+                                      update_values    | update_normal_vectors |
+                                      update_quadrature_points  | update_JxW_values);
+
+    const unsigned int   dofs_per_cell   = fe.dofs_per_cell;
+    const unsigned int   n_q_points      = quadrature_formula.size();
+    const unsigned int   n_face_q_points = face_quadrature_formula.size();
+
+    local_u.clear ();
+    local_p.clear ();
+    for (unsigned int i=0; i<dofs_per_cell; ++i){
+        if (fe.system_to_component_index(i).first < dim)
+            local_u.push_back (i);
+        else
+            local_p.push_back (i);
+    }
+    const unsigned int dim_u = local_u.size(),
+            dim_p = local_p.size();
+
+    FullMatrix<double>	cell_matrix  (dofs_per_cell, dofs_per_cell),
+            l_A          (dim_u,dim_u),
+            l_Bt         (dim_u,dim_p),
+            l_B          (dim_p,dim_u),
+            l_Kinv       (dim_p,dim_p),
+            l_R          (dim_p,dim_u);
+
+    Vector<double>      cell_rhs (dofs_per_cell),
+            l_f (dim_u),
+            l_g (dim_p),
+            l_r (dim_p),
+            l_tmp (dim_u);
+
+    std::vector<unsigned int> local_dof_indices (dofs_per_cell),
+            u_dof_indices (dim_u);
+
+    const RightHandSide<dim>			right_hand_side (par);
+    const BoundaryValues<dim>			boundaries (par);
+    std::vector<Vector<double> >		rhs_values (n_q_points, Vector<double>(dim+1));
+    std::vector<Vector<double> >		boundary_values (n_face_q_points, Vector<double>(dim+1));
+
+    Coefficients<dim> 				  	 coeff(par->YOUNG,par->POISSON);
+    std::vector<double>     		  	 mu_values (n_q_points);
+    std::vector<double>     		  	 beta_values (n_q_points);	// mu^2/alpha
+
+    Tensor<1,dim> e(0);
+    e[dim-1] = 1.0;
+
+    typename ElasticBase<dim>::CellShapes shapes (dofs_per_cell);
+
+    recovery_matrix.clear ();
+    recovery_rhs.clear ();
+    recovery_matrix.reserve (ElasticBase<dim>::triangulation.n_active_cells());
+    recovery_rhs.reserve (ElasticBase<dim>::triangulation.n_active_cells());
+
+    typename DoFHandler<dim>::active_cell_iterator
+            cell = ElasticBase<dim>::dof_handler.begin_active(),
+            endc = ElasticBase<dim>::dof_handler.end();
+    for (; cell!=endc; ++cell)
+    {
+        fe_values.reinit (cell);
+        cell_matrix		= 0;
+        cell_rhs		= 0;
+
+        right_hand_side.vector_value_list(fe_values.get_quadrature_points(),
+                                          rhs_values);
+
+        coeff.mu_value_list     (fe_values.get_quadrature_points(), mu_values);
+        coeff.beta_value_list   (fe_values.get_quadrature_points(), beta_values);
+
+        for (unsigned int q=0; q<n_q_points; ++q)
+        {
+            shapes.reinit (fe_values, q);
+            ElasticBase<dim>::add_cell_matrix (shapes, mu_values[q], beta_values[q],
+                                               fe_values.JxW(q), false, cell_matrix);
+
+            for (unsigned int i=0; i<dofs_per_cell; ++i)
+                cell_rhs(i) +=  shapes.phi_u[i] * e * par->weight * fe_values.JxW(q); // load vector, body force
+        } // end q
+
+        // Neumann Boundary conditions (Ice-Load and free surface)
+        for (unsigned int face_num=0; face_num<GeometryInfo<dim>::faces_per_cell; ++face_num){
+            if (cell->face(face_num)->at_boundary()
+                    && (cell->face(face_num)->boundary_indicator() == par->b_ice ) ){
+                fe_face_values.reinit (cell, face_num);
+
+                boundaries.vector_value_list(fe_face_values.get_quadrature_points(),
+                                             boundary_values);
+
+                for (unsigned int q=0; q<n_face_q_points; ++q)
+                    for (unsigned int i=0; i<dofs_per_cell; ++i){
+                        const unsigned int
+                                component_i = fe.system_to_component_index(i).first;
+
+                        cell_rhs(i) +=  fe_face_values.shape_value(i, q) *
+                                boundary_values[q](component_i) *
+                                fe_face_values.JxW(q);
+                    }
+            }// end if at boundary
+        }// end face
+
+        // Split the local system
+        for (unsigned int i=0; i<dim_u; ++i){
+            for (unsigned int j=0; j<dim_u; ++j)
+                l_A(i,j) = cell_matrix(local_u[i],local_u[j]);
+            for (unsigned int j=0; j<dim_p; ++j)
+                l_Bt(i,j) = cell_matrix(local_u[i],local_p[j]);
+            l_f(i) = cell_rhs(local_u[i]);
+        }
+        for (unsigned int i=0; i<dim_p; ++i){
+            for (unsigned int j=0; j<dim_u; ++j)
+                l_B(i,j) = cell_matrix(local_p[i],local_u[j]);
+            for (unsigned int j=0; j<dim_p; ++j)
+                l_Kinv(i,j) = cell_matrix(local_p[i],local_p[j]);
+            l_g(i) = cell_rhs(local_p[i]);
+        }
+
+        // Condensation, K_pp = -beta*M_p is local to the cell
+        l_Kinv.gauss_jordan();
+        l_Kinv.mmult (l_R, l_B);
+        l_R *= -1.0;				// p = R u + r
+        l_Kinv.vmult (l_r, l_g);
+
+        l_Bt.mmult (l_A, l_R, true);	// A - Bt K^{-1} B
+        l_Bt.vmult (l_tmp, l_r);
+        l_f -= l_tmp;				// f - Bt K^{-1} g
+
+        recovery_matrix.push_back (l_R);
+        recovery_rhs.push_back (l_r);
+
+        // local-to-global, displacements are numbered first
+        cell->get_dof_indices (local_dof_indices);
+        for (unsigned int i=0; i<dim_u; ++i)
+            u_dof_indices[i] = local_dof_indices[local_u[i]];
+
+        ElasticBase<dim>::constraints.distribute_local_to_global(l_A, l_f,
+                                                                 u_dof_indices,
+                                                                 ElasticBase<dim>::system_matrix.block(0,0),
+                                                                 ElasticBase<dim>::system_rhs.block(0));
+    } // end cell
+}
+
+/**
+ * Setup the AMG of the condensed displacement block
+ */
+template <int dim>
+void
+Elastic::ElasticCondensed<dim>::setup_AMG ()
+{
+    A_preconditioner
+            = std_cxx1x::shared_ptr<TrilinosWrappers::PreconditionAMG>(new TrilinosWrappers::PreconditionAMG());
+
+    Threads::TaskGroup<void> tasks;
+    ElasticBase<dim>::setup_displacement_AMG (tasks, *A_preconditioner,
+                                              ElasticBase<dim>::system_matrix.block(0,0), "A_condensed");
+    tasks.join_all ();
+
+    ElasticBase<dim>::amg_memory = A_preconditioner->memory_consumption();
+}
+
+template <int dim>
+void
+Elastic::ElasticCondensed<dim>::solve ()
+{
+    parameters *par = ElasticBase<dim>::par;
+    const TrilinosWrappers::SparseMatrix &A = ElasticBase<dim>::system_matrix.block(0,0);
+
+    SolverControl solver_control (A.m(),
+                                  par->TOL*ElasticBase<dim>::system_rhs.block(0).l2_norm());
+#ifdef LOGRUN
+    solver_control.enable_history_data();
+    solver_control.log_history(true);
+    solver_control.log_result(true);
+    deallog.push("Condensed");
+#endif
+
+    if(!par->adv_enabled && !par->div_enabled){
+        SolverCG<TrilinosWrappers::Vector> solver (solver_control);
+        solver.solve (A, ElasticBase<dim>::solution.block(0),
+                      ElasticBase<dim>::system_rhs.block(0), *A_preconditioner);
+    }else{
+        SolverGMRES<TrilinosWrappers::Vector>
+                solver (solver_control,
+                        SolverGMRES<TrilinosWrappers::Vector >::AdditionalData(100));
+        solver.solve (A, ElasticBase<dim>::solution.block(0),
+                      ElasticBase<dim>::system_rhs.block(0), *A_preconditioner);
+    }
+#ifdef LOGRUN
+    deallog.pop();
+#endif
+
+    par->system_iter = solver_control.last_step();
+    ElasticBase<dim>::constraints.distribute (ElasticBase<dim>::solution);
+
+    ElasticBase<dim>::timer.enter_section("Pressure recovery");
+    recover_pressure ();
+    ElasticBase<dim>::timer.exit_section("Pressure recovery");
+}
+
+template <int dim>
+void
+Elastic::ElasticCondensed<dim>::recover_pressure ()
+{
+    const FESystem<dim> &fe = ElasticBase<dim>::fe;
+    TrilinosWrappers::BlockVector &solution = ElasticBase<dim>::solution;
+
+    std::vector<unsigned int> local_dof_indices (fe.dofs_per_cell);
+    Vector<double> l_u (local_u.size()),
+            l_p (local_p.size());
+
+    unsigned int index = 0;
+    typename DoFHandler<dim>::active_cell_iterator
+            cell = ElasticBase<dim>::dof_handler.begin_active(),
+            endc = ElasticBase<dim>::dof_handler.end();
+    for (; cell!=endc; ++cell, ++index)
+    {
+        cell->get_dof_indices (local_dof_indices);
+        for (unsigned int i=0; i<local_u.size(); ++i)
+            l_u(i) = solution(local_dof_indices[local_u[i]]);
+
+        l_p = recovery_rhs[index];
+        recovery_matrix[index].vmult_add (l_p, l_u);
+
+        // FE_DGP dofs belong to one cell only
+        for (unsigned int i=0; i<local_p.size(); ++i)
+            solution(local_dof_indices[local_p[i]]) = l_p(i);
+    }
+    solution.compress (VectorOperation::insert);
+}
+
+#endif // ELASTIC_CONDENSED_H
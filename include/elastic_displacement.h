@@ -0,0 +1,258 @@
+/* TODO
+
+ */
+
+#ifndef ELASTIC_DISPLACEMENT_H
+#define ELASTIC_DISPLACEMENT_H
+
+#include <deal.II/base/quadrature_lib.h>
+#include <deal.II/base/timer.h>
+#include <deal.II/dofs/dof_accessor.h>
+#include <deal.II/dofs/dof_handler.h>
+#include <deal.II/fe/fe_system.h>
+#include <deal.II/fe/fe_values.h>
+#include <deal.II/lac/full_matrix.h>
+#include <deal.II/lac/solver_cg.h>
+#include <deal.II/lac/solver_control.h>
+#include <deal.II/lac/solver_gmres.h>
+#include <deal.II/lac/trilinos_precondition.h>
+#include <deal.II/lac/trilinos_sparse_matrix.h>
+#include <deal.II/lac/trilinos_vector.h>
+#include <deal.II/lac/vector.h>
+
+#include <vector>
+
+#include "elastic_base.h"
+#include "boundary.h"
+#include "coefficient.h"
+#include "parameters.h"
+#include "rhs.h"
+
+using namespace std;
+using namespace dealii;
+namespace Elastic
+{
+/*!
+ * Pure displacement formulation for compressible runs.
+ * The constraint mu*div u - beta*p = 0 is eliminated before the
+ * discretization, which gives the standard elasticity operator
+ * 2mu(e(u),e(v)) + mu^2/beta (div u, div v). It is solved with AMG
+ * preconditioned CG. Afterwards the pressure is recovered from the
+ * discrete constraint C p = B u with a pressure mass matrix solve.
+ */
+template <int dim>
+class ElasticDisplacement : public ElasticBase<dim> {
+public:
+    ElasticDisplacement (parameters *_par, const unsigned int degree, const int _info,
+                         std::ostream &out = std::cout);
+
+private:
+    // Assemble the displacement operator, B and C
+    virtual void assemble_system ();
+    // Setup Algebraic multigrid(AMG)
+    virtual void setup_AMG ();
+    // Solve the system
+    virtual void solve ();
+
+    // Solve C p = B u - g
+    void recover_pressure ();
+
+    std_cxx1x::shared_ptr<TrilinosWrappers::PreconditionAMG> A_preconditioner;
+};
+}
+
+/*
+ ------------- IMPLEMENTATION --------------
+ */
+template <int dim>
+Elastic::ElasticDisplacement<dim>::ElasticDisplacement (parameters *_par, const unsigned int degree, const int _info,
+                                                         std::ostream &out)
+    : Elastic::ElasticBase<dim>(_par, degree, _info, 2, out){}
+
+/**
+ * Displacement rows hold the elasticity operator, pressure rows
+ * hold B and -C of the mixed system for the recovery.
+ */
+template <int dim>
+void
+Elastic::ElasticDisplacement<dim>::assemble_system ()
+{
+    const FESystem<dim> &fe  = ElasticBase<dim>::fe;
+    parameters          *par = ElasticBase<dim>::par;
+
+    ElasticBase<dim>::system_matrix = 0;
+    ElasticBase<dim>::system_rhs = 0;
+
+    QGauss<dim>   quadrature_formula(ElasticBase<dim>::degree+2);
+    QGauss<dim-1> face_quadrature_formula(ElasticBase<dim>::degree+2);
+
+    FEValues<dim> fe_values (fe, quadrature_formula,
+                             update_values    |
+                             update_quadrature_points  |
+                             update_JxW_values |
+                             update_gradients);
+
+    FEFaceValues<dim> fe_face_values (fe, face_quadrature_formula,
+                                      update_values    | update_normal_vectors |
+                                      update_quadrature_points  | update_JxW_values);
+
+    const unsigned int   dofs_per_cell   = fe.dofs_per_cell;
+    const unsigned int   n_q_points      = quadrature_formula.size();
+    const unsigned int   n_face_q_points = face_quadrature_formula.size();
+
+    FullMatrix<double>   cell_matrix (dofs_per_cell, dofs_per_cell);
+    Vector<double>       cell_rhs (dofs_per_cell);
+
+    std::vector<unsigned int> local_dof_indices (dofs_per_cell);
+
+    const RightHandSide<dim>			right_hand_side (par);
+    const BoundaryValues<dim>			boundaries (par);
+    std::vector<Vector<double> >		rhs_values (n_q_points, Vector<double>(dim+1));
+    std::vector<Vector<double> >		boundary_values (n_face_q_points, Vector<double>(dim+1));
+
+    Coefficients<dim> 				  	 coeff(par->YOUNG,par->POISSON);
+    std::vector<double>     		  	 mu_values (n_q_points);
+    std::vector<double>     		  	 beta_values (n_q_points);	// mu^2/alpha
+
+    Tensor<1,dim> e(0);
+    e[dim-1] = 1.0;
+
+    typename ElasticBase<dim>::CellShapes shapes (dofs_per_cell);
+
+    typename DoFHandler<dim>::active_cell_iterator
+            cell = ElasticBase<dim>::dof_handler.begin_active(),
+            endc = ElasticBase<dim>::dof_handler.end();
+    for (; cell!=endc; ++cell)
+    {
+        fe_values.reinit (cell);
+        cell_matrix		= 0;
+        cell_rhs		= 0;
+
+        right_hand_side.vector_value_list(fe_values.get_quadrature_points(),
+                                          rhs_values);
+
+        coeff.mu_value_list     (fe_values.get_quadrature_points(), mu_values);
+        coeff.beta_value_list   (fe_values.get_quadrature_points(), beta_values);
+
+        for (unsigned int q=0; q<n_q_points; ++q)
+        {
+            shapes.reinit (fe_values, q);
+            ElasticBase<dim>::add_cell_matrix (shapes, mu_values[q], beta_values[q],
+                                               fe_values.JxW(q), true, cell_matrix);
+
+            for (unsigned int i=0; i<dofs_per_cell; ++i)
+                cell_rhs(i) +=  shapes.phi_u[i] * e * par->weight * fe_values.JxW(q); // load vector, body force
+        } // end q
+
+        // Neumann Boundary conditions (Ice-Load and free surface)
+        for (unsigned int face_num=0; face_num<GeometryInfo<dim>::faces_per_cell; ++face_num){
+            if (cell->face(face_num)->at_boundary()
+                    && (cell->face(face_num)->boundary_indicator() == par->b_ice ) ){
+                fe_face_values.reinit (cell, face_num);
+
+                boundaries.vector_value_list(fe_face_values.get_quadrature_points(),
+                                             boundary_values);
+
+                for (unsigned int q=0; q<n_face_q_points; ++q)
+                    for (unsigned int i=0; i<dofs_per_cell; ++i){
+                        const unsigned int
+                                component_i = fe.system_to_component_index(i).first;
+
+                        cell_rhs(i) +=  fe_face_values.shape_value(i, q) *
+                                boundary_values[q](component_i) *
+                                fe_face_values.JxW(q);
+                    }
+            }// end if at boundary
+        }// end face
+
+        // local-to-global
+        cell->get_dof_indices (local_dof_indices);
+        ElasticBase<dim>::constraints.distribute_local_to_global(cell_matrix, cell_rhs,
+                                                                 local_dof_indices,
+                                                                 ElasticBase<dim>::system_matrix,
+                                                                 ElasticBase<dim>::system_rhs);
+    } // end cell
+}
+
+/**
+ * Setup the AMG of the displacement operator
+ */
+template <int dim>
+void
+Elastic::ElasticDisplacement<dim>::setup_AMG ()
+{
+    A_preconditioner
+            = std_cxx1x::shared_ptr<TrilinosWrappers::PreconditionAMG>(new TrilinosWrappers::PreconditionAMG());
+
+    Threads::TaskGroup<void> tasks;
+    ElasticBase<dim>::setup_displacement_AMG (tasks, *A_preconditioner,
+                                              ElasticBase<dim>::system_matrix.block(0,0), "A_displacement");
+    tasks.join_all ();
+
+    ElasticBase<dim>::amg_memory = A_preconditioner->memory_consumption();
+}
+
+template <int dim>
+void
+Elastic::ElasticDisplacement<dim>::solve ()
+{
+    parameters *par = ElasticBase<dim>::par;
+    const TrilinosWrappers::SparseMatrix &A = ElasticBase<dim>::system_matrix.block(0,0);
+
+    SolverControl solver_control (A.m(),
+                                  par->TOL*ElasticBase<dim>::system_rhs.block(0).l2_norm());
+#ifdef LOGRUN
+    solver_control.enable_history_data();
+    solver_control.log_history(true);
+    solver_control.log_result(true);
+    deallog.push("Displacement");
+#endif
+
+    if(!par->adv_enabled && !par->div_enabled){
+        SolverCG<TrilinosWrappers::Vector> solver (solver_control);
+        solver.solve (A, ElasticBase<dim>::solution.block(0),
+                      ElasticBase<dim>::system_rhs.block(0), *A_preconditioner);
+    }else{
+        SolverGMRES<TrilinosWrappers::Vector>
+                solver (solver_control,
+                        SolverGMRES<TrilinosWrappers::Vector >::AdditionalData(100));
+        solver.solve (A, ElasticBase<dim>::solution.block(0),
+                      ElasticBase<dim>::system_rhs.block(0), *A_preconditioner);
+    }
+#ifdef LOGRUN
+    deallog.pop();
+#endif
+
+    par->system_iter = solver_control.last_step();
+
+    ElasticBase<dim>::timer.enter_section("Pressure recovery");
+    recover_pressure ();
+    ElasticBase<dim>::timer.exit_section("Pressure recovery");
+
+    ElasticBase<dim>::constraints.distribute (ElasticBase<dim>::solution);
+}
+
+/**
+ * The pressure block holds -C = -beta*M_p, Jacobi makes it a
+ * well conditioned mass matrix solve.
+ */
+template <int dim>
+void
+Elastic::ElasticDisplacement<dim>::recover_pressure ()
+{
+    const TrilinosWrappers::BlockSparseMatrix &M = ElasticBase<dim>::system_matrix;
+    TrilinosWrappers::BlockVector &solution = ElasticBase<dim>::solution;
+
+    // -C p = g - B u
+    TrilinosWrappers::Vector tmp (M.block(1,1).m());
+    M.block(1,0).residual (tmp, solution.block(0), ElasticBase<dim>::system_rhs.block(1));
+
+    TrilinosWrappers::PreconditionJacobi jacobi;
+    jacobi.initialize (M.block(1,1));
+
+    SolverControl solver_control (tmp.size(), ElasticBase<dim>::par->TOL*tmp.l2_norm());
+    SolverGMRES<TrilinosWrappers::Vector> solver (solver_control);
+    solver.solve (M.block(1,1), solution.block(1), tmp, jacobi);
+}
+
+#endif // ELASTIC_DISPLACEMENT_H
@@ -0,0 +1,329 @@
+/* TODO
+
+ */
+
+#ifndef ELASTIC_MG_H
+#define ELASTIC_MG_H
+
+#include <deal.II/base/quadrature_lib.h>
+#include <deal.II/base/timer.h>
+#include <deal.II/dofs/dof_accessor.h>
+#include <deal.II/dofs/dof_handler.h>
+#include <deal.II/dofs/dof_tools.h>
+#include <deal.II/fe/fe_system.h>
+#include <deal.II/fe/fe_values.h>
+#include <deal.II/lac/compressed_sparsity_pattern.h>
+#include <deal.II/lac/full_matrix.h>
+#include <deal.II/lac/relaxation_block.h>
+#include <deal.II/lac/sparse_matrix.h>
+#include <deal.II/lac/sparsity_pattern.h>
+#include <deal.II/lac/trilinos_block_vector.h>
+#include <deal.II/lac/vector.h>
+#include <deal.II/multigrid/mg_coarse.h>
+#include <deal.II/multigrid/mg_constrained_dofs.h>
+#include <deal.II/multigrid/mg_matrix.h>
+#include <deal.II/multigrid/mg_smoother.h>
+#include <deal.II/multigrid/mg_tools.h>
+#include <deal.II/multigrid/mg_transfer.h>
+#include <deal.II/multigrid/multigrid.h>
+
+#include <set>
+#include <vector>
+
+#include "elastic_base.h"
+#include "coefficient.h"
+#include "parameters.h"
+
+using namespace std;
+using namespace dealii;
+namespace Elastic
+{
+/*!
+ * Applies a multigrid preconditioner of the global dof vector to the
+ * block vectors of the outer solver. The blocks are the component wise
+ * numbered global vector, so the conversion is a plain copy.
+ */
+template <class PreconditionerType>
+class MonolithicPreconditioner : public Subscriptor
+{
+public:
+    MonolithicPreconditioner (const PreconditionerType &_preconditioner,
+                              const ConstraintMatrix   &_constraints,
+                              const unsigned int       n);
+
+    void vmult (TrilinosWrappers::BlockVector       &dst,
+                const TrilinosWrappers::BlockVector &src) const;
+
+private:
+    const PreconditionerType &preconditioner;
+    const ConstraintMatrix   &constraints;
+    mutable Vector<double>   in, out;
+};
+
+/*!
+ * Mixed system preconditioned with one V-cycle of a monolithic
+ * geometric multigrid per outer FGMRES iteration. The levels are the
+ * refine_global hierarchy, every level matrix is assembled like the
+ * system matrix. The smoother is a multiplicative Vanka smoother, the
+ * blocks are all displacement and pressure dofs of one cell, inverted
+ * with SVD since the local saddle point blocks may be singular.
+ */
+template <int dim>
+class ElasticMG : public ElasticBase<dim> {
+public:
+    ElasticMG (parameters *_par, const unsigned int degree, const int _info,
+               std::ostream &out = std::cout);
+
+private:
+    // Setup the multigrid hierarchy
+    virtual void setup_AMG ();
+    // Solve the system
+    virtual void solve ();
+
+    // Assemble the level matrices, Dirichlet rows are decoupled
+    void assemble_multigrid ();
+
+    typedef SparseMatrix<double>						LevelMatrix;
+    typedef RelaxationBlockSSOR<LevelMatrix, double>	Smoother;
+    typedef MGTransferPrebuilt<Vector<double> >			Transfer;
+    typedef PreconditionMG<dim, Vector<double>, Transfer> Preconditioner;
+
+    MGLevelObject<SparsityPattern>		mg_sparsity;
+    MGLevelObject<LevelMatrix>			mg_matrices;
+    // Cell patches of the Vanka smoother
+    MGLevelObject<SparsityPattern>		mg_patches;
+    // Dirichlet dofs on every level, for the level matrices and the transfer
+    MGConstrainedDoFs					mg_constrained_dofs;
+    FullMatrix<double>					coarse_matrix;
+
+    std_cxx1x::shared_ptr<Transfer>											transfer;
+    std_cxx1x::shared_ptr<MGCoarseGridHouseholder<double, Vector<double> > >	coarse;
+    std_cxx1x::shared_ptr<MGSmootherRelaxation<LevelMatrix, Smoother, Vector<double> > > smoother;
+    std_cxx1x::shared_ptr<MGMatrix<LevelMatrix, Vector<double> > >			level_matrix;
+    std_cxx1x::shared_ptr<Multigrid<Vector<double> > >						mg;
+    std_cxx1x::shared_ptr<Preconditioner>									mg_preconditioner;
+};
+}
+
+/*
+ ------------- IMPLEMENTATION --------------
+ */
+template <class PreconditionerType>
+Elastic::MonolithicPreconditioner<PreconditionerType>::
+MonolithicPreconditioner (const PreconditionerType &_preconditioner,
+                          const ConstraintMatrix   &_constraints,
+                          const unsigned int       n)
+    :
+      preconditioner  (_preconditioner),
+      constraints     (_constraints),
+      in              (n),
+      out             (n)
+{}
+
+template <class PreconditionerType>
+void
+Elastic::MonolithicPreconditioner<PreconditionerType>::
+vmult (TrilinosWrappers::BlockVector       &dst,
+       const TrilinosWrappers::BlockVector &src) const
+{
+    unsigned int k = 0;
+    for(unsigned int b = 0; b < src.n_blocks(); ++b)
+        for(unsigned int i = 0; i < src.block(b).size(); ++i, ++k)
+            in(k) = src.block(b)(i);
+
+    preconditioner.vmult (out, in);
+    constraints.set_zero (out);
+
+    k = 0;
+    for(unsigned int b = 0; b < dst.n_blocks(); ++b)
+        for(unsigned int i = 0; i < dst.block(b).size(); ++i, ++k)
+            dst.block(b)(i) = out(k);
+}
+
+template <int dim>
+Elastic::ElasticMG<dim>::ElasticMG (parameters *_par, const unsigned int degree, const int _info,
+                                     std::ostream &out)
+    : Elastic::ElasticBase<dim>(_par, degree, _info, 2, out){}
+
+/**
+ * Level dofs, level matrices, transfer, Vanka smoother and
+ * the direct coarse solver.
+ */
+template <int dim>
+void
+Elastic::ElasticMG<dim>::setup_AMG ()
+{
+    DoFHandler<dim> &dof_handler = ElasticBase<dim>::dof_handler;
+    parameters      *par         = ElasticBase<dim>::par;
+
+    dof_handler.distribute_mg_dofs (ElasticBase<dim>::fe);
+    const unsigned int n_levels = ElasticBase<dim>::triangulation.n_levels();
+
+    // Same boundary conditions as the constraints of the system
+    {
+        std::vector<bool> ns_mask (dim+1, true); // NO_SLIP
+        std::vector<bool> vs_mask (dim+1, false); // V_SLIP
+        ns_mask[dim] = false;
+        vs_mask[0] = true;
+
+        ZeroFunction<dim> zero (dim+1);
+        typename FunctionMap<dim>::type no_slip, v_slip;
+        no_slip[bFlags::NO_SLIP] = &zero;
+        v_slip[bFlags::V_SLIP] = &zero;
+
+        mg_constrained_dofs.clear ();
+        mg_constrained_dofs.initialize (dof_handler, no_slip, ComponentMask(ns_mask));
+
+        // initialize takes a single component mask, the V_SLIP dofs are
+        // added to the boundary indices it owns
+        std::vector<std::set<types::global_dof_index> > v_slip_indices (n_levels);
+        MGTools::make_boundary_list (dof_handler, v_slip, v_slip_indices, ComponentMask(vs_mask));
+        std::vector<std::set<types::global_dof_index> > &boundary_indices
+                = const_cast<std::vector<std::set<types::global_dof_index> > &>
+                (mg_constrained_dofs.get_boundary_indices());
+        for(unsigned int level=0; level<n_levels; ++level)
+            boundary_indices[level].insert (v_slip_indices[level].begin(), v_slip_indices[level].end());
+    }
+
+    mg_matrices.resize (0, n_levels-1);
+    mg_sparsity.resize (0, n_levels-1);
+    mg_patches.resize (0, n_levels-1);
+
+    for(unsigned int level=0; level<n_levels; ++level){
+        CompressedSparsityPattern csp (dof_handler.n_dofs(level),
+                                       dof_handler.n_dofs(level));
+        MGTools::make_sparsity_pattern (dof_handler, csp, level);
+        mg_sparsity[level].copy_from (csp);
+        mg_matrices[level].reinit (mg_sparsity[level]);
+    }
+
+    assemble_multigrid ();
+
+    // Prolongation without the Dirichlet dofs of the finer level
+    transfer = std_cxx1x::shared_ptr<Transfer>(new Transfer (ElasticBase<dim>::constraints,
+                                                             mg_constrained_dofs));
+    transfer->build_matrices (dof_handler);
+
+    coarse_matrix.copy_from (mg_matrices[0]);
+    coarse = std_cxx1x::shared_ptr<MGCoarseGridHouseholder<double, Vector<double> > >
+            (new MGCoarseGridHouseholder<double, Vector<double> >);
+    coarse->initialize (coarse_matrix);
+
+    MGLevelObject<typename Smoother::AdditionalData> smoother_data (0, n_levels-1);
+    for(unsigned int level=0; level<n_levels; ++level){
+        DoFTools::make_cell_patches (mg_patches[level], dof_handler, level);
+        smoother_data[level] = typename Smoother::AdditionalData (mg_patches[level], par->mg_relaxation);
+        smoother_data[level].inversion = PreconditionBlockBase<double>::svd;
+    }
+
+    smoother = std_cxx1x::shared_ptr<MGSmootherRelaxation<LevelMatrix, Smoother, Vector<double> > >
+            (new MGSmootherRelaxation<LevelMatrix, Smoother, Vector<double> >);
+    smoother->initialize (mg_matrices, smoother_data);
+    smoother->set_steps (par->mg_smoothing_steps);
+
+    level_matrix = std_cxx1x::shared_ptr<MGMatrix<LevelMatrix, Vector<double> > >
+            (new MGMatrix<LevelMatrix, Vector<double> >(&mg_matrices));
+
+    mg = std_cxx1x::shared_ptr<Multigrid<Vector<double> > >
+            (new Multigrid<Vector<double> >(dof_handler, *level_matrix, *coarse,
+                                            *transfer, *smoother, *smoother));
+
+    mg_preconditioner = std_cxx1x::shared_ptr<Preconditioner>
+            (new Preconditioner (dof_handler, *mg, *transfer));
+
+    std::size_t memory = transfer->memory_consumption()
+            + coarse_matrix.memory_consumption();
+    for(unsigned int level=0; level<n_levels; ++level)
+        memory += mg_matrices[level].memory_consumption()
+                + mg_sparsity[level].memory_consumption()
+                + mg_patches[level].memory_consumption();
+    ElasticBase<dim>::amg_memory = memory;
+}
+
+/**
+ * Level matrices of the full system, the cell matrix is the one of
+ * ElasticBase::add_cell_matrix. Dirichlet rows and columns are
+ * zeroed cell by cell, only their diagonal is kept.
+ */
+template <int dim>
+void
+Elastic::ElasticMG<dim>::assemble_multigrid ()
+{
+    const FESystem<dim> &fe  = ElasticBase<dim>::fe;
+    parameters          *par = ElasticBase<dim>::par;
+
+    QGauss<dim>   quadrature_formula(ElasticBase<dim>::degree+2);
+
+    FEValues<dim> fe_values (fe, quadrature_formula,
+                             update_values    |
+                             update_quadrature_points  |
+                             update_JxW_values |
+                             update_gradients);
+
+    const unsigned int   dofs_per_cell   = fe.dofs_per_cell;
+    const unsigned int   n_q_points      = quadrature_formula.size();
+
+    FullMatrix<double>   cell_matrix (dofs_per_cell, dofs_per_cell);
+    std::vector<types::global_dof_index> local_dof_indices (dofs_per_cell);
+
+    Coefficients<dim> 				  	 coeff(par->YOUNG,par->POISSON);
+    std::vector<double>     		  	 mu_values (n_q_points);
+    std::vector<double>     		  	 beta_values (n_q_points);	// mu^2/alpha
+
+    typename ElasticBase<dim>::CellShapes shapes (dofs_per_cell);
+
+    typename DoFHandler<dim>::level_cell_iterator
+            cell = ElasticBase<dim>::dof_handler.begin_mg(),
+            endc = ElasticBase<dim>::dof_handler.end_mg();
+    for (; cell!=endc; ++cell)
+    {
+        const unsigned int level = cell->level();
+
+        fe_values.reinit (cell);
+        cell_matrix		= 0;
+
+        coeff.mu_value_list     (fe_values.get_quadrature_points(), mu_values);
+        coeff.beta_value_list   (fe_values.get_quadrature_points(), beta_values);
+
+        for (unsigned int q=0; q<n_q_points; ++q)
+        {
+            shapes.reinit (fe_values, q);
+            ElasticBase<dim>::add_cell_matrix (shapes, mu_values[q], beta_values[q],
+                                               fe_values.JxW(q), false, cell_matrix);
+        } // end q
+
+        cell->get_mg_dof_indices (local_dof_indices);
+
+        // Dirichlet dofs
+        for (unsigned int i=0; i<dofs_per_cell; ++i)
+            if (mg_constrained_dofs.is_boundary_index (level, local_dof_indices[i]))
+                for (unsigned int j=0; j<dofs_per_cell; ++j)
+                    if (i != j){
+                        cell_matrix(i,j) = 0;
+                        cell_matrix(j,i) = 0;
+                    }
+
+        for (unsigned int i=0; i<dofs_per_cell; ++i)
+            for (unsigned int j=0; j<dofs_per_cell; ++j)
+                mg_matrices[level].add (local_dof_indices[i], local_dof_indices[j],
+                                        cell_matrix(i,j));
+    } // end cell
+}
+
+template <int dim>
+void
+Elastic::ElasticMG<dim>::solve ()
+{
+    OuterSolverControl solver_control (ElasticBase<dim>::par,
+                                       ElasticBase<dim>::system_matrix.m(),
+                                       ElasticBase<dim>::par->TOL*ElasticBase<dim>::system_rhs.l2_norm());
+
+    const MonolithicPreconditioner<Preconditioner>
+            preconditioner (*mg_preconditioner,
+                            ElasticBase<dim>::constraints,
+                            ElasticBase<dim>::system_matrix.m());
+
+    ElasticBase<dim>::outer_solve (preconditioner, solver_control);
+}
+
+#endif // ELASTIC_MG_H
@@ -23,7 +23,7 @@ namespace Elastic
 	class ExactSolution : public Function<dim>
 	{
     public:
-        ExactSolution () : Function<dim>(dim+1) {par = parameters::getInstance();}
+        ExactSolution (parameters *_par) : Function<dim>(dim+1), par(_par) {}
 		
 		virtual void vector_value (const Point<dim> &p,
 								   Vector<double>   &value) const;
@@ -47,24 +47,25 @@ Elastic::ExactSolution<dim>::vector_value (const Point<dim> &p, Vector<double>
 
 
     const double yb = par->y1*L; // scaled bottom
-    const double x  = p[0]*L;
-    const double y  = p[1]*L;
+    const double y  = p[dim-1]*L; // vertical coordinate
     const double A  = par->delta * g0 * par->rho_i * par->h;
     const double p0 = gamma * par->rho_i * g0 * par->h;
 
-        values(0) = 0;
+        // horizontal displacements
+        for (unsigned int c = 0; c < dim-1; ++c)
+            values(c) = 0;
         if(par->adv_enabled){
             if(par->div_enabled){ // adv = 1, div = 1, complete
-                values(1) = A*(yb-y);
-                values(2) = -p0 * L;
+                values(dim-1) = A*(yb-y);
+                values(dim) = -p0 * L;
             }
             else{				// adv = 1, div = 0, pre-stress of adv
-                values(1) =  alpha * (exp(rho_r * g0 * delta * yb) - exp(rho_r * g0 * delta *y));
-                values(2) = -p0 * exp(rho_r * g0 * delta * y) * L;
+                values(dim-1) =  alpha * (exp(rho_r * g0 * delta * yb) - exp(rho_r * g0 * delta *y));
+                values(dim) = -p0 * exp(rho_r * g0 * delta * y) * L;
             }
         }else{					// adv = 0, div = 0, simple case
-            values(1) = A*(yb-y);
-            values(2) = -p0 * L;
+            values(dim-1) = A*(yb-y);
+            values(dim) = -p0 * L;
         }
 }
 // end Exact solution
@@ -0,0 +1,1390 @@
+/*! TODO
+ */
+
+#ifndef HMATRIX_H
+#define HMATRIX_H
+
+#include <deal.II/base/point.h>
+#include <deal.II/lac/full_matrix.h>
+#include <deal.II/lac/solver_control.h>
+#include <deal.II/lac/solver_gmres.h>
+#include <deal.II/lac/trilinos_block_sparse_matrix.h>
+#include <deal.II/lac/trilinos_sparse_matrix.h>
+#include <deal.II/lac/trilinos_vector.h>
+#include <deal.II/lac/vector.h>
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <vector>
+
+#include "parameters.h"
+
+using namespace std;
+using namespace dealii;
+namespace Elastic
+{
+
+/*!
+ * Entries of the Schur complement S = C - B A^{-1} Bt, one A solve per
+ * column. Only the requested rows of a column are returned, the full
+ * column is a scratch vector until the next solve. S is symmetric, so
+ * a column is also the row with the same index.
+ */
+template <class PreconditionerA>
+class SchurColumns
+{
+public:
+    SchurColumns (const TrilinosWrappers::BlockSparseMatrix &_M,
+                  const PreconditionerA                     &_Apreconditioner,
+                  const double                              _tol);
+
+    // entries(i) = S(rows[i], j) for the rows in [begin, end)
+    void column (const unsigned int                        j,
+                 std::vector<unsigned int>::const_iterator begin,
+                 std::vector<unsigned int>::const_iterator end,
+                 Vector<double>                            &entries);
+
+    // S times the sum of the unit vectors of js, with a single A solve
+    void probe (const std::vector<unsigned int> &js, Vector<double> &result);
+
+    unsigned int n_solves () const;
+    unsigned int n_unconverged () const;
+
+private:
+    // tmp = S unit
+    void apply ();
+
+    const TrilinosWrappers::BlockSparseMatrix	*M;
+    const PreconditionerA						*Apreconditioner;
+    const double								tol;
+
+    SolverControl							control;
+    SolverGMRES<TrilinosWrappers::Vector>	solver;
+    TrilinosWrappers::Vector				unit, rhs, x, tmp;
+
+    unsigned int							solves, unconverged;
+};
+
+/*!
+ * Hierarchical matrix approximation of the Schur complement
+ * S = C - B A^{-1} Bt of the 2 block system.
+ * The pressure dofs are ordered along a binary cluster tree, built by
+ * recursive bisection of their support points down to clusters of at
+ * most par->hmatrix_leaf dofs, all leaves on the same level. The block
+ * tree splits a pair of clusters into the pairs of their children
+ * until the pair is well separated (min(diam) <= eta*dist), these
+ * blocks are compressed with adaptive cross approximation to
+ * par->hmatrix_tol, or until both are leaves, these blocks are dense.
+ * This gives O(n log n) blocks. The system has to be symmetric.
+ * vmult applies the inverse through a recursive H-LU factorization,
+ * the low-rank updates are truncated to the same tolerance.
+ */
+template <int dim>
+class HMatrixSchur : public Subscriptor
+{
+public:
+    HMatrixSchur (parameters *_par);
+
+    /*!
+     * Approximate S on the clusters of points without forming it.
+     * Low-rank blocks use partially pivoted ACA, one A solve per
+     * pivot. Dense blocks are probed, leaf clusters with disjoint dense
+     * neighbourhoods share their A solves and the low-rank part of
+     * the probe is subtracted.
+     */
+    template <class PreconditionerA>
+    void build (const TrilinosWrappers::BlockSparseMatrix &M,
+                const PreconditionerA                     &Apreconditioner,
+                const std::vector<Point<dim> >            &points);
+
+    // H-LU in place
+    void factorize ();
+
+    // dst = S^{-1} src with the H-LU
+    void vmult (TrilinosWrappers::Vector       &dst,
+                const TrilinosWrappers::Vector &src) const;
+
+    std::size_t memory_consumption () const;
+
+    // Number of low-rank blocks and their largest rank
+    unsigned int n_low_rank () const;
+    unsigned int max_rank () const;
+
+    // A solves of the last build and how many of them did not converge
+    unsigned int n_solves () const;
+    unsigned int n_unconverged () const;
+
+    // Largest number of bytes of S entries held at once by the build
+    std::size_t peak_storage () const;
+
+private:
+    struct Block
+    {
+        Block () : low_rank (false), m (0), n (0) {}
+
+        // dense is used when low_rank is false, otherwise U V^T
+        bool				low_rank;
+        unsigned int		m, n;
+        FullMatrix<double>	dense, U, V;
+    };
+
+    // Cluster of the dofs order[first] ... order[first+size-1]
+    struct Cluster
+    {
+        unsigned int	first, size;
+        // -1 for leaves
+        int				child[2];
+        Point<dim>		lower, upper;
+    };
+
+    // Block of the clusters (row,col), either a leaf with data or
+    // split into the blocks of the children, (i,j) at child[2*i+j]
+    struct Node
+    {
+        unsigned int	row, col;
+        int				child[4];
+        Block			data;
+    };
+
+    // Rows and columns of the block of S on two clusters
+    template <class PreconditionerA>
+    struct SchurEntries
+    {
+        SchurEntries (SchurColumns<PreconditionerA> &_S, const std::vector<unsigned int> &_order,
+                      const Cluster &_tau, const Cluster &_sigma)
+            : S(_S), order(_order), tau(_tau), sigma(_sigma) {}
+
+        void row (const unsigned int i, Vector<double> &v)
+        {
+            S.column (order[tau.first+i], order.begin()+sigma.first,
+                      order.begin()+sigma.first+sigma.size, v);
+        }
+        void column (const unsigned int j, Vector<double> &u)
+        {
+            S.column (order[sigma.first+j], order.begin()+tau.first,
+                      order.begin()+tau.first+tau.size, u);
+        }
+
+        SchurColumns<PreconditionerA>	&S;
+        const std::vector<unsigned int>	&order;
+        const Cluster					&tau, &sigma;
+    };
+
+    // Rows and columns of the product of the nodes a and b
+    struct ProductEntries
+    {
+        ProductEntries (const HMatrixSchur<dim> &_H, const unsigned int _a, const unsigned int _b,
+                        const unsigned int _m, const unsigned int _k, const unsigned int _n)
+            : H(_H), a(_a), b(_b), m(_m), k(_k), n(_n) {}
+
+        void row (const unsigned int i, Vector<double> &v)
+        {
+            Vector<double> unit (m), w (k);
+            unit(i) = 1.0;
+            v.reinit (n);
+            H.hvmult (a, 1.0, unit.begin(), w.begin(), true);
+            H.hvmult (b, 1.0, w.begin(), v.begin(), true);
+        }
+        void column (const unsigned int j, Vector<double> &u)
+        {
+            Vector<double> unit (n), w (k);
+            unit(j) = 1.0;
+            u.reinit (m);
+            H.hvmult (b, 1.0, unit.begin(), w.begin(), false);
+            H.hvmult (a, 1.0, w.begin(), u.begin(), false);
+        }
+
+        const HMatrixSchur<dim>	&H;
+        const unsigned int		a, b, m, k, n;
+    };
+
+    // Recursive bisection along the longest side of the bounding box,
+    // depth levels below this cluster. Returns the cluster.
+    unsigned int cluster (const unsigned int first, const unsigned int size,
+                          const unsigned int depth, const std::vector<Point<dim> > &points);
+
+    bool admissible (const unsigned int t, const unsigned int s) const;
+
+    // Block tree below the clusters (t,s), returns the node
+    template <class PreconditionerA>
+    unsigned int build_node (const unsigned int t, const unsigned int s,
+                             SchurColumns<PreconditionerA>                          &S,
+                             std::map<std::pair<unsigned int, unsigned int>, unsigned int> &built);
+
+    // Partially pivoted ACA, false if the rank exceeds max_rank
+    template <class Entries>
+    bool partial_aca (Entries &entries, const unsigned int m, const unsigned int n,
+                      const unsigned int max_rank, Block &block);
+
+    // Leaf clusters sharing a color have no dense block row in common
+    void color_clusters (std::vector<std::vector<unsigned int> > &colors) const;
+
+    // Entry (i,j) of a block in either storage
+    double entry (const Block &block, const unsigned int i, const unsigned int j) const;
+
+    // Entry of the dofs at positions pi, pj of order
+    double entry (const unsigned int pi, const unsigned int pj) const;
+
+    void set_low_rank (const std::vector<Vector<double> > &us,
+                       const std::vector<Vector<double> > &vs,
+                       Block                              &block) const;
+
+    void transpose (const Block &block, Block &result) const;
+
+    // ACA with full pivoting of R, dense if the rank does not pay off
+    void compress (FullMatrix<double> &R, Block &block, const bool low_rank) const;
+
+    // Recompress U V^T through QR factors of U and V
+    void truncate (Block &block) const;
+
+    // A = Q R with orthonormal columns of Q, dependent columns dropped
+    void orthonormalize (const FullMatrix<double> &A, FullMatrix<double> &Q,
+                         FullMatrix<double> &R) const;
+
+    void to_dense (const Block &block, FullMatrix<double> &R) const;
+
+    // y += a*H x of node, or with H^T, x and y start at the cluster
+    void hvmult (const unsigned int node, const double a, const double *x, double *y,
+                 const bool transposed) const;
+
+    // x = L^{-1} x, x = U^{-1} x and x = U^{-T} x of the diagonal node
+    void solve_lower (const unsigned int node, double *x) const;
+    void solve_upper (const unsigned int node, double *x) const;
+    void solve_upper_transposed (const unsigned int node, double *x) const;
+
+    // H-LU of the diagonal node
+    void lu (const unsigned int node);
+
+    // X = L^{-1} X with the diagonal node l
+    void solve_lower_left (const unsigned int l, const unsigned int x);
+
+    // X = X U^{-1} with the diagonal node u
+    void solve_upper_right (const unsigned int x, const unsigned int u);
+
+    // X -= A B
+    void add_product (const unsigned int x, const unsigned int a, const unsigned int b);
+
+    // P = A B as a single block
+    void product (const unsigned int a, const unsigned int b, Block &P);
+
+    // X -= P, X starts at row_offset, col_offset of P
+    void subtract_block (const unsigned int x, const Block &P,
+                         const unsigned int row_offset, const unsigned int col_offset);
+
+    unsigned int leaf_size () const;
+
+    // pointer to parameter object
+    parameters *par;
+
+    // Dofs in cluster order
+    std::vector<unsigned int>				order;
+    std::vector<Cluster>					clusters;
+    // Block tree, the root is node 0
+    std::vector<Node>						nodes;
+    // Dense leaves of every column cluster
+    std::vector<std::vector<unsigned int> >	near;
+
+    unsigned int							solves, unconverged;
+    std::size_t								peak;
+};
+}
+
+/*
+     ------------- IMPLEMENTATION --------------
+*/
+template <class PreconditionerA>
+Elastic::SchurColumns<PreconditionerA>::SchurColumns (const TrilinosWrappers::BlockSparseMatrix &_M,
+                                                      const PreconditionerA                     &_Apreconditioner,
+                                                      const double                              _tol)
+    :
+      M               (&_M),
+      Apreconditioner (&_Apreconditioner),
+      tol             (_tol),
+      control         (_M.block(0,0).m(), 1.0, false, false),
+      solver          (control),
+      unit            (_M.block(1,1).m()),
+      rhs             (_M.block(0,0).m()),
+      x               (_M.block(0,0).m()),
+      tmp             (_M.block(1,1).m()),
+      solves          (0),
+      unconverged     (0)
+{}
+
+template <class PreconditionerA>
+void
+Elastic::SchurColumns<PreconditionerA>::column (const unsigned int                        j,
+                                                std::vector<unsigned int>::const_iterator begin,
+                                                std::vector<unsigned int>::const_iterator end,
+                                                Vector<double>                            &entries)
+{
+    unit = 0;
+    unit(j) = 1.0;
+    apply ();
+
+    entries.reinit (end - begin);
+    for (unsigned int i = 0; begin != end; ++begin, ++i)
+        entries(i) = tmp(*begin);
+}
+
+template <class PreconditionerA>
+void
+Elastic::SchurColumns<PreconditionerA>::probe (const std::vector<unsigned int> &js,
+                                               Vector<double>                  &result)
+{
+    unit = 0;
+    for (unsigned int k = 0; k < js.size(); ++k)
+        unit(js[k]) = 1.0;
+    apply ();
+
+    result.reinit (tmp.size());
+    for (unsigned int i = 0; i < tmp.size(); ++i)
+        result(i) = tmp(i);
+}
+
+template <class PreconditionerA>
+unsigned int
+Elastic::SchurColumns<PreconditionerA>::n_solves () const
+{
+    return solves;
+}
+
+template <class PreconditionerA>
+unsigned int
+Elastic::SchurColumns<PreconditionerA>::n_unconverged () const
+{
+    return unconverged;
+}
+
+template <class PreconditionerA>
+void
+Elastic::SchurColumns<PreconditionerA>::apply ()
+{
+    M->block(0,1).vmult (rhs, unit);
+
+    x = 0;
+    if (rhs.l2_norm() > 0){
+        control.set_tolerance (tol*rhs.l2_norm());
+        ++solves;
+        try{
+            solver.solve (M->block(0,0), x, rhs, *Apreconditioner);
+        }catch (const SolverControl::NoConvergence &){
+            // The last iterate is used, the H-matrix is a preconditioner
+            ++unconverged;
+        }
+    }
+
+    M->block(1,0).vmult (tmp, x);
+    tmp *= -1.0;
+    M->block(1,1).vmult_add (tmp, unit);
+}
+
+template <int dim>
+Elastic::HMatrixSchur<dim>::HMatrixSchur (parameters *_par)
+    :
+      par         (_par),
+      solves      (0),
+      unconverged (0),
+      peak        (0)
+{}
+
+template <int dim>
+template <class PreconditionerA>
+void
+Elastic::HMatrixSchur<dim>::build (const TrilinosWrappers::BlockSparseMatrix &M,
+                                   const PreconditionerA                     &Apreconditioner,
+                                   const std::vector<Point<dim> >            &points)
+{
+    const unsigned int n_p = points.size();
+
+    order.resize (n_p);
+    for (unsigned int i = 0; i < n_p; ++i)
+        order[i] = i;
+
+    // All leaves on one level, so the pairs of the block tree split together
+    unsigned int depth = 0;
+    while ((n_p + (1u << depth) - 1) >> depth > leaf_size ())
+        ++depth;
+
+    clusters.clear ();
+    cluster (0, n_p, depth, points);
+
+    nodes.clear ();
+    near.clear ();
+    near.resize (clusters.size());
+    peak = 0;
+
+    SchurColumns<PreconditionerA> S (M, Apreconditioner, par->hmatrix_tol);
+    std::map<std::pair<unsigned int, unsigned int>, unsigned int> built;
+    build_node (0, 0, S, built);
+
+    // Probe the dense blocks, the k-th dof of every cluster of a color
+    // at once. Their dense rows are disjoint, the other clusters only
+    // add entries of low-rank blocks to them.
+    std::vector<std::vector<unsigned int> > colors;
+    color_clusters (colors);
+
+    Vector<double> probed;
+    peak = std::max (peak, n_p*sizeof(double));
+    for (unsigned int g = 0; g < colors.size(); ++g){
+        const std::vector<unsigned int> &color = colors[g];
+
+        unsigned int size = 0;
+        for (unsigned int l = 0; l < color.size(); ++l)
+            size = std::max (size, clusters[color[l]].size);
+
+        for (unsigned int k = 0; k < size; ++k){
+            std::vector<unsigned int> js;
+            for (unsigned int l = 0; l < color.size(); ++l)
+                if (k < clusters[color[l]].size)
+                    js.push_back (order[clusters[color[l]].first + k]);
+            S.probe (js, probed);
+
+            for (unsigned int l = 0; l < color.size(); ++l){
+                const unsigned int c = color[l];
+                if (k >= clusters[c].size)
+                    continue;
+
+                for (unsigned int d = 0; d < near[c].size(); ++d){
+                    const Cluster &tau = clusters[nodes[near[c][d]].row];
+                    Block &D = nodes[near[c][d]].data;
+                    for (unsigned int i = 0; i < tau.size; ++i){
+                        double value = probed(order[tau.first + i]);
+                        for (unsigned int o = 0; o < color.size(); ++o)
+                            if (o != l && k < clusters[color[o]].size)
+                                value -= entry (tau.first + i, clusters[color[o]].first + k);
+                        D.dense(i,k) = value;
+                    }
+                }
+            }
+        }
+    }
+
+    solves = S.n_solves();
+    unconverged = S.n_unconverged();
+}
+
+template <int dim>
+template <class PreconditionerA>
+unsigned int
+Elastic::HMatrixSchur<dim>::build_node (const unsigned int t, const unsigned int s,
+                                        SchurColumns<PreconditionerA>                          &S,
+                                        std::map<std::pair<unsigned int, unsigned int>, unsigned int> &built)
+{
+    const unsigned int id = nodes.size();
+    nodes.push_back (Node());
+    nodes[id].row = t;
+    nodes[id].col = s;
+    std::fill (nodes[id].child, nodes[id].child+4, -1);
+    built[std::make_pair (t,s)] = id;
+
+    const unsigned int m = clusters[t].size, n = clusters[s].size;
+
+    if (admissible (t,s)){
+        // S is symmetric, the mirrored block is transposed if it is low-rank
+        typename std::map<std::pair<unsigned int, unsigned int>, unsigned int>::const_iterator
+                mirror = built.find (std::make_pair (s,t));
+        if (mirror != built.end()){
+            const Node &other = nodes[mirror->second];
+            if (other.child[0] < 0 && other.data.low_rank){
+                transpose (other.data, nodes[id].data);
+                return id;
+            }
+        }else{
+            // The rank pays off only below m*n/(m+n)
+            const unsigned int max_rank = std::min (static_cast<unsigned int>(par->hmatrix_rank), m*n/(m+n));
+            SchurEntries<PreconditionerA> entries (S, order, clusters[t], clusters[s]);
+            Block block;
+            if (partial_aca (entries, m, n, max_rank, block)){
+                nodes[id].data = block;
+                return id;
+            }
+        }
+        // Split further if the rank does not pay off
+    }
+
+    if (clusters[t].child[0] < 0){
+        Block &D = nodes[id].data;
+        D.low_rank = false;
+        D.m = m;
+        D.n = n;
+        D.dense.reinit (m, n);
+        near[s].push_back (id);
+        return id;
+    }
+
+    for (unsigned int i = 0; i < 2; ++i)
+        for (unsigned int j = 0; j < 2; ++j){
+            const unsigned int c = build_node (clusters[t].child[i], clusters[s].child[j], S, built);
+            nodes[id].child[2*i+j] = c;
+        }
+    return id;
+}
+
+template <int dim>
+void
+Elastic::HMatrixSchur<dim>::factorize ()
+{
+    lu (0);
+}
+
+template <int dim>
+void
+Elastic::HMatrixSchur<dim>::vmult (TrilinosWrappers::Vector       &dst,
+                                   const TrilinosWrappers::Vector &src) const
+{
+    Vector<double> x (order.size());
+    for (unsigned int i = 0; i < order.size(); ++i)
+        x(i) = src(order[i]);
+
+    solve_lower (0, x.begin());
+    solve_upper (0, x.begin());
+
+    for (unsigned int i = 0; i < order.size(); ++i)
+        dst(order[i]) = x(i);
+}
+
+template <int dim>
+std::size_t
+Elastic::HMatrixSchur<dim>::memory_consumption () const
+{
+    std::size_t memory = order.size()*sizeof(unsigned int)
+            + clusters.size()*sizeof(Cluster);
+    for (unsigned int i = 0; i < nodes.size(); ++i)
+        memory += sizeof(Node)
+                + nodes[i].data.dense.memory_consumption()
+                + nodes[i].data.U.memory_consumption()
+                + nodes[i].data.V.memory_consumption();
+    return memory;
+}
+
+template <int dim>
+unsigned int
+Elastic::HMatrixSchur<dim>::n_low_rank () const
+{
+    unsigned int n = 0;
+    for (unsigned int i = 0; i < nodes.size(); ++i)
+        if (nodes[i].child[0] < 0 && nodes[i].data.low_rank)
+            ++n;
+    return n;
+}
+
+template <int dim>
+unsigned int
+Elastic::HMatrixSchur<dim>::max_rank () const
+{
+    unsigned int rank = 0;
+    for (unsigned int i = 0; i < nodes.size(); ++i)
+        if (nodes[i].child[0] < 0 && nodes[i].data.low_rank)
+            rank = std::max (rank, nodes[i].data.U.n());
+    return rank;
+}
+
+template <int dim>
+unsigned int
+Elastic::HMatrixSchur<dim>::n_solves () const
+{
+    return solves;
+}
+
+template <int dim>
+unsigned int
+Elastic::HMatrixSchur<dim>::n_unconverged () const
+{
+    return unconverged;
+}
+
+template <int dim>
+std::size_t
+Elastic::HMatrixSchur<dim>::peak_storage () const
+{
+    return peak;
+}
+
+template <int dim>
+unsigned int
+Elastic::HMatrixSchur<dim>::leaf_size () const
+{
+    // Both halves of a split cluster must not be empty
+    return std::max (par->hmatrix_leaf, 2);
+}
+
+template <int dim>
+unsigned int
+Elastic::HMatrixSchur<dim>::cluster (const unsigned int first, const unsigned int size,
+                                     const unsigned int depth, const std::vector<Point<dim> > &points)
+{
+    const unsigned int id = clusters.size();
+    clusters.push_back (Cluster());
+    clusters[id].first = first;
+    clusters[id].size = size;
+    clusters[id].child[0] = clusters[id].child[1] = -1;
+
+    Point<dim> lower = points[order[first]], upper = points[order[first]];
+    for (unsigned int i = first+1; i < first+size; ++i)
+        for (unsigned int d = 0; d < dim; ++d){
+            lower[d] = std::min (lower[d], points[order[i]][d]);
+            upper[d] = std::max (upper[d], points[order[i]][d]);
+        }
+    clusters[id].lower = lower;
+    clusters[id].upper = upper;
+
+    if (depth == 0)
+        return id;
+
+    unsigned int axis = 0;
+    for (unsigned int d = 1; d < dim; ++d)
+        if (upper[d] - lower[d] > upper[axis] - lower[axis])
+            axis = d;
+
+    // Median split keeps the clusters balanced
+    const unsigned int half = size/2;
+    std::vector<std::pair<double, unsigned int> > keys (size);
+    for (unsigned int i = 0; i < size; ++i)
+        keys[i] = std::make_pair (points[order[first+i]][axis], order[first+i]);
+    std::nth_element (keys.begin(), keys.begin()+half, keys.end());
+    for (unsigned int i = 0; i < size; ++i)
+        order[first+i] = keys[i].second;
+
+    const unsigned int left = cluster (first, half, depth-1, points);
+    const unsigned int right = cluster (first+half, size-half, depth-1, points);
+    clusters[id].child[0] = left;
+    clusters[id].child[1] = right;
+    return id;
+}
+
+template <int dim>
+bool
+Elastic::HMatrixSchur<dim>::admissible (const unsigned int t, const unsigned int s) const
+{
+    if (t == s)
+        return false;
+
+    const Cluster &a = clusters[t], &b = clusters[s];
+    double dist = 0;
+    for (unsigned int d = 0; d < dim; ++d){
+        const double gap = std::max (0.0, std::max (a.lower[d] - b.upper[d],
+                                                    b.lower[d] - a.upper[d]));
+        dist += gap*gap;
+    }
+
+    const double diam = std::min (a.upper.distance(a.lower),
+                                  b.upper.distance(b.lower));
+    return diam <= par->hmatrix_eta*std::sqrt(dist);
+}
+
+/**
+ * Cross approximation with full pivoting, R is overwritten with the
+ * remainder. Stops when the pivot drops below tol times the first one.
+ */
+template <int dim>
+void
+Elastic::HMatrixSchur<dim>::compress (FullMatrix<double> &R, Block &block, const bool low_rank) const
+{
+    const unsigned int m = R.m(), n = R.n();
+
+    block.low_rank = false;
+    block.m = m;
+    block.n = n;
+    block.U.reinit (0, 0);
+    block.V.reinit (0, 0);
+    if (!low_rank || m == 0 || n == 0){
+        block.dense = R;
+        return;
+    }
+
+    const FullMatrix<double> original (R);
+    std::vector<Vector<double> > us, vs;
+    double first = 0;
+    bool converged = false;
+    // The rank pays off only below m*n/(m+n)
+    const unsigned int max_rank = std::min (static_cast<unsigned int>(par->hmatrix_rank), m*n/(m+n));
+
+    while (us.size() <= max_rank){
+        unsigned int pi = 0, pj = 0;
+        double pivot = 0;
+        for (unsigned int i = 0; i < m; ++i)
+            for (unsigned int j = 0; j < n; ++j)
+                if (std::fabs(R(i,j)) > std::fabs(pivot)){
+                    pivot = R(i,j);
+                    pi = i;
+                    pj = j;
+                }
+
+        if (us.empty())
+            first = std::fabs(pivot);
+        if (std::fabs(pivot) <= par->hmatrix_tol*first){
+            converged = true;
+            break;
+        }
+        if (us.size() == max_rank)
+            break;
+
+        Vector<double> u (m), v (n);
+        for (unsigned int i = 0; i < m; ++i)
+            u(i) = R(i,pj);
+        for (unsigned int j = 0; j < n; ++j)
+            v(j) = R(pi,j)/pivot;
+
+        for (unsigned int i = 0; i < m; ++i)
+            for (unsigned int j = 0; j < n; ++j)
+                R(i,j) -= u(i)*v(j);
+
+        us.push_back (u);
+        vs.push_back (v);
+    }
+
+    if (!converged){
+        block.dense = original;
+        return;
+    }
+
+    set_low_rank (us, vs, block);
+}
+
+/**
+ * U V^T = Q_u (R_u R_v^T) Q_v^T, the small core is compressed with
+ * full pivoting to the relative tolerance. Dense when the new rank
+ * does not pay off.
+ */
+template <int dim>
+void
+Elastic::HMatrixSchur<dim>::truncate (Block &block) const
+{
+    if (!block.low_rank || block.U.n() == 0)
+        return;
+
+    FullMatrix<double> Qu, Ru, Qv, Rv;
+    orthonormalize (block.U, Qu, Ru);
+    orthonormalize (block.V, Qv, Rv);
+
+    FullMatrix<double> core (Ru.m(), Rv.m());
+    if (Ru.m() > 0 && Rv.m() > 0)
+        Ru.mTmult (core, Rv);
+
+    std::vector<Vector<double> > cus, cvs;
+    double first = 0;
+    for (unsigned int r = 0; r < std::min (core.m(), core.n()); ++r){
+        unsigned int pi = 0, pj = 0;
+        double pivot = 0;
+        for (unsigned int i = 0; i < core.m(); ++i)
+            for (unsigned int j = 0; j < core.n(); ++j)
+                if (std::fabs(core(i,j)) > std::fabs(pivot)){
+                    pivot = core(i,j);
+                    pi = i;
+                    pj = j;
+                }
+        if (r == 0)
+            first = std::fabs(pivot);
+        if (std::fabs(pivot) <= par->hmatrix_tol*first)
+            break;
+
+        Vector<double> cu (core.m()), cv (core.n());
+        for (unsigned int i = 0; i < core.m(); ++i)
+            cu(i) = core(i,pj);
+        for (unsigned int j = 0; j < core.n(); ++j)
+            cv(j) = core(pi,j)/pivot;
+        for (unsigned int i = 0; i < core.m(); ++i)
+            for (unsigned int j = 0; j < core.n(); ++j)
+                core(i,j) -= cu(i)*cv(j);
+        cus.push_back (cu);
+        cvs.push_back (cv);
+    }
+
+    std::vector<Vector<double> > us (cus.size(), Vector<double>(block.m)),
+            vs (cvs.size(), Vector<double>(block.n));
+    for (unsigned int l = 0; l < cus.size(); ++l){
+        Qu.vmult (us[l], cus[l]);
+        Qv.vmult (vs[l], cvs[l]);
+    }
+    set_low_rank (us, vs, block);
+
+    if (block.m + block.n > 0 && block.U.n() > block.m*block.n/(block.m+block.n)){
+        FullMatrix<double> R;
+        to_dense (block, R);
+        compress (R, block, false);
+    }
+}
+
+/**
+ * Modified Gram-Schmidt with one reorthogonalization pass.
+ */
+template <int dim>
+void
+Elastic::HMatrixSchur<dim>::orthonormalize (const FullMatrix<double> &A, FullMatrix<double> &Q,
+                                            FullMatrix<double> &R) const
+{
+    const unsigned int m = A.m(), k = A.n();
+    std::vector<Vector<double> > qs;
+    FullMatrix<double> coefficients (k, k);
+
+    for (unsigned int c = 0; c < k; ++c){
+        Vector<double> v (m);
+        for (unsigned int i = 0; i < m; ++i)
+            v(i) = A(i,c);
+        const double original = v.l2_norm();
+
+        for (unsigned int pass = 0; pass < 2; ++pass)
+            for (unsigned int l = 0; l < qs.size(); ++l){
+                const double h = qs[l]*v;
+                coefficients(l,c) += h;
+                v.add (-h, qs[l]);
+            }
+
+        const double norm = v.l2_norm();
+        if (norm <= 1e-12*original || norm == 0)
+            continue;
+        coefficients(qs.size(),c) = norm;
+        v /= norm;
+        qs.push_back (v);
+    }
+
+    Q.reinit (m, qs.size());
+    R.reinit (qs.size(), k);
+    for (unsigned int l = 0; l < qs.size(); ++l){
+        for (unsigned int i = 0; i < m; ++i)
+            Q(i,l) = qs[l](i);
+        for (unsigned int c = 0; c < k; ++c)
+            R(l,c) = coefficients(l,c);
+    }
+}
+
+template <int dim>
+void
+Elastic::HMatrixSchur<dim>::set_low_rank (const std::vector<Vector<double> > &us,
+                                          const std::vector<Vector<double> > &vs,
+                                          Block                              &block) const
+{
+    block.low_rank = true;
+    block.dense.reinit (0, 0);
+    block.U.reinit (0, 0);
+    block.V.reinit (0, 0);
+    if (us.empty())
+        return;
+    block.U.reinit (block.m, us.size());
+    block.V.reinit (block.n, vs.size());
+    for (unsigned int k = 0; k < us.size(); ++k){
+        for (unsigned int i = 0; i < block.m; ++i)
+            block.U(i,k) = us[k](i);
+        for (unsigned int j = 0; j < block.n; ++j)
+            block.V(j,k) = vs[k](j);
+    }
+}
+
+template <int dim>
+void
+Elastic::HMatrixSchur<dim>::transpose (const Block &block, Block &result) const
+{
+    result.low_rank = block.low_rank;
+    result.m = block.n;
+    result.n = block.m;
+    result.U = block.V;
+    result.V = block.U;
+    result.dense.reinit (block.dense.n(), block.dense.m());
+    for (unsigned int i = 0; i < block.dense.m(); ++i)
+        for (unsigned int j = 0; j < block.dense.n(); ++j)
+            result.dense(j,i) = block.dense(i,j);
+}
+
+template <int dim>
+double
+Elastic::HMatrixSchur<dim>::entry (const Block &block, const unsigned int i, const unsigned int j) const
+{
+    if (!block.low_rank)
+        return block.dense(i,j);
+
+    double value = 0;
+    for (unsigned int k = 0; k < block.U.n(); ++k)
+        value += block.U(i,k)*block.V(j,k);
+    return value;
+}
+
+template <int dim>
+double
+Elastic::HMatrixSchur<dim>::entry (const unsigned int pi, const unsigned int pj) const
+{
+    unsigned int id = 0;
+    while (nodes[id].child[0] >= 0){
+        const Cluster &t = clusters[nodes[id].row], &s = clusters[nodes[id].col];
+        const unsigned int i = (pi >= clusters[t.child[1]].first),
+                j = (pj >= clusters[s.child[1]].first);
+        id = nodes[id].child[2*i+j];
+    }
+    return entry (nodes[id].data, pi - clusters[nodes[id].row].first,
+                  pj - clusters[nodes[id].col].first);
+}
+
+/**
+ * Greedy coloring of the leaf clusters, two clusters conflict if a
+ * cluster is in the dense neighbourhood of both.
+ */
+template <int dim>
+void
+Elastic::HMatrixSchur<dim>::color_clusters (std::vector<std::vector<unsigned int> > &colors) const
+{
+    colors.clear ();
+    std::vector<std::vector<bool> > covered;
+    for (unsigned int c = 0; c < clusters.size(); ++c){
+        if (clusters[c].child[0] >= 0)
+            continue;
+
+        const std::vector<unsigned int> &dense = near[c];
+        unsigned int g = 0;
+        for (; g < colors.size(); ++g){
+            bool fits = true;
+            for (unsigned int l = 0; l < dense.size() && fits; ++l)
+                fits = !covered[g][nodes[dense[l]].row];
+            if (fits)
+                break;
+        }
+        if (g == colors.size()){
+            colors.push_back (std::vector<unsigned int>());
+            covered.push_back (std::vector<bool>(clusters.size(), false));
+        }
+
+        colors[g].push_back (c);
+        for (unsigned int l = 0; l < dense.size(); ++l)
+            covered[g][nodes[dense[l]].row] = true;
+    }
+}
+
+/**
+ * Cross approximation with partial pivoting. The next pivot row is the
+ * largest entry of the last column, the Frobenius norm of the
+ * approximation is updated with every cross. Stops when the new cross
+ * is below tol times that norm. Only the crosses are kept, their
+ * storage counts towards peak_storage.
+ */
+template <int dim>
+template <class Entries>
+bool
+Elastic::HMatrixSchur<dim>::partial_aca (Entries &entries, const unsigned int m, const unsigned int n,
+                                         const unsigned int max_rank, Block &block)
+{
+    std::vector<Vector<double> > us, vs;
+    std::vector<bool> used_rows (m, false), used_cols (n, false);
+    double norm = 0;
+    unsigned int pi = 0;
+
+    block.m = m;
+    block.n = n;
+    if (m == 0 || n == 0){
+        set_low_rank (us, vs, block);
+        return true;
+    }
+
+    for (;;){
+        used_rows[pi] = true;
+        Vector<double> v;
+        entries.row (pi, v);
+        for (unsigned int l = 0; l < us.size(); ++l)
+            v.add (-us[l](pi), vs[l]);
+
+        unsigned int pj = n;
+        double pivot = 0;
+        for (unsigned int j = 0; j < n; ++j)
+            if (!used_cols[j] && std::fabs(v(j)) > std::fabs(pivot)){
+                pivot = v(j);
+                pj = j;
+            }
+
+        // The row is reproduced, try the next unused one
+        if (pj == n){
+            pi = std::find (used_rows.begin(), used_rows.end(), false) - used_rows.begin();
+            if (pi == m)
+                break;
+            continue;
+        }
+        if (us.size() == max_rank)
+            return false;
+
+        used_cols[pj] = true;
+        v /= pivot;
+        Vector<double> u;
+        entries.column (pj, u);
+        for (unsigned int l = 0; l < us.size(); ++l)
+            u.add (-vs[l](pj), us[l]);
+
+        const double cross = u.norm_sqr()*v.norm_sqr();
+        for (unsigned int l = 0; l < us.size(); ++l)
+            norm += 2*(u*us[l])*(v*vs[l]);
+        norm += cross;
+        us.push_back (u);
+        vs.push_back (v);
+        peak = std::max (peak, us.size()*(m+n)*sizeof(double));
+
+        if (std::sqrt(cross) <= par->hmatrix_tol*std::sqrt(norm))
+            break;
+
+        pi = m;
+        double largest = -1;
+        for (unsigned int i = 0; i < m; ++i)
+            if (!used_rows[i] && std::fabs(u(i)) > largest){
+                largest = std::fabs(u(i));
+                pi = i;
+            }
+        if (pi == m)
+            break;
+    }
+
+    set_low_rank (us, vs, block);
+    return true;
+}
+
+template <int dim>
+void
+Elastic::HMatrixSchur<dim>::to_dense (const Block &block, FullMatrix<double> &R) const
+{
+    if (!block.low_rank){
+        R = block.dense;
+        return;
+    }
+
+    R.reinit (block.m, block.n);
+    if (block.U.n() > 0)
+        block.U.mTmult (R, block.V);
+}
+
+template <int dim>
+void
+Elastic::HMatrixSchur<dim>::hvmult (const unsigned int node, const double a, const double *x, double *y,
+                                    const bool transposed) const
+{
+    const Node &N = nodes[node];
+
+    if (N.child[0] >= 0){
+        const Cluster &t = clusters[N.row], &s = clusters[N.col];
+        for (unsigned int i = 0; i < 2; ++i)
+            for (unsigned int j = 0; j < 2; ++j){
+                const unsigned int r = clusters[t.child[i]].first - t.first,
+                        c = clusters[s.child[j]].first - s.first;
+                if (transposed)
+                    hvmult (N.child[2*i+j], a, x + r, y + c, true);
+                else
+                    hvmult (N.child[2*i+j], a, x + c, y + r, false);
+            }
+        return;
+    }
+
+    const Block &B = N.data;
+    if (!B.low_rank){
+        for (unsigned int i = 0; i < B.m; ++i)
+            for (unsigned int j = 0; j < B.n; ++j)
+                if (transposed)
+                    y[j] += a*B.dense(i,j)*x[i];
+                else
+                    y[i] += a*B.dense(i,j)*x[j];
+        return;
+    }
+
+    // U V^T x or V U^T x
+    const FullMatrix<double> &left = (transposed ? B.V : B.U),
+            &right = (transposed ? B.U : B.V);
+    for (unsigned int k = 0; k < B.U.n(); ++k){
+        double w = 0;
+        for (unsigned int j = 0; j < right.m(); ++j)
+            w += right(j,k)*x[j];
+        for (unsigned int i = 0; i < left.m(); ++i)
+            y[i] += a*w*left(i,k);
+    }
+}
+
+/**
+ * L has identity blocks on the diagonal, the diagonal leaves of U
+ * hold the inverse of their block after lu.
+ */
+template <int dim>
+void
+Elastic::HMatrixSchur<dim>::solve_lower (const unsigned int node, double *x) const
+{
+    const Node &N = nodes[node];
+    if (N.child[0] < 0)
+        return;
+
+    const unsigned int offset = clusters[clusters[N.row].child[1]].first - clusters[N.row].first;
+    solve_lower (N.child[0], x);
+    hvmult (N.child[2], -1.0, x, x + offset, false);
+    solve_lower (N.child[3], x + offset);
+}
+
+template <int dim>
+void
+Elastic::HMatrixSchur<dim>::solve_upper (const unsigned int node, double *x) const
+{
+    const Node &N = nodes[node];
+    if (N.child[0] < 0){
+        const FullMatrix<double> &inverse = N.data.dense;
+        Vector<double> tmp (inverse.m());
+        for (unsigned int i = 0; i < inverse.m(); ++i)
+            for (unsigned int j = 0; j < inverse.n(); ++j)
+                tmp(i) += inverse(i,j)*x[j];
+        std::copy (tmp.begin(), tmp.end(), x);
+        return;
+    }
+
+    const unsigned int offset = clusters[clusters[N.row].child[1]].first - clusters[N.row].first;
+    solve_upper (N.child[3], x + offset);
+    hvmult (N.child[1], -1.0, x + offset, x, false);
+    solve_upper (N.child[0], x);
+}
+
+template <int dim>
+void
+Elastic::HMatrixSchur<dim>::solve_upper_transposed (const unsigned int node, double *x) const
+{
+    const Node &N = nodes[node];
+    if (N.child[0] < 0){
+        const FullMatrix<double> &inverse = N.data.dense;
+        Vector<double> tmp (inverse.n());
+        for (unsigned int i = 0; i < inverse.m(); ++i)
+            for (unsigned int j = 0; j < inverse.n(); ++j)
+                tmp(j) += inverse(i,j)*x[i];
+        std::copy (tmp.begin(), tmp.end(), x);
+        return;
+    }
+
+    const unsigned int offset = clusters[clusters[N.row].child[1]].first - clusters[N.row].first;
+    solve_upper_transposed (N.child[0], x);
+    hvmult (N.child[1], -1.0, x, x + offset, true);
+    solve_upper_transposed (N.child[3], x + offset);
+}
+
+/**
+ * [S00 S01; S10 S11] = [I 0; L10 L11] [U00 U01; 0 U11] with
+ * U01 = L00^{-1} S01, L10 = S10 U00^{-1} and the H-LU of
+ * S11 - L10 U01.
+ */
+template <int dim>
+void
+Elastic::HMatrixSchur<dim>::lu (const unsigned int node)
+{
+    if (nodes[node].child[0] < 0){
+        Block &D = nodes[node].data;
+        FullMatrix<double> R;
+        to_dense (D, R);
+        R.gauss_jordan ();
+        D.low_rank = false;
+        D.U.reinit (0, 0);
+        D.V.reinit (0, 0);
+        D.dense = R;
+        return;
+    }
+
+    const int *child = nodes[node].child;
+    lu (child[0]);
+    solve_lower_left (child[0], child[1]);
+    solve_upper_right (child[2], child[0]);
+    add_product (child[3], child[2], child[1]);
+    lu (child[3]);
+}
+
+template <int dim>
+void
+Elastic::HMatrixSchur<dim>::solve_lower_left (const unsigned int l, const unsigned int x)
+{
+    if (nodes[x].child[0] >= 0){
+        const int *L = nodes[l].child, *X = nodes[x].child;
+        for (unsigned int j = 0; j < 2; ++j){
+            solve_lower_left (L[0], X[j]);
+            add_product (X[2+j], L[2], X[j]);
+            solve_lower_left (L[3], X[2+j]);
+        }
+        return;
+    }
+
+    // Columns of U or of the dense block
+    Block &B = nodes[x].data;
+    FullMatrix<double> &columns = (B.low_rank ? B.U : B.dense);
+    Vector<double> v (columns.m());
+    for (unsigned int j = 0; j < columns.n(); ++j){
+        for (unsigned int i = 0; i < columns.m(); ++i)
+            v(i) = columns(i,j);
+        solve_lower (l, v.begin());
+        for (unsigned int i = 0; i < columns.m(); ++i)
+            columns(i,j) = v(i);
+    }
+}
+
+template <int dim>
+void
+Elastic::HMatrixSchur<dim>::solve_upper_right (const unsigned int x, const unsigned int u)
+{
+    if (nodes[x].child[0] >= 0){
+        const int *U = nodes[u].child, *X = nodes[x].child;
+        for (unsigned int i = 0; i < 2; ++i){
+            solve_upper_right (X[2*i], U[0]);
+            add_product (X[2*i+1], X[2*i], U[1]);
+            solve_upper_right (X[2*i+1], U[3]);
+        }
+        return;
+    }
+
+    // (X U^{-1})^T = U^{-T} X^T on the columns of V or the rows of the dense block
+    Block &B = nodes[x].data;
+    if (B.low_rank){
+        Vector<double> v (B.V.m());
+        for (unsigned int k = 0; k < B.V.n(); ++k){
+            for (unsigned int j = 0; j < B.V.m(); ++j)
+                v(j) = B.V(j,k);
+            solve_upper_transposed (u, v.begin());
+            for (unsigned int j = 0; j < B.V.m(); ++j)
+                B.V(j,k) = v(j);
+        }
+    }else{
+        Vector<double> v (B.dense.n());
+        for (unsigned int i = 0; i < B.dense.m(); ++i){
+            for (unsigned int j = 0; j < B.dense.n(); ++j)
+                v(j) = B.dense(i,j);
+            solve_upper_transposed (u, v.begin());
+            for (unsigned int j = 0; j < B.dense.n(); ++j)
+                B.dense(i,j) = v(j);
+        }
+    }
+}
+
+template <int dim>
+void
+Elastic::HMatrixSchur<dim>::add_product (const unsigned int x, const unsigned int a, const unsigned int b)
+{
+    if (nodes[x].child[0] >= 0 && nodes[a].child[0] >= 0 && nodes[b].child[0] >= 0){
+        for (unsigned int i = 0; i < 2; ++i)
+            for (unsigned int j = 0; j < 2; ++j)
+                for (unsigned int k = 0; k < 2; ++k)
+                    add_product (nodes[x].child[2*i+j], nodes[a].child[2*i+k], nodes[b].child[2*k+j]);
+        return;
+    }
+
+    Block P;
+    product (a, b, P);
+    subtract_block (x, P, 0, 0);
+}
+
+/**
+ * A low-rank factor carries over to the product. Otherwise a dense
+ * factor gives a dense product, two split factors of a leaf are
+ * multiplied with partially pivoted ACA on their product.
+ */
+template <int dim>
+void
+Elastic::HMatrixSchur<dim>::product (const unsigned int a, const unsigned int b, Block &P)
+{
+    const Node &A = nodes[a], &B = nodes[b];
+    const unsigned int m = clusters[A.row].size, k = clusters[A.col].size,
+            n = clusters[B.col].size;
+    P.m = m;
+    P.n = n;
+
+    if (A.child[0] < 0 && A.data.low_rank){
+        // U_a (B^T V_a)^T
+        P.low_rank = true;
+        P.U = A.data.U;
+        P.V.reinit (n, A.data.V.n());
+        Vector<double> v (k), w (n);
+        for (unsigned int l = 0; l < A.data.V.n(); ++l){
+            for (unsigned int j = 0; j < k; ++j)
+                v(j) = A.data.V(j,l);
+            w = 0;
+            hvmult (b, 1.0, v.begin(), w.begin(), true);
+            for (unsigned int j = 0; j < n; ++j)
+                P.V(j,l) = w(j);
+        }
+        return;
+    }
+
+    if (B.child[0] < 0 && B.data.low_rank){
+        // (A U_b) V_b^T
+        P.low_rank = true;
+        P.V = B.data.V;
+        P.U.reinit (m, B.data.U.n());
+        Vector<double> v (k), w (m);
+        for (unsigned int l = 0; l < B.data.U.n(); ++l){
+            for (unsigned int i = 0; i < k; ++i)
+                v(i) = B.data.U(i,l);
+            w = 0;
+            hvmult (a, 1.0, v.begin(), w.begin(), false);
+            for (unsigned int i = 0; i < m; ++i)
+                P.U(i,l) = w(i);
+        }
+        return;
+    }
+
+    ProductEntries entries (*this, a, b, m, k, n);
+    if (A.child[0] >= 0 && B.child[0] >= 0){
+        const unsigned int max_rank = (m+n > 0 ? m*n/(m+n) : 0);
+        if (partial_aca (entries, m, n, max_rank, P))
+            return;
+    }
+
+    P.low_rank = false;
+    P.U.reinit (0, 0);
+    P.V.reinit (0, 0);
+    P.dense.reinit (m, n);
+    Vector<double> column;
+    for (unsigned int j = 0; j < n; ++j){
+        entries.column (j, column);
+        for (unsigned int i = 0; i < m; ++i)
+            P.dense(i,j) = column(i);
+    }
+}
+
+template <int dim>
+void
+Elastic::HMatrixSchur<dim>::subtract_block (const unsigned int x, const Block &P,
+                                            const unsigned int row_offset, const unsigned int col_offset)
+{
+    if (nodes[x].child[0] >= 0){
+        const Cluster &t = clusters[nodes[x].row], &s = clusters[nodes[x].col];
+        for (unsigned int i = 0; i < 2; ++i)
+            for (unsigned int j = 0; j < 2; ++j)
+                subtract_block (nodes[x].child[2*i+j], P,
+                                row_offset + clusters[t.child[i]].first - t.first,
+                                col_offset + clusters[s.child[j]].first - s.first);
+        return;
+    }
+
+    Block &X = nodes[x].data;
+    const unsigned int m = X.m, n = X.n;
+
+    if (P.low_rank){
+        const unsigned int rank = P.U.n();
+        if (rank == 0)
+            return;
+
+        if (!X.low_rank){
+            for (unsigned int i = 0; i < m; ++i)
+                for (unsigned int j = 0; j < n; ++j)
+                    for (unsigned int l = 0; l < rank; ++l)
+                        X.dense(i,j) -= P.U(row_offset+i,l)*P.V(col_offset+j,l);
+            return;
+        }
+
+        // [U_x -U_p] [V_x V_p]^T, then truncated
+        const unsigned int old_rank = X.U.n();
+        FullMatrix<double> U (m, old_rank+rank), V (n, old_rank+rank);
+        for (unsigned int l = 0; l < old_rank; ++l){
+            for (unsigned int i = 0; i < m; ++i)
+                U(i,l) = X.U(i,l);
+            for (unsigned int j = 0; j < n; ++j)
+                V(j,l) = X.V(j,l);
+        }
+        for (unsigned int l = 0; l < rank; ++l){
+            for (unsigned int i = 0; i < m; ++i)
+                U(i,old_rank+l) = -P.U(row_offset+i,l);
+            for (unsigned int j = 0; j < n; ++j)
+                V(j,old_rank+l) = P.V(col_offset+j,l);
+        }
+        X.U = U;
+        X.V = V;
+        truncate (X);
+        return;
+    }
+
+    FullMatrix<double> R;
+    to_dense (X, R);
+    for (unsigned int i = 0; i < m; ++i)
+        for (unsigned int j = 0; j < n; ++j)
+            R(i,j) -= P.dense(row_offset+i, col_offset+j);
+    compress (R, X, X.low_rank);
+}
+
+#endif // HMATRIX_H
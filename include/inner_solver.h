@@ -0,0 +1,475 @@
+/*! TODO
+ */
+
+#ifndef INNER_SOLVER_H
+#define INNER_SOLVER_H
+
+#include <deal.II/base/std_cxx1x/shared_ptr.h>
+#include <deal.II/base/timer.h>
+#include <deal.II/lac/solver_control.h>
+#include <deal.II/lac/solver_gmres.h>
+#include <deal.II/lac/trilinos_sparse_matrix.h>
+#include <deal.II/lac/trilinos_vector.h>
+#include <deal.II/lac/trilinos_precondition.h>
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+#include "parameters.h"
+#include "single_precision.h"
+#include "solver_cgs2.h"
+#include "vector_pool.h"
+
+using namespace std;
+using namespace dealii;
+namespace Elastic
+{
+
+/*!
+ * Usage of the persistent Krylov workspaces of the inner solvers.
+ */
+/*!
+ * Workspace of the Krylov solvers. TimerOutput only keeps wall times
+ * per section, so the counts and memory are printed with the iteration
+ * summary of ElasticBase::run, the times of the allocation in the
+ * "Preconditioner workspace" section and the solve times per iteration
+ * in the solver summary.
+ */
+struct WorkspaceStatistics
+{
+    WorkspaceStatistics () : n_requests(0), n_allocated(0), memory(0), single_memory(0),
+        iterations(0), solve_time(0), single_application(0), double_application(0) {}
+
+    unsigned int n_requests, n_allocated;
+    // single_memory is taken by the single precision matrix copies
+    std::size_t  memory, single_memory;
+    // Krylov iterations and their wall time
+    unsigned int iterations;
+    double       solve_time;
+    // Measured time of one residual and preconditioner application
+    // in float and in double, summed over the single precision blocks
+    double       single_application, double_application;
+};
+
+/*!
+ * Applies the inverse of one diagonal block of the preconditioner.
+ * Depending on par->inner_solver the inverse is approximated with
+ * a nested FGMRES solve, a fixed number of AMG V-cycles
+ * (Richardson iteration) or a Chebyshev accelerated AMG.
+ * The last two have a fixed cost and perform no global reductions.
+ * With fixed set the inverse is always a fixed linear operator,
+ * FGMRES is replaced by V-cycles, as MINRES needs. With exact set the
+ * preconditioner is an accurate inverse of M and is applied once.
+ * With par->single_precision the FGMRES and V-cycle iterations run
+ * in float on a single precision copy of M, only the AMG stays double.
+ * The AMG is shared with the double precision solvers of the other
+ * blocks, so its smoothers cannot move to float; the added memory and
+ * the measured time per application in both precisions are reported.
+ * With par->inner_cgs2 FGMRES orthogonalizes with fused CGS2 passes.
+ */
+template <class PreconditionerType>
+class InnerSolver : public Subscriptor
+{
+public:
+    InnerSolver (parameters                           *_par,
+                 const TrilinosWrappers::SparseMatrix &M,
+                 const PreconditionerType             &Mpreconditioner,
+                 const std::string                    &_name,
+                 const bool                           fixed = false,
+                 const bool                           exact = false);
+
+    /*!
+     * Approximately solve M*dst = src, for FGMRES up to the relative
+     * tolerance tol. Returns the number of inner iterations.
+     */
+    unsigned int solve (TrilinosWrappers::Vector       &dst,
+                        const TrilinosWrappers::Vector &src,
+                        const double                   tol) const;
+
+    /*!
+     * Add the usage of the Krylov workspace to stats.
+     */
+    void add_statistics (WorkspaceStatistics &stats) const;
+
+private:
+    unsigned int solve_fgmres (TrilinosWrappers::Vector       &dst,
+                               const TrilinosWrappers::Vector &src,
+                               const double                   tol) const;
+
+    unsigned int solve_vcycle (TrilinosWrappers::Vector       &dst,
+                               const TrilinosWrappers::Vector &src) const;
+
+    unsigned int solve_chebyshev (TrilinosWrappers::Vector       &dst,
+                                  const TrilinosWrappers::Vector &src) const;
+
+    unsigned int solve_single (TrilinosWrappers::Vector       &dst,
+                               const TrilinosWrappers::Vector &src,
+                               const double                   tol) const;
+
+    // Estimate spectrum of P^{-1}M once with power iterations
+    void estimate_eigenvalues () const;
+
+    // Time one application in float and in double
+    void measure_single ();
+
+    // pointer to parameter object
+    parameters *par;
+    const SmartPointer<const TrilinosWrappers::SparseMatrix> matrix;
+    const PreconditionerType &preconditioner;
+    const std::string name;
+    iFlags::inner_Type type;
+    // V-cycles or Chebyshev steps per application
+    int cycles;
+
+    // Krylov basis and temporaries, kept over the outer iterations
+    mutable VectorPool<TrilinosWrappers::Vector>	pool;
+    mutable SolverControl							control;
+    mutable SolverFGMRES<TrilinosWrappers::Vector>	fgmres;
+    mutable SolverCGS2FGMRES<TrilinosWrappers::Vector>	cgs2;
+    // Time and iterations of the FGMRES solves
+    mutable double									fgmres_time;
+    mutable unsigned int							fgmres_iterations;
+
+    mutable TrilinosWrappers::Vector r, z, d;
+    mutable bool	 eigenvalues_estimated;
+    mutable double	 lambda_min, lambda_max;
+
+    // Single precision path
+    bool													single;
+    SinglePrecisionMatrix									float_matrix;
+    std_cxx1x::shared_ptr<const SinglePrecisionPreconditioner<PreconditionerType> >
+                                                            float_preconditioner;
+    mutable VectorPool<Vector<float> >						float_pool;
+    mutable SolverFGMRES<Vector<float> >					float_fgmres;
+    mutable SolverCGS2FGMRES<Vector<float> >				float_cgs2;
+    mutable Vector<float>									fdst, fsrc, fr, fz;
+    double													single_application, double_application;
+};
+}
+
+/*
+     ------------- IMPLEMENTATION --------------
+*/
+template <class PreconditionerType>
+Elastic::InnerSolver<PreconditionerType>::
+InnerSolver(parameters                           *_par,
+            const TrilinosWrappers::SparseMatrix &M,
+            const PreconditionerType             &Mpreconditioner,
+            const std::string                    &_name,
+            const bool                           fixed,
+            const bool                           exact)
+    :
+      par                     (_par),
+      matrix                  (&M),
+      preconditioner          (Mpreconditioner),
+      name                    (_name),
+      control                 (M.m(), 1.0),
+      fgmres                  (control, pool,
+                               SolverFGMRES<TrilinosWrappers::Vector >::AdditionalData(100)),
+      cgs2                    (control, pool, 100),
+      fgmres_time             (0),
+      fgmres_iterations       (0),
+      r                       (M.m()),
+      z                       (M.m()),
+      d                       (M.m()),
+      eigenvalues_estimated   (false),
+      lambda_min              (0),
+      lambda_max              (0),
+      single                  (false),
+      float_fgmres            (control, float_pool,
+                               SolverFGMRES<Vector<float> >::AdditionalData(100)),
+      float_cgs2              (control, float_pool, 100),
+      single_application      (0),
+      double_application      (0)
+{
+    type = par->inner_solver;
+    if (fixed && type == iFlags::FGMRES)
+        type = iFlags::VCYCLE;
+    cycles = par->inner_cycles;
+    if (exact){
+        type = iFlags::VCYCLE;
+        cycles = 1;
+    }
+
+#ifdef LOGRUN
+    control.enable_history_data ();
+    control.log_history (true);
+    control.log_result (true);
+#endif
+
+    // Chebyshev keeps its spectrum estimate in double
+    single = par->single_precision && type != iFlags::CHEBYSHEV && !exact;
+    if (single){
+        float_matrix.copy_from (M);
+        float_preconditioner = std_cxx1x::shared_ptr<const SinglePrecisionPreconditioner<PreconditionerType> >
+                (new SinglePrecisionPreconditioner<PreconditionerType>(preconditioner, M.m()));
+        fdst.reinit (M.m());
+        fsrc.reinit (M.m());
+        fr.reinit (M.m());
+        fz.reinit (M.m());
+        measure_single ();
+        if (type == iFlags::FGMRES)
+            float_pool.presize (par->inner_pool, fdst);
+    }else if (type == iFlags::FGMRES)
+        pool.presize (par->inner_pool, r);
+}
+
+template <class PreconditionerType>
+unsigned int
+Elastic::InnerSolver<PreconditionerType>::
+solve (TrilinosWrappers::Vector       &dst,
+       const TrilinosWrappers::Vector &src,
+       const double                   tol) const
+{
+    if (single)
+        return solve_single (dst, src, tol);
+
+    switch (type){
+    case iFlags::VCYCLE:
+        return solve_vcycle (dst, src);
+    case iFlags::CHEBYSHEV:
+        return solve_chebyshev (dst, src);
+    default:
+        return solve_fgmres (dst, src, tol);
+    }
+}
+
+template <class PreconditionerType>
+unsigned int
+Elastic::InnerSolver<PreconditionerType>::
+solve_fgmres (TrilinosWrappers::Vector       &dst,
+              const TrilinosWrappers::Vector &src,
+              const double                   tol) const
+{
+    control.set_tolerance (tol*src.l2_norm());
+    Timer timer;
+
+#ifdef LOGRUN
+    deallog.push(name);
+#endif
+    if (par->inner_cgs2)
+        cgs2.solve(*matrix, dst, src, preconditioner);
+    else
+        fgmres.solve(*matrix, dst, src, preconditioner);
+#ifdef LOGRUN
+    deallog.pop();
+#endif
+
+    fgmres_time += timer.wall_time();
+    fgmres_iterations += control.last_step();
+    return control.last_step();
+}
+
+template <class PreconditionerType>
+void
+Elastic::InnerSolver<PreconditionerType>::
+add_statistics (WorkspaceStatistics &stats) const
+{
+    stats.n_requests  += pool.n_requests();
+    stats.n_allocated += pool.n_allocated();
+    stats.memory      += pool.memory_consumption();
+    stats.iterations  += fgmres_iterations;
+    stats.solve_time  += fgmres_time;
+    if (single){
+        stats.n_requests    += float_pool.n_requests();
+        stats.n_allocated   += float_pool.n_allocated();
+        stats.memory        += float_pool.memory_consumption();
+        stats.single_memory += float_matrix.memory_consumption();
+        stats.single_application += single_application;
+        stats.double_application += double_application;
+    }
+}
+
+/*!
+ * The float path still applies the double AMG through conversions,
+ * so its gain is measured instead of assumed. A few residuals and
+ * AMG applications are timed in both precisions.
+ */
+template <class PreconditionerType>
+void
+Elastic::InnerSolver<PreconditionerType>::
+measure_single ()
+{
+    const unsigned int n_applications = 3;
+
+    for (unsigned int i = 0; i < r.size(); ++i)
+        r(i) = 1.0 + (i%7)*0.1;
+    copy_vector (fr, r);
+    d = 0;
+    fdst = 0;
+
+    Timer timer;
+    for (unsigned int k = 0; k < n_applications; ++k){
+        matrix->residual (z, d, r);
+        preconditioner.vmult (d, z);
+    }
+    double_application = timer.wall_time()/n_applications;
+
+    timer.restart ();
+    for (unsigned int k = 0; k < n_applications; ++k){
+        float_matrix.residual (fz, fdst, fr);
+        float_preconditioner->vmult (fdst, fz);
+    }
+    single_application = timer.wall_time()/n_applications;
+}
+
+/*!
+ * FGMRES or V-cycles in float, the tolerance is far above the
+ * single precision round-off. src and dst are converted once.
+ */
+template <class PreconditionerType>
+unsigned int
+Elastic::InnerSolver<PreconditionerType>::
+solve_single (TrilinosWrappers::Vector       &dst,
+              const TrilinosWrappers::Vector &src,
+              const double                   tol) const
+{
+    unsigned int iterations = cycles;
+    copy_vector (fsrc, src);
+
+    if (type == iFlags::VCYCLE){
+        float_preconditioner->vmult (fdst, fsrc);
+        for (int k = 1; k < cycles; ++k){
+            float_matrix.residual (fr, fdst, fsrc);
+            float_preconditioner->vmult (fz, fr);
+            fdst += fz;
+        }
+    }else{
+        // Start from dst as the double precision path does
+        copy_vector (fdst, dst);
+        control.set_tolerance (tol*fsrc.l2_norm());
+        Timer timer;
+
+#ifdef LOGRUN
+        deallog.push(name);
+#endif
+        if (par->inner_cgs2)
+            float_cgs2.solve (float_matrix, fdst, fsrc, *float_preconditioner);
+        else
+            float_fgmres.solve (float_matrix, fdst, fsrc, *float_preconditioner);
+#ifdef LOGRUN
+        deallog.pop();
+#endif
+        iterations = control.last_step();
+        fgmres_time += timer.wall_time();
+        fgmres_iterations += iterations;
+    }
+
+    copy_vector (dst, fdst);
+    return iterations;
+}
+
+/*!
+ * Richardson iteration with the AMG as the approximate inverse,
+ * x_{k+1} = x_k + P^{-1}(b - M x_k), started from x_0 = 0.
+ */
+template <class PreconditionerType>
+unsigned int
+Elastic::InnerSolver<PreconditionerType>::
+solve_vcycle (TrilinosWrappers::Vector       &dst,
+              const TrilinosWrappers::Vector &src) const
+{
+    preconditioner.vmult (dst, src);
+
+    for (int k = 1; k < cycles; ++k){
+        matrix->residual (r, dst, src);
+        preconditioner.vmult (z, r);
+        dst += z;
+    }
+
+    return cycles;
+}
+
+/*!
+ * Chebyshev iteration on the AMG preconditioned block, see
+ * Saad, "Iterative methods for sparse linear systems", Alg. 12.1.
+ * The spectrum bounds are estimated once, after that every
+ * application uses only matrix-vector products and V-cycles.
+ */
+template <class PreconditionerType>
+unsigned int
+Elastic::InnerSolver<PreconditionerType>::
+solve_chebyshev (TrilinosWrappers::Vector       &dst,
+                 const TrilinosWrappers::Vector &src) const
+{
+    if (!eigenvalues_estimated)
+        estimate_eigenvalues ();
+
+    const double theta = 0.5*(lambda_max + lambda_min),
+            delta = 0.5*(lambda_max - lambda_min),
+            sigma = theta/delta;
+    double rho = 1.0/sigma, rho_new;
+
+    // x_0 = 0, r_0 = b
+    dst = 0;
+    r = src;
+    preconditioner.vmult (z, r);
+    d.equ (1.0/theta, z);
+
+    for (int k = 0; k < cycles; ++k){
+        dst += d;
+        if (k == cycles-1)
+            break;
+
+        matrix->vmult (z, d);
+        r -= z;
+        preconditioner.vmult (z, r);
+
+        rho_new = 1.0/(2.0*sigma - rho);
+        d.sadd (rho_new*rho, 2.0*rho_new/delta, z);
+        rho = rho_new;
+    }
+
+    return cycles;
+}
+
+/*!
+ * Power iterations for the largest eigenvalue of P^{-1}M and for the
+ * largest eigenvalue of lambda_max*I - P^{-1}M, which gives the
+ * smallest one. The interval is widened by a safety margin.
+ */
+template <class PreconditionerType>
+void
+Elastic::InnerSolver<PreconditionerType>::
+estimate_eigenvalues () const
+{
+    const unsigned int n_power_iterations = 10;
+    double norm;
+
+    // Start vector with all components excited
+    for (unsigned int i = 0; i < d.size(); ++i)
+        d(i) = 1.0 + (i%7)*0.1;
+    d /= d.l2_norm();
+
+    lambda_max = 0;
+    for (unsigned int k = 0; k < n_power_iterations; ++k){
+        matrix->vmult (r, d);
+        preconditioner.vmult (z, r);
+        lambda_max = d*z;
+        norm = z.l2_norm();
+        if (norm < ZERO)
+            break;
+        d.equ (1.0/norm, z);
+    }
+    lambda_max *= 1.1;
+
+    // Shifted power iteration
+    double shifted = 0;
+    for (unsigned int k = 0; k < n_power_iterations; ++k){
+        matrix->vmult (r, d);
+        preconditioner.vmult (z, r);
+        z.sadd (-1.0, lambda_max, d);
+        shifted = d*z;
+        norm = z.l2_norm();
+        if (norm < ZERO)
+            break;
+        d.equ (1.0/norm, z);
+    }
+
+    // Keep the lower bound away from zero
+    lambda_min = std::max (0.9*(lambda_max - shifted), lambda_max/30.0);
+    eigenvalues_estimated = true;
+}
+
+#endif // INNER_SOLVER_H
@@ -0,0 +1,163 @@
+/*! TODO
+ */
+
+#ifndef OUTER_CONTROL_H
+#define OUTER_CONTROL_H
+
+#include <deal.II/base/std_cxx1x/function.h>
+#include <deal.II/lac/solver_control.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "parameters.h"
+
+using namespace std;
+using namespace dealii;
+namespace Elastic
+{
+
+/*!
+ * Solver control of the outer FGMRES.
+ * Keeps track of the outer residual so the preconditioners can relax
+ * their inner tolerances while the outer iteration converges
+ * (inexact Krylov, Simoncini & Szyld 2003, Bouras & Fraysse 2005).
+ * FGMRES computes its residual from the preconditioned directions,
+ * so the final accuracy of the outer solve is not affected.
+ * With the fallback enabled the solve fails when the residual has not
+ * halved over the last par->stagnation_window iterations, the caller
+ * then switches to the direct solver.
+ * With par->checkpoint the function given to set_checkpoint is called
+ * at the first restart after every par->checkpoint_interval iterations,
+ * when the iterate of the solver is up to date. The solve goes on.
+ * The function given to set_restart_check is called when the solver
+ * checks the residual of a new iterate after a restart, the solve ends
+ * successfully when it returns true.
+ */
+class OuterSolverControl : public SolverControl
+{
+public:
+    OuterSolverControl (parameters *_par, const unsigned int n, const double tol);
+
+    virtual State check (const unsigned int step, const double check_value);
+
+    // Called with the outer step of a restart to write a checkpoint
+    void set_checkpoint (const std_cxx1x::function<void (const unsigned int)> &_checkpoint);
+
+    // Fail on stagnation, set when the caller can factorize the system
+    void enable_fallback (const bool _fallback);
+
+    // Called with the outer step and the true residual at every restart
+    void set_restart_check (const std_cxx1x::function<bool (const unsigned int, const double)> &_restart_check);
+
+    /*!
+     * Inner tolerance for the current outer iteration.
+     * Returns base_tol unless par->adaptive_tol is set, then base_tol
+     * is scaled with ||r_0||/||r_k|| and kept below adaptive_max. The
+     * lower bound adaptive_min never raises it above base_tol.
+     */
+    double inner_tolerance (const double base_tol) const;
+
+private:
+    // pointer to parameter object
+    parameters *par;
+    double		initial_residual, current_residual;
+    std::vector<double> history;
+    bool		fallback;
+
+    std_cxx1x::function<void (const unsigned int)>	checkpoint;
+    std_cxx1x::function<bool (const unsigned int, const double)>	restart_check;
+    // FGMRES checks the same step again after a restart, with x updated
+    unsigned int		last_checkpoint, previous_step;
+};
+}
+
+/*
+     ------------- IMPLEMENTATION --------------
+*/
+inline
+Elastic::OuterSolverControl::OuterSolverControl (parameters *_par, const unsigned int n, const double tol)
+    :
+      SolverControl (n, tol),
+      par (_par),
+      initial_residual (0),
+      current_residual (0),
+      fallback (false),
+      last_checkpoint (0),
+      previous_step (0)
+{}
+
+inline
+void
+Elastic::OuterSolverControl::set_checkpoint (const std_cxx1x::function<void (const unsigned int)> &_checkpoint)
+{
+    checkpoint = _checkpoint;
+}
+
+inline
+void
+Elastic::OuterSolverControl::enable_fallback (const bool _fallback)
+{
+    fallback = _fallback;
+}
+
+inline
+void
+Elastic::OuterSolverControl::set_restart_check (const std_cxx1x::function<bool (const unsigned int, const double)> &_restart_check)
+{
+    restart_check = _restart_check;
+}
+
+inline
+SolverControl::State
+Elastic::OuterSolverControl::check (const unsigned int step, const double check_value)
+{
+    if (step == 0){
+        initial_residual = check_value;
+        history.clear ();
+        last_checkpoint = 0;
+    }
+    current_residual = check_value;
+    history.push_back (check_value);
+    const bool restart = step > 0 && step == previous_step;
+    previous_step = step;
+
+    const State state = SolverControl::check (step, check_value);
+    if (state != iterate)
+        return state;
+
+    if (restart && restart_check && restart_check (step, check_value)){
+        lcheck = success;
+        return success;
+    }
+
+    if (restart && checkpoint && par->checkpoint_interval > 0
+            && step >= last_checkpoint + par->checkpoint_interval){
+        last_checkpoint = step;
+        checkpoint (step);
+    }
+
+    if (!fallback || par->stagnation_window <= 0)
+        return state;
+
+    const unsigned int window = par->stagnation_window;
+    if (history.size() > window && check_value > 0.5*history[history.size()-1-window]){
+        lcheck = failure;
+        return failure;
+    }
+    return state;
+}
+
+inline
+double
+Elastic::OuterSolverControl::inner_tolerance (const double base_tol) const
+{
+    if (!par->adaptive_tol || current_residual <= 0 || initial_residual <= 0)
+        return base_tol;
+
+    const double relaxed = base_tol*initial_residual/current_residual;
+    const double lower = std::min (par->adaptive_min, base_tol);
+    return std::max (lower, std::min (par->adaptive_max, relaxed));
+}
+
+#endif // OUTER_CONTROL_H
@@ -16,6 +16,7 @@
 #include <string>
 #include <string.h>
 #include <sstream>
+#include <stdexcept>
 #include <sys/stat.h>
 
 // Define LOG_RUN to log residuals and solvers
@@ -59,20 +60,73 @@ struct bFlags{
     };
 };
 
+/*! Inner solver types enumerator,
+ * Strategies used to apply the inverse of the
+ * diagonal blocks inside the preconditioners.
+ */
+struct iFlags{
+    enum inner_Type {
+        FGMRES    = 0,  // nested FGMRES preconditioned with AMG
+        VCYCLE    = 1,  // fixed number of AMG V-cycles
+        CHEBYSHEV = 2   // Chebyshev accelerated AMG, no inner reductions
+    };
+};
+
+struct fFlags{
+    enum formulation_Type {
+        MIXED        = 0,   // displacement and pressure
+        DISPLACEMENT = 1,   // displacement only, pressure post-processed
+        AUTO         = 2    // DISPLACEMENT if compressible without adv/div
+    };
+};
+
+struct sFlags{
+    enum schur_Type {
+        ELEMENT = 0,    // element-by-element C - B(A+h^2 I)^{-1}Bt
+        MASS    = 1,    // scaled pressure mass matrix
+        LUMPED  = 2,    // lumped scaled pressure mass matrix
+        SIMPLE  = 3,    // C - B diag(A)^{-1} Bt, sparse product as in SIMPLE
+        HMATRIX = 4     // block low-rank C - B A^{-1} Bt, applied with its LU
+    };
+};
+
+/*!
+ * Thrown by parameters instead of exiting. status is the exit code
+ * main.cc returns, 0 after --help and --samplefile.
+ */
+class ParameterException : public std::runtime_error
+{
+public:
+    ParameterException (const std::string &message, const int _status = 1)
+        : std::runtime_error (message), status (_status) {}
+
+    const int status;
+};
+
 class parameters {
 public:
     // Variables
-    std::string					param_file, default_file;
+    std::string					param_file, default_file, tune_file, store_file,
+                                checkpoint_file, ensemble_list;
 
     int							dimension, degree,
                                 refinements,
                                 xdivisions, ydivisions,
                                 info, // {0,1,2}
-                                system_iter;
+                                system_iter,
+                                inner_cycles, inner_pool,
+                                tune_weight,
+                                direct_dofs, fallback_dofs, stagnation_window,
+                                mg_smoothing_steps,
+                                hmatrix_leaf, hmatrix_rank,
+                                recycle_size, load_steps, checkpoint_interval;
 
     double						load, weight,
                                 gravity,
                                 InvMatPreTOL, SchurTOL, TOL, threshold,
+                                adaptive_min, adaptive_max,
+                                al_gamma, max_poisson, mg_relaxation, disc_fraction,
+                                hmatrix_eta, hmatrix_tol,
                                 YOUNG, POISSON, ETA,
                                 rho_i, rho_r, g0,
                                 x1, x2, y1, y2, Ix, h,
@@ -108,26 +162,72 @@ public:
      */
     bool						load_enabled,weight_enabled,adv_enabled,div_enabled;
 
+    /*!
+     * \brief inner_concurrent solves the displacement blocks concurrently.
+     * \brief adaptive_tol relaxes inner tolerances with the outer residual.
+     * \brief rigid_modes uses rigid body modes as AMG near null space.
+     * \brief share_amg uses one AMG for all displacement components.
+     * \brief amg_concurrent builds the AMG hierarchies on tasks, the ML builds are serialized.
+     * \brief amg_tune picks the AMG settings with trial solves.
+     * \brief al_enabled augments the preconditioner with a grad-div term.
+     * \brief dg_pressure uses FE_DGP pressure condensed cell by cell.
+     * \brief minres solves symmetric systems with MINRES, block diagonal preconditioner.
+     * \brief single_precision runs the inner iterations in float.
+     * \brief direct_fallback factorizes the system when the outer solver stagnates.
+     * \brief monolithic_mg preconditions the whole system with geometric multigrid.
+     * \brief recycle keeps a Krylov subspace of the outer solver between solves.
+     * \brief outer_cgs2, inner_cgs2 orthogonalize FGMRES with fused CGS2 passes.
+     * \brief disc_stop stops the outer solve at a fraction of the discretization error.
+     * \brief store_enabled starts from stored solutions and stores the new one,
+     * \brief store_extrapolate extrapolates the stored solutions in the Poisson ratio.
+     * \brief checkpoint writes checkpoints after each phase and during the solve,
+     * \brief restart continues from the checkpoint, skipping the completed phases.
+     */
+    bool						inner_concurrent, adaptive_tol, rigid_modes, share_amg,
+                                amg_concurrent, amg_tune, al_enabled, dg_pressure, minres,
+                                single_precision, direct_fallback, monolithic_mg, recycle,
+                                outer_cgs2, inner_cgs2, disc_stop,
+                                store_enabled, store_extrapolate, checkpoint, restart;
+
     bFlags::boundary_Type		b_ice, b_up, b_left, b_right, b_bottom;
+    iFlags::inner_Type			inner_solver;
+    sFlags::schur_Type			schur_type;
+    fFlags::formulation_Type	formulation;
     std::vector<unsigned int>	inv_iterations, schur_iterations;
+    // Poisson ratios of the ensemble members
+    std::vector<double>			ensemble;
+    // Options that were changed because they do not fit together
+    std::vector<std::string>	warnings;
 
     std::string					str_poisson;
 
     // Methods
+    /*!
+     * Parameters of one problem: the configuration and the iteration
+     * statistics of its solve. Every problem gets its own object, copies
+     * of the command line parameters can run concurrently.
+     * Without require_default a missing default.cfg is not an error,
+     * the built-in defaults are used.
+     */
+    parameters(int argc, char* argv[], const bool require_default = true);
     ~parameters();
     static parameters* getInstance();
     static parameters* getInstance(int _argc, char *_argv[]);
+    // Change the Poisson ratio and the constants depending on it
+    void set_poisson(const double poisson);
+    // convert Schur approximations to text
+    std::string schur2str(sFlags::schur_Type st);
+    // convert formulations to text
+    std::string formulation2str(fFlags::formulation_Type ft);
 
     void write_sample_file();
+    // Contents of the sample default.cfg
+    void sample_file(std::ostream &ofs);
     std::ostream &print_variables(std::ostream & str);
     std::ostream &print_values(std::ostream &ostr);
 private:
     // Variables
     boost::program_options::variables_map vm;
-    boost::program_options::options_description general;
-    boost::program_options::options_description vars;
-    boost::program_options::options_description file_options;
-    boost::program_options::options_description cmdLine_options;
     // Instance flag
     static bool instanceFlag;
     // Instance
@@ -135,15 +235,27 @@ private:
 
     // Methods
     parameters();
-    parameters(int argc, char* argv[]);
-    void create_options();
+    void create_options(boost::program_options::options_description &general,
+                        boost::program_options::options_description &vars,
+                        boost::program_options::options_description &file_options,
+                        boost::program_options::options_description &cmdLine_options);
     void compute_additionals();
-    void setup_variables(boost::program_options::variables_map & vm);
+    void compute_material();
+    void setup_variables(boost::program_options::variables_map & vm,
+                         const boost::program_options::options_description &cmdLine_options);
 
     bFlags::boundary_Type str2boundary(std::string tempSt);
     // convert boundaries to text
     std::string boudary2str(bFlags::boundary_Type bt);
 
+    iFlags::inner_Type str2inner(std::string tempSt);
+    // convert inner solver types to text
+    std::string inner2str(iFlags::inner_Type it);
+
+    sFlags::schur_Type str2schur(std::string tempSt);
+
+    fFlags::formulation_Type str2formulation(std::string tempSt);
+
     bool fexists(std::string filename);
     std::vector<std::string>& split(const std::string &s, char delim, std::vector<std::string> &elems);
     std::vector<std::string> split(const std::string &s, char delim);
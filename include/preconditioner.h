@@ -3,6 +3,10 @@
 #ifndef PRECONDITIONER_H
 #define PRECONDITIONER_H
 
+#include <deal.II/base/std_cxx1x/bind.h>
+#include <deal.II/base/std_cxx1x/function.h>
+#include <deal.II/base/std_cxx1x/shared_ptr.h>
+#include <deal.II/base/thread_management.h>
 #include <deal.II/lac/trilinos_sparse_matrix.h>
 #include <deal.II/lac/trilinos_block_sparse_matrix.h>
 #include <deal.II/lac/trilinos_vector.h>
@@ -16,7 +20,10 @@
 #include <sstream>
 #include <string>
 #include <typeinfo>
+#include <vector>
 
+#include "inner_solver.h"
+#include "outer_control.h"
 #include "parameters.h"
 
 using namespace std;
@@ -24,25 +31,41 @@ using namespace dealii;
 namespace Elastic
 {
 	// new code step-31
+    /*!
+     * Block lower triangular preconditioner with one diagonal block per
+     * displacement component and the Schur complement in the last block.
+     * The displacement blocks are independent and are solved concurrently
+     * when par->inner_concurrent is set. The Schur complement is
+     * approximated by the separate matrix Schur, see par->schur_type.
+     */
     template <class PreconditionerA, class PreconditionerS>
 	class BlockSchurPreconditioner : public Subscriptor
     {
     public:
-        BlockSchurPreconditioner (const TrilinosWrappers::BlockSparseMatrix     &S,
-                                  const PreconditionerA            &A0preconditioner,
-                                  const PreconditionerA            &A1preconditioner,
-                                  const PreconditionerS            &Spreconditioner);
+        BlockSchurPreconditioner (parameters                                *_par,
+                                  const TrilinosWrappers::BlockSparseMatrix     &S,
+                                  const TrilinosWrappers::SparseMatrix      &Schur,
+                                  const std::vector<const PreconditionerA*> &Apreconditioners,
+                                  const PreconditionerS            &Spreconditioner,
+                                  const OuterSolverControl         *outer = 0);
         
         void vmult (TrilinosWrappers::BlockVector       &dst,
                     const TrilinosWrappers::BlockVector &src) const;
+
+        // Usage of the Krylov workspaces of the inner solvers
+        WorkspaceStatistics workspace_statistics () const;
         
     private:
     	// pointer to parameter object
         parameters *par;
         const SmartPointer<const TrilinosWrappers::BlockSparseMatrix> s_matrix;
-        const PreconditionerA  &a0_preconditioner;
-        const PreconditionerA  &a1_preconditioner;
-        const PreconditionerS  &s_preconditioner;
+        // number of displacement blocks, index of the Schur block
+        const unsigned int n_u;
+        // outer residual for adaptive inner tolerances
+        const OuterSolverControl *outer_control;
+
+        std::vector<std_cxx1x::shared_ptr<const InnerSolver<PreconditionerA> > > a_inverse;
+        const InnerSolver<PreconditionerS> s_inverse;
         
         mutable TrilinosWrappers::Vector tmp;
     };
@@ -53,18 +76,28 @@ namespace Elastic
 */
 template <class PreconditionerA, class PreconditionerS>
 Elastic::BlockSchurPreconditioner<PreconditionerA, PreconditionerS>::
-BlockSchurPreconditioner(const TrilinosWrappers::BlockSparseMatrix  &S,
-                         const PreconditionerA                       &A0preconditioner,
-                         const PreconditionerA                       &A1preconditioner,
-                         const PreconditionerS                       &Spreconditioner)
+BlockSchurPreconditioner(parameters                                 *_par,
+                         const TrilinosWrappers::BlockSparseMatrix  &S,
+                         const TrilinosWrappers::SparseMatrix        &Schur,
+                         const std::vector<const PreconditionerA*>   &Apreconditioners,
+                         const PreconditionerS                       &Spreconditioner,
+                         const OuterSolverControl                    *outer)
     :
+      par                     (_par),
       s_matrix				(&S),
-      a0_preconditioner        (A0preconditioner),
-      a1_preconditioner        (A1preconditioner),
-      s_preconditioner        (Spreconditioner),
-      tmp                     (s_matrix->block(2,2).m())
+      n_u                     (Apreconditioners.size()),
+      outer_control           (outer),
+      s_inverse               (par, Schur, Spreconditioner, "Schur"),
+      tmp                     (Schur.m())
 {
-    par = parameters::getInstance();
+    for(unsigned int i = 0; i < n_u; ++i){
+        ostringstream name;
+        name << "A" << i+1;
+        a_inverse.push_back (std_cxx1x::shared_ptr<const InnerSolver<PreconditionerA> >
+                             (new InnerSolver<PreconditionerA>(par, s_matrix->block(i,i),
+                                                               *Apreconditioners[i],
+                                                               name.str())));
+    }
 }
 
 template <class PreconditionerA, class PreconditionerS>
@@ -73,78 +106,57 @@ Elastic::BlockSchurPreconditioner<PreconditionerA, PreconditionerS>::
 vmult (TrilinosWrappers::BlockVector       &dst,
        const TrilinosWrappers::BlockVector &src) const
 {
-
-    // Solver for solving the block with A0^{-1}
-    SolverControl control_inv0 (s_matrix->block(0,0).m(),
-                               par->InvMatPreTOL*src.block(0).l2_norm());
-
-#ifdef LOGRUN
-    control_inv0.enable_history_data ();
-    control_inv0.log_history (true);
-    control_inv0.log_result (true);
-#endif
-
-    SolverFGMRES<TrilinosWrappers::Vector> // SchurTOL
-            solver0 (control_inv0, SolverFGMRES<TrilinosWrappers::Vector >::AdditionalData(100));
-
-#ifdef LOGRUN
-    deallog.push("A1");
-#endif
-    solver0.solve(s_matrix->block(0,0), dst.block(0), src.block(0), a0_preconditioner);
-#ifdef LOGRUN
-    deallog.pop();
-#endif
-
-    // Solve the block system for A1^{-1}
-    SolverControl control_inv1 (s_matrix->block(1,1).m(),
-                               par->InvMatPreTOL*src.block(1).l2_norm());
-#ifdef LOGRUN
-    control_inv1.enable_history_data ();
-    control_inv1.log_history (true);
-    control_inv1.log_result (true);
-#endif
-
-    SolverFGMRES<TrilinosWrappers::Vector> // SchurTOL
-            solver1 (control_inv1, SolverFGMRES<TrilinosWrappers::Vector >::AdditionalData(100));
-
-#ifdef LOGRUN
-    deallog.push("A2");
-#endif
-    solver1.solve(s_matrix->block(1,1), dst.block(1), src.block(1), a1_preconditioner);
-#ifdef LOGRUN
-    deallog.pop();
-#endif
-
-    // Push number of inner iterations to solve first block.
-    par->inv_iterations.push_back((control_inv0.last_step() + control_inv1.last_step())/2);
-
-    s_matrix->block(2,0).residual(tmp, dst.block(0),src.block(2));
+    const double inv_tol = (outer_control ? outer_control->inner_tolerance (par->InvMatPreTOL)
+                                          : par->InvMatPreTOL),
+            schur_tol = (outer_control ? outer_control->inner_tolerance (par->SchurTOL)
+                                       : par->SchurTOL);
+
+    // Solve the blocks with A_i^{-1}, every task has its own
+    // solver control and returns its iteration count.
+    std::vector<unsigned int> iterations (n_u, 0);
+    if(par->inner_concurrent){
+        std::vector<Threads::Task<unsigned int> > tasks;
+        for(unsigned int i = 0; i < n_u; ++i){
+            std_cxx1x::function<unsigned int ()> task
+                    = std_cxx1x::bind (&InnerSolver<PreconditionerA>::solve,
+                                       std_cxx1x::cref(*a_inverse[i]),
+                                       std_cxx1x::ref(dst.block(i)),
+                                       std_cxx1x::cref(src.block(i)),
+                                       inv_tol);
+            tasks.push_back (Threads::new_task (task));
+        }
+        for(unsigned int i = 0; i < n_u; ++i)
+            iterations[i] = tasks[i].return_value();
+    }else{
+        for(unsigned int i = 0; i < n_u; ++i)
+            iterations[i] = a_inverse[i]->solve (dst.block(i), src.block(i), inv_tol);
+    }
+
+    // Push average number of inner iterations to solve the displacement blocks.
+    unsigned int inv_iter = 0;
+    for(unsigned int i = 0; i < n_u; ++i)
+        inv_iter += iterations[i];
+    par->inv_iterations.push_back(inv_iter/n_u);
+
+    s_matrix->block(n_u,0).residual(tmp, dst.block(0),src.block(n_u));
     tmp *= -1;
-    s_matrix->block(2,1).vmult_add(tmp, dst.block(1));
-
-
-    SolverControl control_s (s_matrix->block(2,2).m(),
-                             par->SchurTOL*tmp.l2_norm());
-#ifdef LOGRUN
-    control_s.enable_history_data ();
-    control_s.log_history (true);
-    control_s.log_result (true);
-#endif
-
-    SolverFGMRES<TrilinosWrappers::Vector> // SchurTOL
-            solver (control_s, SolverFGMRES<TrilinosWrappers::Vector >::AdditionalData(100));
-
-#ifdef LOGRUN
-    deallog.push("Schur");
-#endif
-    solver.solve(s_matrix->block(2,2), dst.block(2), tmp, s_preconditioner);
-#ifdef LOGRUN
-    deallog.pop();
-#endif
+    for(unsigned int i = 1; i < n_u; ++i)
+        s_matrix->block(n_u,i).vmult_add(tmp, dst.block(i));
 
     // Push number of inner iterations for computing Schure complement.
-    par->schur_iterations.push_back(control_s.last_step());
+    par->schur_iterations.push_back(s_inverse.solve (dst.block(n_u), tmp, schur_tol));
 }
 
+template <class PreconditionerA, class PreconditionerS>
+Elastic::WorkspaceStatistics
+Elastic::BlockSchurPreconditioner<PreconditionerA, PreconditionerS>::
+workspace_statistics () const
+{
+    WorkspaceStatistics stats;
+    for(unsigned int i = 0; i < n_u; ++i)
+        a_inverse[i]->add_statistics (stats);
+    s_inverse.add_statistics (stats);
+    return stats;
+}
 
 #endif
@@ -18,6 +18,8 @@
 #include <string>
 #include <typeinfo>
 
+#include "inner_solver.h"
+#include "outer_control.h"
 #include "parameters.h"
 
 using namespace std;
@@ -30,19 +32,30 @@ template <class PreconditionerA, class PreconditionerS>
 class Preconditioner2Blocks : public Subscriptor
 {
 public:
-    Preconditioner2Blocks (const TrilinosWrappers::BlockSparseMatrix     &S,
+    Preconditioner2Blocks (parameters                                *_par,
+                           const TrilinosWrappers::BlockSparseMatrix     &S,
+                           const TrilinosWrappers::SparseMatrix &Schur,
                            const PreconditionerA           &Apreconditioner,
-                           const PreconditionerS            &Spreconditioner);
+                           const PreconditionerS            &Spreconditioner,
+                           const OuterSolverControl         *outer = 0);
 
     void vmult (TrilinosWrappers::BlockVector       &dst,
                 const TrilinosWrappers::BlockVector &src) const;
 
+    // Usage of the Krylov workspaces of the inner solvers
+    WorkspaceStatistics workspace_statistics () const;
+
 private:
     // pointer to parameter object
     parameters *par;
     const SmartPointer<const TrilinosWrappers::BlockSparseMatrix> s_matrix;
     const PreconditionerA &a_preconditioner;
     const PreconditionerS  &s_preconditioner;
+    // outer residual for adaptive inner tolerances
+    const OuterSolverControl *outer_control;
+
+    const InnerSolver<PreconditionerA> a_inverse;
+    const InnerSolver<PreconditionerS> s_inverse;
 
     mutable TrilinosWrappers::Vector tmp;
 };
@@ -53,17 +66,23 @@ private:
 */
 template <class PreconditionerA, class PreconditionerS>
 Elastic::Preconditioner2Blocks<PreconditionerA, PreconditionerS>::
-Preconditioner2Blocks(const TrilinosWrappers::BlockSparseMatrix  &S,
+Preconditioner2Blocks(parameters                                 *_par,
+                      const TrilinosWrappers::BlockSparseMatrix  &S,
+                      const TrilinosWrappers::SparseMatrix       &Schur,
                       const PreconditionerA                      &Apreconditioner,
-                      const PreconditionerS                       &Spreconditioner)
+                      const PreconditionerS                       &Spreconditioner,
+                      const OuterSolverControl                    *outer)
     :
+      par                     (_par),
       s_matrix				(&S),
       a_preconditioner        (Apreconditioner),
       s_preconditioner        (Spreconditioner),
-      tmp                     (s_matrix->block(1,1).m())
-{
-    par = parameters::getInstance();
-}
+      outer_control           (outer),
+      a_inverse               (par, s_matrix->block(0,0), a_preconditioner, "A1"),
+      s_inverse               (par, Schur, s_preconditioner, "Schur", false,
+                               par->schur_type == sFlags::HMATRIX),
+      tmp                     (Schur.m())
+{}
 
 template <class PreconditionerA, class PreconditionerS>
 void
@@ -71,59 +90,30 @@ Elastic::Preconditioner2Blocks<PreconditionerA, PreconditionerS>::
 vmult (TrilinosWrappers::BlockVector       &dst,
        const TrilinosWrappers::BlockVector &src) const
 {
-    double inv_relative_tol = par->InvMatPreTOL*src.block(0).l2_norm(),
-            schur_relative_tol;
-    // Solver for solving the block with A0^{-1}
-    SolverControl control_inv (s_matrix->block(0,0).m(),
-                               inv_relative_tol);
-
-#ifdef LOGRUN
-    control_inv.enable_history_data ();
-    control_inv.log_history (true);
-    control_inv.log_result (true);
-#endif
-
-    SolverFGMRES<TrilinosWrappers::Vector> // SchurTOL
-            solver_A (control_inv, SolverFGMRES<TrilinosWrappers::Vector >::AdditionalData(100));
-
-#ifdef LOGRUN
-    deallog.push("A1");
-#endif
-    solver_A.solve(s_matrix->block(0,0), dst.block(0), src.block(0), a_preconditioner);
-#ifdef LOGRUN
-    deallog.pop();
-#endif
+    const double inv_tol = (outer_control ? outer_control->inner_tolerance (par->InvMatPreTOL)
+                                          : par->InvMatPreTOL),
+            schur_tol = (outer_control ? outer_control->inner_tolerance (par->SchurTOL)
+                                       : par->SchurTOL);
 
     // Push number of inner iterations to solve first block.
-    par->inv_iterations.push_back(control_inv.last_step());// + control_inv1.last_step());
+    par->inv_iterations.push_back(a_inverse.solve (dst.block(0), src.block(0), inv_tol));
 
     s_matrix->block(1,0).residual(tmp, dst.block(0),src.block(1));
     tmp *= -1;
 
-    schur_relative_tol = par->SchurTOL*tmp.l2_norm();
-
-    SolverControl control_s (s_matrix->block(1,1).m(),
-                             schur_relative_tol);
-
-#ifdef LOGRUN
-    control_s.enable_history_data ();
-    control_s.log_history (true);
-    control_s.log_result (true);
-#endif
-
-    SolverFGMRES<TrilinosWrappers::Vector> // SchurTOL
-            solver (control_s, SolverFGMRES<TrilinosWrappers::Vector >::AdditionalData(100));
-
-#ifdef LOGRUN
-    deallog.push("Schur");
-#endif
-    solver.solve(s_matrix->block(1,1), dst.block(1), tmp, s_preconditioner);
-#ifdef LOGRUN
-    deallog.pop();
-#endif
-
     // Push number of inner iterations for computing Schure complement.
-    par->schur_iterations.push_back(control_s.last_step());
+    par->schur_iterations.push_back(s_inverse.solve (dst.block(1), tmp, schur_tol));
+}
+
+template <class PreconditionerA, class PreconditionerS>
+Elastic::WorkspaceStatistics
+Elastic::Preconditioner2Blocks<PreconditionerA, PreconditionerS>::
+workspace_statistics () const
+{
+    WorkspaceStatistics stats;
+    a_inverse.add_statistics (stats);
+    s_inverse.add_statistics (stats);
+    return stats;
 }
 
 #endif // PRECONDITIONER_2BLOCK_H
@@ -0,0 +1,131 @@
+/*! TODO
+ */
+
+#ifndef PRECONDITIONER_DIAGONAL_H
+#define PRECONDITIONER_DIAGONAL_H
+
+#include <deal.II/base/thread_management.h>
+#include <deal.II/lac/trilinos_sparse_matrix.h>
+#include <deal.II/lac/trilinos_block_sparse_matrix.h>
+#include <deal.II/lac/trilinos_vector.h>
+#include <deal.II/lac/trilinos_block_vector.h>
+#include <deal.II/lac/trilinos_precondition.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "inner_solver.h"
+#include "parameters.h"
+
+using namespace std;
+using namespace dealii;
+namespace Elastic
+{
+/*!
+ * Block diagonal preconditioner diag(A_1, .., A_n, -S) for MINRES.
+ * MINRES needs a fixed symmetric positive definite preconditioner, so
+ * the inner solvers are fixed linear operators (V-cycles or Chebyshev,
+ * never FGMRES) and the Schur block is the negated approximation,
+ * schur_operator() holds -S when par->minres is set.
+ * The blocks do not depend on each other, no coupling term is applied.
+ */
+template <class PreconditionerA, class PreconditionerS>
+class BlockDiagonalPreconditioner : public Subscriptor
+{
+public:
+    BlockDiagonalPreconditioner (parameters                                *_par,
+                                 const TrilinosWrappers::BlockSparseMatrix &S,
+                                 const TrilinosWrappers::SparseMatrix      &Schur,
+                                 const std::vector<const PreconditionerA*> &Apreconditioners,
+                                 const PreconditionerS                     &Spreconditioner);
+
+    void vmult (TrilinosWrappers::BlockVector       &dst,
+                const TrilinosWrappers::BlockVector &src) const;
+
+    // Usage of the Krylov workspaces of the inner solvers
+    WorkspaceStatistics workspace_statistics () const;
+
+private:
+    // pointer to parameter object
+    parameters *par;
+    // number of displacement blocks, index of the Schur block
+    const unsigned int n_u;
+
+    std::vector<std_cxx1x::shared_ptr<const InnerSolver<PreconditionerA> > > a_inverse;
+    const InnerSolver<PreconditionerS> s_inverse;
+};
+}
+
+/*
+     ------------- IMPLEMENTATION --------------
+*/
+template <class PreconditionerA, class PreconditionerS>
+Elastic::BlockDiagonalPreconditioner<PreconditionerA, PreconditionerS>::
+BlockDiagonalPreconditioner(parameters                                 *_par,
+                            const TrilinosWrappers::BlockSparseMatrix  &S,
+                            const TrilinosWrappers::SparseMatrix        &Schur,
+                            const std::vector<const PreconditionerA*>   &Apreconditioners,
+                            const PreconditionerS                       &Spreconditioner)
+    :
+      par                     (_par),
+      n_u                     (Apreconditioners.size()),
+      s_inverse               (par, Schur, Spreconditioner, "Schur", true)
+{
+    for(unsigned int i = 0; i < n_u; ++i){
+        ostringstream name;
+        name << "A" << i+1;
+        a_inverse.push_back (std_cxx1x::shared_ptr<const InnerSolver<PreconditionerA> >
+                             (new InnerSolver<PreconditionerA>(par, S.block(i,i),
+                                                               *Apreconditioners[i],
+                                                               name.str(), true)));
+    }
+}
+
+template <class PreconditionerA, class PreconditionerS>
+void
+Elastic::BlockDiagonalPreconditioner<PreconditionerA, PreconditionerS>::
+vmult (TrilinosWrappers::BlockVector       &dst,
+       const TrilinosWrappers::BlockVector &src) const
+{
+    // Fixed cost inner solvers ignore the tolerance
+    std::vector<unsigned int> iterations (n_u, 0);
+    if(par->inner_concurrent){
+        std::vector<Threads::Task<unsigned int> > tasks;
+        for(unsigned int i = 0; i < n_u; ++i){
+            std_cxx1x::function<unsigned int ()> task
+                    = std_cxx1x::bind (&InnerSolver<PreconditionerA>::solve,
+                                       std_cxx1x::cref(*a_inverse[i]),
+                                       std_cxx1x::ref(dst.block(i)),
+                                       std_cxx1x::cref(src.block(i)),
+                                       par->InvMatPreTOL);
+            tasks.push_back (Threads::new_task (task));
+        }
+        for(unsigned int i = 0; i < n_u; ++i)
+            iterations[i] = tasks[i].return_value();
+    }else{
+        for(unsigned int i = 0; i < n_u; ++i)
+            iterations[i] = a_inverse[i]->solve (dst.block(i), src.block(i), par->InvMatPreTOL);
+    }
+
+    unsigned int inv_iter = 0;
+    for(unsigned int i = 0; i < n_u; ++i)
+        inv_iter += iterations[i];
+    par->inv_iterations.push_back(inv_iter/n_u);
+
+    par->schur_iterations.push_back(s_inverse.solve (dst.block(n_u), src.block(n_u), par->SchurTOL));
+}
+
+template <class PreconditionerA, class PreconditionerS>
+Elastic::WorkspaceStatistics
+Elastic::BlockDiagonalPreconditioner<PreconditionerA, PreconditionerS>::
+workspace_statistics () const
+{
+    WorkspaceStatistics stats;
+    for(unsigned int i = 0; i < n_u; ++i)
+        a_inverse[i]->add_statistics (stats);
+    s_inverse.add_statistics (stats);
+    return stats;
+}
+
+#endif // PRECONDITIONER_DIAGONAL_H
@@ -0,0 +1,409 @@
+/*! TODO
+ */
+
+#ifndef RECYCLING_SOLVER_H
+#define RECYCLING_SOLVER_H
+
+#include <deal.II/base/subscriptor.h>
+#include <deal.II/lac/full_matrix.h>
+#include <deal.II/lac/solver_control.h>
+#include <deal.II/lac/vector.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace std;
+using namespace dealii;
+namespace Elastic
+{
+
+/*!
+ * Flexible GMRES with Krylov subspace recycling (GCRO-DR, Parks et al. 2006).
+ * A subspace U is kept from one solve to the next, C = A*U is orthonormal.
+ * Every solve first removes the component of the residual in C and then
+ * runs flexible Arnoldi cycles on (I - C*C^T)*A, the update is
+ * x += Z*y - U*(C^T*A*Z)*y.
+ * After the solve U is replaced by the k directions w of [U Z] with the
+ * smallest |A*w|/|w|, taken from the Arnoldi relation A*[U Z] = [C V]*G
+ * and the Gram matrix of [U Z]. C is recomputed from U at the start of every solve,
+ * so the subspace stays valid when the operator has changed.
+ */
+template <class VECTOR>
+class RecyclingFGMRES : public Subscriptor
+{
+public:
+    RecyclingFGMRES (const unsigned int max_subspace = 10,
+                     const unsigned int restart = 100);
+
+    /*!
+     * Solve A*x = b with the right preconditioner P, x is the initial guess.
+     * Throws SolverControl::NoConvergence like the deal.II solvers.
+     */
+    template <class MATRIX, class PRECONDITIONER>
+    void solve (SolverControl        &control,
+                const MATRIX         &A,
+                VECTOR               &x,
+                const VECTOR         &b,
+                const PRECONDITIONER &P);
+
+    // Forget the recycled subspace
+    void clear ();
+
+    void set_max_subspace (const unsigned int k);
+
+    // Dimension of the recycled subspace
+    unsigned int subspace_size () const;
+
+    // Number of vectors held in the last solve, subspace and Arnoldi basis
+    unsigned int n_vectors () const;
+
+    std::size_t memory_consumption () const;
+
+private:
+    /*!
+     * Replace U by the max_subspace directions w = [U Z]*p with the
+     * smallest |A*w|/|w|, G = [I B; 0 H] of the last cycle.
+     */
+    void update_subspace (const FullMatrix<double> &H,
+                          const FullMatrix<double> &B,
+                          const unsigned int        dim);
+
+    // Eigenvalues and eigenvectors (columns of Q) of the symmetric M, cyclic Jacobi
+    static void symmetric_eigen (FullMatrix<double> &M,
+                                 Vector<double>     &eigenvalues,
+                                 FullMatrix<double> &Q);
+
+    unsigned int			max_subspace;
+    const unsigned int		restart;
+
+    std::vector<VECTOR>		U, C;
+    // Arnoldi basis and preconditioned directions of the current cycle
+    std::vector<VECTOR>		V, Z;
+};
+}
+
+/*
+     ------------- IMPLEMENTATION --------------
+*/
+template <class VECTOR>
+Elastic::RecyclingFGMRES<VECTOR>::RecyclingFGMRES (const unsigned int max_subspace,
+                                                   const unsigned int restart)
+    :
+      max_subspace (max_subspace),
+      restart      (restart)
+{}
+
+template <class VECTOR>
+void
+Elastic::RecyclingFGMRES<VECTOR>::clear ()
+{
+    U.clear ();
+    C.clear ();
+}
+
+template <class VECTOR>
+void
+Elastic::RecyclingFGMRES<VECTOR>::set_max_subspace (const unsigned int k)
+{
+    max_subspace = k;
+    if(U.size() > k){
+        U.resize (k);
+        C.resize (k);
+    }
+}
+
+template <class VECTOR>
+unsigned int
+Elastic::RecyclingFGMRES<VECTOR>::subspace_size () const
+{
+    return U.size();
+}
+
+template <class VECTOR>
+unsigned int
+Elastic::RecyclingFGMRES<VECTOR>::n_vectors () const
+{
+    return U.size() + C.size() + V.size() + Z.size();
+}
+
+template <class VECTOR>
+std::size_t
+Elastic::RecyclingFGMRES<VECTOR>::memory_consumption () const
+{
+    std::size_t memory = 0;
+    for(unsigned int i = 0; i < U.size(); ++i)
+        memory += U[i].memory_consumption() + C[i].memory_consumption();
+    for(unsigned int i = 0; i < V.size(); ++i)
+        memory += V[i].memory_consumption();
+    for(unsigned int i = 0; i < Z.size(); ++i)
+        memory += Z[i].memory_consumption();
+    return memory;
+}
+
+template <class VECTOR>
+template <class MATRIX, class PRECONDITIONER>
+void
+Elastic::RecyclingFGMRES<VECTOR>::solve (SolverControl        &control,
+                                         const MATRIX         &A,
+                                         VECTOR               &x,
+                                         const VECTOR         &b,
+                                         const PRECONDITIONER &P)
+{
+    VECTOR r (b);
+    A.vmult (r, x);
+    r.sadd (-1.0, 1.0, b);
+
+    // C = A*U, orthonormalized with the same operations applied to U
+    std::vector<VECTOR> kept_U, kept_C;
+    for(unsigned int i = 0; i < U.size(); ++i){
+        VECTOR c (r);
+        A.vmult (c, U[i]);
+        for(unsigned int j = 0; j < kept_C.size(); ++j){
+            const double h = kept_C[j]*c;
+            c.add (-h, kept_C[j]);
+            U[i].add (-h, kept_U[j]);
+        }
+        const double norm = c.l2_norm();
+        if(norm < 1e-12*U[i].l2_norm() || norm == 0)
+            continue;
+        c /= norm;
+        U[i] /= norm;
+        kept_C.push_back (c);
+        kept_U.push_back (U[i]);
+    }
+    U.swap (kept_U);
+    C.swap (kept_C);
+    const unsigned int k = U.size();
+
+    // Remove the part of the residual the subspace can represent
+    for(unsigned int i = 0; i < k; ++i){
+        const double c = C[i]*r;
+        x.add (c, U[i]);
+        r.add (-c, C[i]);
+    }
+
+    double beta = r.l2_norm();
+    unsigned int step = 0;
+    SolverControl::State state = control.check (step, beta);
+
+    V.assign (restart+1, r);
+    Z.assign (restart, r);
+    FullMatrix<double> H (restart+1, restart), B (k, restart);
+    unsigned int dim = 0;
+
+    while(state == SolverControl::iterate){
+        FullMatrix<double> R (restart+1, restart);
+        Vector<double> g (restart+1), cs (restart), sn (restart);
+        H = 0;
+        B = 0;
+        g(0) = beta;
+        V[0].equ (1.0/beta, r);
+
+        dim = 0;
+        for(unsigned int j = 0; j < restart && state == SolverControl::iterate; ++j){
+            P.vmult (Z[j], V[j]);
+            A.vmult (V[j+1], Z[j]);
+
+            for(unsigned int i = 0; i < k; ++i){
+                B(i,j) = C[i]*V[j+1];
+                V[j+1].add (-B(i,j), C[i]);
+            }
+            for(unsigned int i = 0; i <= j; ++i){
+                H(i,j) = V[i]*V[j+1];
+                V[j+1].add (-H(i,j), V[i]);
+            }
+            H(j+1,j) = V[j+1].l2_norm();
+            if(H(j+1,j) != 0)
+                V[j+1] /= H(j+1,j);
+
+            // Givens rotations on a copy, H is kept for the subspace update
+            for(unsigned int i = 0; i <= j+1; ++i)
+                R(i,j) = H(i,j);
+            for(unsigned int i = 0; i < j; ++i){
+                const double tmp = cs(i)*R(i,j) + sn(i)*R(i+1,j);
+                R(i+1,j) = -sn(i)*R(i,j) + cs(i)*R(i+1,j);
+                R(i,j)   = tmp;
+            }
+            const double denom = std::sqrt (R(j,j)*R(j,j) + R(j+1,j)*R(j+1,j));
+            cs(j) = R(j,j)/denom;
+            sn(j) = R(j+1,j)/denom;
+            R(j,j)   = denom;
+            R(j+1,j) = 0;
+            g(j+1) = -sn(j)*g(j);
+            g(j)   =  cs(j)*g(j);
+
+            dim = j+1;
+            state = control.check (++step, std::fabs (g(j+1)));
+        }
+
+        // Back substitution R*y = g
+        Vector<double> y (dim), By (k);
+        for(int i = dim-1; i >= 0; --i){
+            double sum = g(i);
+            for(unsigned int l = i+1; l < dim; ++l)
+                sum -= R(i,l)*y(l);
+            y(i) = sum/R(i,i);
+        }
+        for(unsigned int j = 0; j < dim; ++j){
+            x.add (y(j), Z[j]);
+            for(unsigned int i = 0; i < k; ++i)
+                By(i) += B(i,j)*y(j);
+        }
+        for(unsigned int i = 0; i < k; ++i)
+            x.add (-By(i), U[i]);
+
+        if(state == SolverControl::iterate){
+            // Restart from the true residual, kept orthogonal to C
+            A.vmult (r, x);
+            r.sadd (-1.0, 1.0, b);
+            for(unsigned int i = 0; i < k; ++i){
+                const double c = C[i]*r;
+                x.add (c, U[i]);
+                r.add (-c, C[i]);
+            }
+            beta = r.l2_norm();
+            // Same step again, like the restart of the deal.II FGMRES
+            state = control.check (step, beta);
+        }
+    }
+
+    if(dim > 0 && max_subspace > 0)
+        update_subspace (H, B, dim);
+
+    if(state != SolverControl::success)
+        throw SolverControl::NoConvergence (control.last_step(), control.last_value());
+}
+
+/**
+ * A*[U Z] = [C V]*G with [C V] orthonormal, so |A*[U Z]*p| = |G*p|.
+ * [U Z] is not orthonormal, the directions with the smallest
+ * |A*w|/|w| for w = [U Z]*p solve G^T*G*p = theta*W*p with the Gram
+ * matrix W = [U Z]^T*[U Z]. W = Q*L*Q^T is reduced to its well
+ * conditioned part T = Q*L^{-1/2}, then T^T*G^T*G*T is symmetric.
+ */
+template <class VECTOR>
+void
+Elastic::RecyclingFGMRES<VECTOR>::update_subspace (const FullMatrix<double> &H,
+                                                   const FullMatrix<double> &B,
+                                                   const unsigned int        dim)
+{
+    const unsigned int k = U.size(), n = k + dim;
+    FullMatrix<double> G (n+1, n);
+    for(unsigned int i = 0; i < k; ++i){
+        G(i,i) = 1;
+        for(unsigned int j = 0; j < dim; ++j)
+            G(i,k+j) = B(i,j);
+    }
+    for(unsigned int i = 0; i <= dim; ++i)
+        for(unsigned int j = 0; j < dim; ++j)
+            G(k+i,k+j) = H(i,j);
+
+    // Gram matrix of [U Z]
+    std::vector<const VECTOR *> W (n);
+    for(unsigned int i = 0; i < k; ++i)
+        W[i] = &U[i];
+    for(unsigned int j = 0; j < dim; ++j)
+        W[k+j] = &Z[j];
+    FullMatrix<double> gram (n, n), Qw (n, n);
+    for(unsigned int i = 0; i < n; ++i)
+        for(unsigned int j = 0; j <= i; ++j)
+            gram(i,j) = gram(j,i) = (*W[i])*(*W[j]);
+    Vector<double> lambda (n);
+    symmetric_eigen (gram, lambda, Qw);
+
+    // Drop the directions in which [U Z] is numerically dependent
+    double largest = 0;
+    for(unsigned int i = 0; i < n; ++i)
+        largest = std::max (largest, lambda(i));
+    std::vector<unsigned int> kept;
+    for(unsigned int i = 0; i < n; ++i)
+        if(lambda(i) > 1e-12*largest)
+            kept.push_back (i);
+    const unsigned int r = kept.size();
+    if(r == 0)
+        return;
+
+    FullMatrix<double> T (n, r);
+    for(unsigned int l = 0; l < r; ++l)
+        for(unsigned int i = 0; i < n; ++i)
+            T(i,l) = Qw(i,kept[l])/std::sqrt(lambda(kept[l]));
+
+    FullMatrix<double> GT (n+1, r), M (r, r), Q (r, r), P (n, r);
+    G.mmult (GT, T);
+    GT.Tmmult (M, GT);
+    Vector<double> eigenvalues (r);
+    symmetric_eigen (M, eigenvalues, Q);
+    T.mmult (P, Q);
+
+    std::vector<std::pair<double, unsigned int> > order (r);
+    for(unsigned int i = 0; i < r; ++i)
+        order[i] = std::make_pair (eigenvalues(i), i);
+    std::sort (order.begin(), order.end());
+
+    const unsigned int new_k = std::min (max_subspace, r);
+    std::vector<VECTOR> new_U (new_k, Z[0]);
+    for(unsigned int s = 0; s < new_k; ++s){
+        const unsigned int col = order[s].second;
+        new_U[s] = 0;
+        for(unsigned int i = 0; i < n; ++i)
+            new_U[s].add (P(i,col), *W[i]);
+    }
+    U.swap (new_U);
+    C.assign (U.size(), U[0]);
+}
+
+template <class VECTOR>
+void
+Elastic::RecyclingFGMRES<VECTOR>::symmetric_eigen (FullMatrix<double> &M,
+                                                   Vector<double>     &eigenvalues,
+                                                   FullMatrix<double> &Q)
+{
+    const unsigned int n = M.m();
+    Q = 0;
+    for(unsigned int i = 0; i < n; ++i)
+        Q(i,i) = 1;
+
+    for(unsigned int sweep = 0; sweep < 50; ++sweep){
+        double off = 0, total = 0;
+        for(unsigned int i = 0; i < n; ++i)
+            for(unsigned int j = 0; j < n; ++j){
+                total += M(i,j)*M(i,j);
+                if(i != j)
+                    off += M(i,j)*M(i,j);
+            }
+        if(off <= 1e-24*total)
+            break;
+
+        for(unsigned int p = 0; p < n; ++p)
+            for(unsigned int q = p+1; q < n; ++q){
+                if(M(p,q) == 0)
+                    continue;
+                const double theta = (M(q,q) - M(p,p))/(2*M(p,q));
+                const double t = (theta >= 0 ? 1.0 : -1.0)
+                        /(std::fabs(theta) + std::sqrt(theta*theta + 1));
+                const double c = 1/std::sqrt(t*t + 1), s = t*c;
+
+                for(unsigned int l = 0; l < n; ++l){
+                    const double mlp = M(l,p), mlq = M(l,q);
+                    M(l,p) = c*mlp - s*mlq;
+                    M(l,q) = s*mlp + c*mlq;
+                }
+                for(unsigned int l = 0; l < n; ++l){
+                    const double mpl = M(p,l), mql = M(q,l);
+                    M(p,l) = c*mpl - s*mql;
+                    M(q,l) = s*mpl + c*mql;
+                }
+                for(unsigned int l = 0; l < n; ++l){
+                    const double qlp = Q(l,p), qlq = Q(l,q);
+                    Q(l,p) = c*qlp - s*qlq;
+                    Q(l,q) = s*qlp + c*qlq;
+                }
+            }
+    }
+
+    for(unsigned int i = 0; i < n; ++i)
+        eigenvalues(i) = M(i,i);
+}
+
+#endif // RECYCLING_SOLVER_H
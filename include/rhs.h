@@ -17,7 +17,7 @@ namespace Elastic
 	class RightHandSide : public Function<dim>
 	{
     public:
-        RightHandSide () : Function<dim>(dim+1) {par = parameters::getInstance();}
+        RightHandSide (parameters *_par) : Function<dim>(dim+1), par(_par) {}
 		
 		virtual double value (const Point<dim>   &p, const unsigned int  component = 0) const;
 		
@@ -35,7 +35,7 @@ template <int dim>
 double
 Elastic::RightHandSide<dim>::value (const Point<dim>  &p, const unsigned int component) const
 {
-    if (component == 1) // y-component
+    if (component == dim-1) // vertical component
         return (par->weight);
 
     return 0;
@@ -0,0 +1,154 @@
+/*! TODO
+ */
+
+#ifndef SINGLE_PRECISION_H
+#define SINGLE_PRECISION_H
+
+#include <deal.II/lac/sparse_matrix.h>
+#include <deal.II/lac/sparsity_pattern.h>
+#include <deal.II/lac/trilinos_sparse_matrix.h>
+#include <deal.II/lac/trilinos_vector.h>
+#include <deal.II/lac/vector.h>
+
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+using namespace dealii;
+namespace Elastic
+{
+
+/*!
+ * Single precision copy of one block of the preconditioner.
+ * The inner Krylov iterations only need InvMatPreTOL, so their
+ * matrix-vector products can stream floats instead of doubles.
+ */
+class SinglePrecisionMatrix : public Subscriptor
+{
+public:
+    void copy_from (const TrilinosWrappers::SparseMatrix &M);
+
+    void vmult (Vector<float> &dst, const Vector<float> &src) const;
+
+    // dst = src - M*x
+    void residual (Vector<float> &dst, const Vector<float> &x, const Vector<float> &src) const;
+
+    unsigned int m () const;
+
+    std::size_t memory_consumption () const;
+
+private:
+    SparsityPattern			sparsity;
+    SparseMatrix<float>		matrix;
+};
+
+/*!
+ * Applies a double precision preconditioner to float vectors.
+ * ML keeps its hierarchies in double, the vectors are converted
+ * on the way in and out.
+ */
+template <class PreconditionerType>
+class SinglePrecisionPreconditioner : public Subscriptor
+{
+public:
+    SinglePrecisionPreconditioner (const PreconditionerType &_preconditioner,
+                                   const unsigned int       n);
+
+    void vmult (Vector<float> &dst, const Vector<float> &src) const;
+
+private:
+    const PreconditionerType &preconditioner;
+    mutable TrilinosWrappers::Vector in, out;
+};
+
+// Conversion between the Trilinos vectors of the outer solver and float
+void copy_vector (Vector<float> &dst, const TrilinosWrappers::Vector &src);
+void copy_vector (TrilinosWrappers::Vector &dst, const Vector<float> &src);
+}
+
+/*
+     ------------- IMPLEMENTATION --------------
+*/
+inline
+void
+Elastic::SinglePrecisionMatrix::copy_from (const TrilinosWrappers::SparseMatrix &M)
+{
+    std::vector<unsigned int> row_lengths (M.m());
+    for (unsigned int i = 0; i < M.m(); ++i)
+        row_lengths[i] = M.row_length (i);
+
+    matrix.clear ();
+    sparsity.reinit (M.m(), M.n(), row_lengths);
+    for (TrilinosWrappers::SparseMatrix::const_iterator it = M.begin(); it != M.end(); ++it)
+        sparsity.add (it->row(), it->column());
+    sparsity.compress ();
+
+    matrix.reinit (sparsity);
+    for (TrilinosWrappers::SparseMatrix::const_iterator it = M.begin(); it != M.end(); ++it)
+        matrix.set (it->row(), it->column(), static_cast<float>(it->value()));
+}
+
+inline
+void
+Elastic::SinglePrecisionMatrix::vmult (Vector<float> &dst, const Vector<float> &src) const
+{
+    matrix.vmult (dst, src);
+}
+
+inline
+void
+Elastic::SinglePrecisionMatrix::residual (Vector<float> &dst, const Vector<float> &x,
+                                          const Vector<float> &src) const
+{
+    matrix.residual (dst, x, src);
+}
+
+inline
+unsigned int
+Elastic::SinglePrecisionMatrix::m () const
+{
+    return matrix.m();
+}
+
+inline
+std::size_t
+Elastic::SinglePrecisionMatrix::memory_consumption () const
+{
+    return matrix.memory_consumption() + sparsity.memory_consumption();
+}
+
+template <class PreconditionerType>
+Elastic::SinglePrecisionPreconditioner<PreconditionerType>::
+SinglePrecisionPreconditioner (const PreconditionerType &_preconditioner,
+                               const unsigned int       n)
+    :
+      preconditioner  (_preconditioner),
+      in              (n),
+      out             (n)
+{}
+
+template <class PreconditionerType>
+void
+Elastic::SinglePrecisionPreconditioner<PreconditionerType>::
+vmult (Vector<float> &dst, const Vector<float> &src) const
+{
+    copy_vector (in, src);
+    preconditioner.vmult (out, in);
+    copy_vector (dst, out);
+}
+
+inline
+void
+Elastic::copy_vector (Vector<float> &dst, const TrilinosWrappers::Vector &src)
+{
+    std::copy (src.begin(), src.end(), dst.begin());
+}
+
+inline
+void
+Elastic::copy_vector (TrilinosWrappers::Vector &dst, const Vector<float> &src)
+{
+    std::copy (src.begin(), src.end(), dst.begin());
+}
+
+#endif // SINGLE_PRECISION_H
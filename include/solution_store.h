@@ -0,0 +1,240 @@
+/*! TODO
+ */
+
+#ifndef SOLUTION_STORE_H
+#define SOLUTION_STORE_H
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+namespace Elastic
+{
+
+/*!
+ * Solutions of earlier runs, used as initial guesses.
+ * The file is a sequence of records, a fixed size header followed by
+ * the solution values as doubles. New records are appended. The file is
+ * mapped read only, so only the records that are picked get read.
+ * Records are keyed by a hash of the mesh and DoF signature. Within a
+ * key the nearest record in (poisson, load) is used. With extrapolate
+ * set and two records at the same load, the guess is linearly
+ * extrapolated in the Poisson ratio.
+ */
+class SolutionStore
+{
+public:
+    SolutionStore (const std::string &_filename, const std::string &signature);
+    ~SolutionStore ();
+
+    /*!
+     * Initial guess of size n for the given parameters. origin
+     * describes where it comes from, cold_iterations are the iterations
+     * of the solve that started from zero. Returns false if no record
+     * of this signature and size is stored.
+     */
+    bool initial_guess (const double        poisson,
+                        const double        load,
+                        const bool          extrapolate,
+                        std::vector<double> &x,
+                        std::string         &origin,
+                        unsigned int        &cold_iterations) const;
+
+    // Append a solution to the file
+    void store (const double               poisson,
+                const double               load,
+                const unsigned int         iterations,
+                const unsigned int         cold_iterations,
+                const std::vector<double> &x) const;
+
+    // FNV-1a hash of the signature
+    static uint64_t hash (const std::string &signature);
+
+private:
+    // 48 bytes, the values after it stay 8 byte aligned
+    struct Header
+    {
+        char		magic[4];
+        uint32_t	version;
+        uint64_t	key;
+        double		poisson, load;
+        uint32_t	iterations, cold_iterations;
+        uint64_t	n;
+    };
+
+    const double * values (const Header *record) const;
+
+    const std::string			filename;
+    const uint64_t				key;
+
+    void						*mapping;
+    std::size_t					mapped_size;
+    // Records of this key, pointing into the mapping
+    std::vector<const Header*>	records;
+};
+}
+
+/*
+     ------------- IMPLEMENTATION --------------
+*/
+inline
+uint64_t
+Elastic::SolutionStore::hash (const std::string &signature)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (unsigned int i = 0; i < signature.size(); ++i){
+        h ^= static_cast<unsigned char>(signature[i]);
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+inline
+Elastic::SolutionStore::SolutionStore (const std::string &_filename, const std::string &signature)
+    :
+      filename    (_filename),
+      key         (hash (signature)),
+      mapping     (0),
+      mapped_size (0)
+{
+    const int fd = open (filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+
+    struct stat st;
+    if (fstat (fd, &st) == 0 && st.st_size >= static_cast<off_t>(sizeof(Header))){
+        mapped_size = st.st_size;
+        mapping = mmap (0, mapped_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED){
+            mapping = 0;
+            mapped_size = 0;
+        }
+    }
+    close (fd);
+
+    // Walk the records, a truncated or foreign tail ends the scan
+    const char *begin = static_cast<const char*>(mapping);
+    std::size_t offset = 0;
+    while (mapping && offset + sizeof(Header) <= mapped_size){
+        const Header *record = reinterpret_cast<const Header*>(begin + offset);
+        if (std::memcmp (record->magic, "ESOL", 4) != 0 || record->version != 1)
+            break;
+        const std::size_t size = sizeof(Header) + record->n*sizeof(double);
+        if (offset + size > mapped_size)
+            break;
+        if (record->key == key)
+            records.push_back (record);
+        offset += size;
+    }
+}
+
+inline
+Elastic::SolutionStore::~SolutionStore ()
+{
+    if (mapping)
+        munmap (mapping, mapped_size);
+}
+
+inline
+const double *
+Elastic::SolutionStore::values (const Header *record) const
+{
+    return reinterpret_cast<const double*>(record + 1);
+}
+
+inline
+bool
+Elastic::SolutionStore::initial_guess (const double        poisson,
+                                       const double        load,
+                                       const bool          extrapolate,
+                                       std::vector<double> &x,
+                                       std::string         &origin,
+                                       unsigned int        &cold_iterations) const
+{
+    const std::size_t n = x.size();
+
+    // Nearest record, the Poisson ratio scaled to its range [0, 0.5]
+    const Header *nearest = 0, *second = 0;
+    double d_nearest = std::numeric_limits<double>::max();
+    for (unsigned int i = 0; i < records.size(); ++i){
+        if (records[i]->n != n)
+            continue;
+        const double d = std::fabs (records[i]->poisson - poisson)/0.5
+                + std::fabs (records[i]->load - load)/std::max (std::fabs (load), 1.0);
+        // Later records of the same parameters win
+        if (d <= d_nearest){
+            d_nearest = d;
+            nearest = records[i];
+        }
+    }
+    if (!nearest)
+        return false;
+
+    // Next nearest Poisson ratio at the same load
+    if (extrapolate){
+        double d_second = std::numeric_limits<double>::max();
+        for (unsigned int i = 0; i < records.size(); ++i){
+            if (records[i]->n != n || records[i]->load != nearest->load
+                    || records[i]->poisson == nearest->poisson)
+                continue;
+            const double d = std::fabs (records[i]->poisson - poisson);
+            if (d <= d_second){
+                d_second = d;
+                second = records[i];
+            }
+        }
+    }
+
+    std::ostringstream oss;
+    const double *x1 = values (nearest);
+    if (second && nearest->poisson != poisson){
+        const double *x2 = values (second);
+        const double t = (poisson - nearest->poisson)/(second->poisson - nearest->poisson);
+        for (std::size_t i = 0; i < n; ++i)
+            x[i] = x1[i] + t*(x2[i] - x1[i]);
+        oss << "extrapolated from nu = " << nearest->poisson << ", " << second->poisson;
+    }else{
+        std::copy (x1, x1 + n, x.begin());
+        oss << "nearest nu = " << nearest->poisson << ", load = " << nearest->load;
+    }
+    origin = oss.str();
+    cold_iterations = nearest->cold_iterations;
+    return true;
+}
+
+inline
+void
+Elastic::SolutionStore::store (const double               poisson,
+                               const double               load,
+                               const unsigned int         iterations,
+                               const unsigned int         cold_iterations,
+                               const std::vector<double> &x) const
+{
+    Header record;
+    std::memset (&record, 0, sizeof(Header));
+    std::memcpy (record.magic, "ESOL", 4);
+    record.version = 1;
+    record.key = key;
+    record.poisson = poisson;
+    record.load = load;
+    record.iterations = iterations;
+    record.cold_iterations = cold_iterations;
+    record.n = x.size();
+
+    std::ofstream ofs (filename.c_str(), std::ios::binary | std::ios::app);
+    ofs.write (reinterpret_cast<const char*>(&record), sizeof(Header));
+    ofs.write (reinterpret_cast<const char*>(&x[0]), x.size()*sizeof(double));
+}
+
+#endif // SOLUTION_STORE_H
@@ -0,0 +1,394 @@
+/*! TODO
+ */
+
+#ifndef SOLVER_CGS2_H
+#define SOLVER_CGS2_H
+
+#include <deal.II/base/std_cxx1x/bind.h>
+#include <deal.II/base/std_cxx1x/function.h>
+#include <deal.II/base/subscriptor.h>
+#include <deal.II/base/thread_management.h>
+#include <deal.II/base/timer.h>
+#include <deal.II/lac/full_matrix.h>
+#include <deal.II/lac/solver_control.h>
+#include <deal.II/lac/trilinos_block_vector.h>
+#include <deal.II/lac/trilinos_vector.h>
+#include <deal.II/lac/vector.h>
+#include <deal.II/lac/vector_memory.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace std;
+using namespace dealii;
+namespace Elastic
+{
+
+/*!
+ * Contiguous local storage of the vectors, the fused kernels stream
+ * over it directly instead of calling one reduction per basis vector.
+ */
+inline TrilinosScalar * local_data (TrilinosWrappers::Vector &v, const unsigned int)
+{
+    return v.begin();
+}
+inline std::size_t local_size (const TrilinosWrappers::Vector &v, const unsigned int)
+{
+    return v.local_size();
+}
+inline unsigned int n_local_blocks (const TrilinosWrappers::Vector &)
+{
+    return 1;
+}
+
+inline TrilinosScalar * local_data (TrilinosWrappers::BlockVector &v, const unsigned int b)
+{
+    return v.block(b).begin();
+}
+inline std::size_t local_size (const TrilinosWrappers::BlockVector &v, const unsigned int b)
+{
+    return v.block(b).local_size();
+}
+inline unsigned int n_local_blocks (const TrilinosWrappers::BlockVector &v)
+{
+    return v.n_blocks();
+}
+
+template <typename Number>
+inline Number * local_data (Vector<Number> &v, const unsigned int)
+{
+    return v.begin();
+}
+template <typename Number>
+inline std::size_t local_size (const Vector<Number> &v, const unsigned int)
+{
+    return v.size();
+}
+template <typename Number>
+inline unsigned int n_local_blocks (const Vector<Number> &)
+{
+    return 1;
+}
+
+/*!
+ * Flexible GMRES with classical Gram-Schmidt and one reorthogonalization
+ * (CGS2). Each pass computes all dot products V^T*w and |w|^2 in one
+ * sweep over the data, which is a single reduction. The norm after the
+ * update follows from |w - V*h|^2 = |w|^2 - |h|^2. That gives two
+ * fused reductions per iteration instead of the j+2 reductions of
+ * modified Gram-Schmidt.
+ * The flexible Arnoldi relation A*Z = V*H holds for any directions Z.
+ * The preconditioner is therefore applied to the vector after the
+ * first pass while the arithmetic of the second pass runs on another
+ * thread. The thread only touches local data, a norm that needs a
+ * reduction is taken after the preconditioner has returned.
+ * Vectors come from a VectorMemory when they are first used, like the
+ * temporary vectors of the deal.II GMRES.
+ */
+template <class VECTOR>
+class SolverCGS2FGMRES : public Subscriptor
+{
+public:
+    SolverCGS2FGMRES (SolverControl        &control,
+                      VectorMemory<VECTOR> &memory,
+                      const unsigned int   restart = 100);
+
+    template <class MATRIX, class PRECONDITIONER>
+    void solve (const MATRIX         &A,
+                VECTOR               &x,
+                const VECTOR         &b,
+                const PRECONDITIONER &P);
+
+    // Wall time of all solves divided by their iterations
+    double time_per_iteration () const;
+
+private:
+    // w -= V*h and h = V^T*w, norm is |w| afterwards
+    void orthogonalize (const unsigned int n, VECTOR &w,
+                        Vector<double> &h, double &norm) const;
+
+    // The part of orthogonalize without communication, ww = |w|^2 before
+    void local_pass (const unsigned int n, VECTOR &w,
+                     Vector<double> &h, double &ww) const;
+
+    // |w| after local_pass
+    double pass_norm (const unsigned int n, const VECTOR &w,
+                      const Vector<double> &h, const double ww) const;
+
+    // vectors[i], allocated and shaped like x on first use
+    VECTOR & get (std::vector<VECTOR*> &vectors, const unsigned int i,
+                  const VECTOR &x);
+
+    // Fused reduction: h = V^T*w and the return value |w|^2
+    double fused_dots (const unsigned int n, VECTOR &w, Vector<double> &h) const;
+
+    // Fused update: w -= V*h
+    void fused_update (const unsigned int n, VECTOR &w, const Vector<double> &h) const;
+
+    SolverControl			&control;
+    VectorMemory<VECTOR>	&memory;
+    const unsigned int		restart;
+
+    std::vector<VECTOR*>	V, Z;
+
+    double					total_time;
+    unsigned int			total_iterations;
+};
+}
+
+/*
+     ------------- IMPLEMENTATION --------------
+*/
+template <class VECTOR>
+Elastic::SolverCGS2FGMRES<VECTOR>::SolverCGS2FGMRES (SolverControl        &control,
+                                                     VectorMemory<VECTOR> &memory,
+                                                     const unsigned int   restart)
+    :
+      control          (control),
+      memory           (memory),
+      restart          (restart),
+      total_time       (0),
+      total_iterations (0)
+{}
+
+template <class VECTOR>
+double
+Elastic::SolverCGS2FGMRES<VECTOR>::time_per_iteration () const
+{
+    return total_iterations > 0 ? total_time/total_iterations : 0;
+}
+
+template <class VECTOR>
+double
+Elastic::SolverCGS2FGMRES<VECTOR>::fused_dots (const unsigned int n, VECTOR &w,
+                                               Vector<double> &h) const
+{
+    // Chunks of w stay in cache while all basis vectors pass by
+    const std::size_t chunk = 512;
+    double ww = 0;
+    for(unsigned int i = 0; i < n; ++i)
+        h(i) = 0;
+
+    for(unsigned int b = 0; b < n_local_blocks(w); ++b){
+        const std::size_t size = local_size (w, b);
+        const typename VECTOR::value_type *pw = local_data (w, b);
+        for(std::size_t start = 0; start < size; start += chunk){
+            const std::size_t end = std::min (start + chunk, size);
+            for(std::size_t k = start; k < end; ++k)
+                ww += static_cast<double>(pw[k])*pw[k];
+            for(unsigned int i = 0; i < n; ++i){
+                const typename VECTOR::value_type *pv = local_data (*V[i], b);
+                double sum = 0;
+                for(std::size_t k = start; k < end; ++k)
+                    sum += static_cast<double>(pv[k])*pw[k];
+                h(i) += sum;
+            }
+        }
+    }
+    // The vectors are not distributed, the local sums are complete
+    return ww;
+}
+
+template <class VECTOR>
+void
+Elastic::SolverCGS2FGMRES<VECTOR>::fused_update (const unsigned int n, VECTOR &w,
+                                                 const Vector<double> &h) const
+{
+    const std::size_t chunk = 512;
+    for(unsigned int b = 0; b < n_local_blocks(w); ++b){
+        const std::size_t size = local_size (w, b);
+        typename VECTOR::value_type *pw = local_data (w, b);
+        for(std::size_t start = 0; start < size; start += chunk){
+            const std::size_t end = std::min (start + chunk, size);
+            for(unsigned int i = 0; i < n; ++i){
+                const typename VECTOR::value_type *pv = local_data (*V[i], b);
+                const typename VECTOR::value_type hi = h(i);
+                for(std::size_t k = start; k < end; ++k)
+                    pw[k] -= hi*pv[k];
+            }
+        }
+    }
+}
+
+template <class VECTOR>
+void
+Elastic::SolverCGS2FGMRES<VECTOR>::orthogonalize (const unsigned int n, VECTOR &w,
+                                                  Vector<double> &h, double &norm) const
+{
+    double ww = 0;
+    local_pass (n, w, h, ww);
+    norm = pass_norm (n, w, h, ww);
+}
+
+template <class VECTOR>
+void
+Elastic::SolverCGS2FGMRES<VECTOR>::local_pass (const unsigned int n, VECTOR &w,
+                                               Vector<double> &h, double &ww) const
+{
+    ww = fused_dots (n, w, h);
+    fused_update (n, w, h);
+}
+
+template <class VECTOR>
+double
+Elastic::SolverCGS2FGMRES<VECTOR>::pass_norm (const unsigned int n, const VECTOR &w,
+                                              const Vector<double> &h, const double ww) const
+{
+    double hh = 0;
+    for(unsigned int i = 0; i < n; ++i)
+        hh += h(i)*h(i);
+    // Cancellation, w was almost in span(V)
+    if(ww - hh <= 1e-8*ww)
+        return w.l2_norm();
+    return std::sqrt (ww - hh);
+}
+
+template <class VECTOR>
+VECTOR &
+Elastic::SolverCGS2FGMRES<VECTOR>::get (std::vector<VECTOR*> &vectors, const unsigned int i,
+                                        const VECTOR &x)
+{
+    if(vectors[i] == 0){
+        vectors[i] = memory.alloc ();
+        vectors[i]->reinit (x);
+    }
+    return *vectors[i];
+}
+
+template <class VECTOR>
+template <class MATRIX, class PRECONDITIONER>
+void
+Elastic::SolverCGS2FGMRES<VECTOR>::solve (const MATRIX         &A,
+                                          VECTOR               &x,
+                                          const VECTOR         &b,
+                                          const PRECONDITIONER &P)
+{
+    Timer timer;
+    timer.start ();
+
+    // Only the vectors of the iterations that run are allocated
+    V.assign (restart+1, static_cast<VECTOR*>(0));
+    Z.assign (restart, static_cast<VECTOR*>(0));
+    std::vector<VECTOR*> direction (1, static_cast<VECTOR*>(0));
+
+    A.vmult (get (V, 0, x), x);
+    V[0]->sadd (-1.0, 1.0, b);
+    double beta = V[0]->l2_norm();
+
+    unsigned int step = 0;
+    SolverControl::State state = control.check (step, beta);
+
+    FullMatrix<double> H (restart+1, restart);
+    Vector<double> g (restart+1), cs (restart), sn (restart),
+            h1 (restart+1), h2 (restart+1), c (restart+1), y (restart);
+
+    while(state == SolverControl::iterate){
+        H = 0;
+        g = 0;
+        g(0) = beta;
+        *V[0] /= beta;
+        P.vmult (get (Z, 0, x), *V[0]);
+
+        unsigned int dim = 0;
+        for(unsigned int j = 0; j < restart && state == SolverControl::iterate; ++j){
+            VECTOR &w = get (V, j+1, x);
+            A.vmult (w, *Z[j]);
+
+            double norm1 = 0, norm = 0;
+            orthogonalize (j+1, w, h1, norm1);
+
+            // Residual if the second pass changed nothing
+            for(unsigned int i = 0; i <= j; ++i)
+                c(i) = h1(i);
+            for(unsigned int i = 0; i < j; ++i){
+                const double tmp = cs(i)*c(i) + sn(i)*c(i+1);
+                c(i+1) = -sn(i)*c(i) + cs(i)*c(i+1);
+                c(i)   = tmp;
+            }
+            const double estimate = std::fabs (g(j))*norm1
+                    /std::sqrt (c(j)*c(j) + norm1*norm1);
+
+            // Start the next preconditioner application during the second pass
+            const bool speculate = j+1 < restart && estimate > control.tolerance()
+                    && norm1 > 0;
+            if(speculate){
+                get (direction, 0, x).equ (1.0/norm1, w);
+                double ww = 0;
+                std_cxx1x::function<void ()> task
+                        = std_cxx1x::bind (&SolverCGS2FGMRES<VECTOR>::local_pass,
+                                           this, j+1,
+                                           std_cxx1x::ref(w),
+                                           std_cxx1x::ref(h2),
+                                           std_cxx1x::ref(ww));
+                Threads::Task<void> second_pass = Threads::new_task (task);
+                P.vmult (get (Z, j+1, x), *direction[0]);
+                second_pass.join ();
+                norm = pass_norm (j+1, w, h2, ww);
+            }else
+                orthogonalize (j+1, w, h2, norm);
+
+            for(unsigned int i = 0; i <= j; ++i)
+                H(i,j) = h1(i) + h2(i);
+            H(j+1,j) = norm;
+            if(norm != 0)
+                w /= norm;
+
+            for(unsigned int i = 0; i < j; ++i){
+                const double tmp = cs(i)*H(i,j) + sn(i)*H(i+1,j);
+                H(i+1,j) = -sn(i)*H(i,j) + cs(i)*H(i+1,j);
+                H(i,j)   = tmp;
+            }
+            const double denom = std::sqrt (H(j,j)*H(j,j) + H(j+1,j)*H(j+1,j));
+            cs(j) = H(j,j)/denom;
+            sn(j) = H(j+1,j)/denom;
+            H(j,j)   = denom;
+            H(j+1,j) = 0;
+            g(j+1) = -sn(j)*g(j);
+            g(j)   =  cs(j)*g(j);
+
+            dim = j+1;
+            state = control.check (++step, std::fabs (g(j+1)));
+
+            // The estimate was too optimistic, apply the preconditioner now
+            if(state == SolverControl::iterate && j+1 < restart && !speculate)
+                P.vmult (get (Z, j+1, x), w);
+        }
+
+        // Back substitution, x += Z*y
+        for(int i = dim-1; i >= 0; --i){
+            double sum = g(i);
+            for(unsigned int l = i+1; l < dim; ++l)
+                sum -= H(i,l)*y(l);
+            y(i) = sum/H(i,i);
+        }
+        for(unsigned int j = 0; j < dim; ++j)
+            x.add (y(j), *Z[j]);
+
+        if(state == SolverControl::iterate){
+            A.vmult (*V[0], x);
+            V[0]->sadd (-1.0, 1.0, b);
+            beta = V[0]->l2_norm();
+            // Same step again, like the restart of the deal.II FGMRES
+            state = control.check (step, beta);
+        }
+    }
+
+    for(unsigned int i = 0; i < V.size(); ++i)
+        if(V[i] != 0)
+            memory.free (V[i]);
+    for(unsigned int i = 0; i < Z.size(); ++i)
+        if(Z[i] != 0)
+            memory.free (Z[i]);
+    if(direction[0] != 0)
+        memory.free (direction[0]);
+
+    timer.stop ();
+    total_time += timer.wall_time();
+    total_iterations += step;
+
+    if(state != SolverControl::success)
+        throw SolverControl::NoConvergence (control.last_step(), control.last_value());
+}
+
+#endif // SOLVER_CGS2_H
@@ -0,0 +1,138 @@
+/*! TODO
+ */
+
+#ifndef VECTOR_POOL_H
+#define VECTOR_POOL_H
+
+#include <deal.II/base/thread_management.h>
+#include <deal.II/lac/vector_memory.h>
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+using namespace std;
+using namespace dealii;
+namespace Elastic
+{
+
+/*!
+ * Pool of vectors owned by one solver.
+ * GrowingVectorMemory shares one static pool between all vectors of
+ * the same type, so the A and Schur solves hand their vectors back and
+ * forth and they are re-allocated with the other size on every use.
+ * This pool keeps its vectors with the size of its own block and
+ * counts requests and real allocations.
+ */
+template <class VECTOR>
+class VectorPool : public VectorMemory<VECTOR>
+{
+public:
+    VectorPool ();
+    ~VectorPool ();
+
+    /*!
+     * Allocate n vectors shaped like v up front.
+     */
+    void presize (const unsigned int n, const VECTOR &v);
+
+    virtual VECTOR* alloc ();
+    virtual void free (const VECTOR *const v);
+    virtual std::size_t memory_consumption () const;
+
+    // Number of vectors requested by the solvers
+    unsigned int n_requests () const;
+    // Number of vectors really allocated
+    unsigned int n_allocated () const;
+
+private:
+    typedef std::pair<bool, VECTOR*> entry_type;
+    std::vector<entry_type>	pool;
+    unsigned int			requests;
+    Threads::Mutex			mutex;
+};
+}
+
+/*
+     ------------- IMPLEMENTATION --------------
+*/
+template <class VECTOR>
+Elastic::VectorPool<VECTOR>::VectorPool ()
+    :
+      requests (0)
+{}
+
+template <class VECTOR>
+Elastic::VectorPool<VECTOR>::~VectorPool ()
+{
+    for (unsigned int i = 0; i < pool.size(); ++i)
+        delete pool[i].second;
+    pool.clear ();
+}
+
+template <class VECTOR>
+void
+Elastic::VectorPool<VECTOR>::presize (const unsigned int n, const VECTOR &v)
+{
+    Threads::Mutex::ScopedLock lock(mutex);
+    while (pool.size() < n){
+        VECTOR *tmp = new VECTOR;
+        tmp->reinit (v);
+        pool.push_back (entry_type(false, tmp));
+    }
+}
+
+template <class VECTOR>
+VECTOR*
+Elastic::VectorPool<VECTOR>::alloc ()
+{
+    Threads::Mutex::ScopedLock lock(mutex);
+    ++requests;
+    for (unsigned int i = 0; i < pool.size(); ++i)
+        if (pool[i].first == false){
+            pool[i].first = true;
+            return pool[i].second;
+        }
+
+    pool.push_back (entry_type(true, new VECTOR));
+    return pool.back().second;
+}
+
+template <class VECTOR>
+void
+Elastic::VectorPool<VECTOR>::free (const VECTOR *const v)
+{
+    Threads::Mutex::ScopedLock lock(mutex);
+    for (unsigned int i = 0; i < pool.size(); ++i)
+        if (pool[i].second == v){
+            pool[i].first = false;
+            return;
+        }
+    Assert (false, ExcInternalError());
+}
+
+template <class VECTOR>
+std::size_t
+Elastic::VectorPool<VECTOR>::memory_consumption () const
+{
+    std::size_t memory = pool.capacity()*sizeof(entry_type);
+    for (unsigned int i = 0; i < pool.size(); ++i)
+        memory += pool[i].second->memory_consumption();
+    return memory;
+}
+
+template <class VECTOR>
+unsigned int
+Elastic::VectorPool<VECTOR>::n_requests () const
+{
+    return requests;
+}
+
+template <class VECTOR>
+unsigned int
+Elastic::VectorPool<VECTOR>::n_allocated () const
+{
+    return pool.size();
+}
+
+#endif // VECTOR_POOL_H
@@ -0,0 +1,167 @@
+#include "elastic_api.h"
+#include "elastic.h"
+#include "elastic_2_block.h"
+#include "elastic_condensed.h"
+#include "elastic_displacement.h"
+#include "elastic_mg.h"
+
+#include <deal.II/base/thread_management.h>
+#include <deal.II/base/timer.h>
+
+#include <sstream>
+
+using namespace dealii;
+namespace
+{
+// Run one problem type and copy its solution to result
+template <template <int> class Problem, int dim>
+void run_problem (parameters *par, std::ostream &out, Elastic::Result *result)
+{
+    Problem<dim> elastic_problem(par, par->degree, par->info, out);
+    elastic_problem.run ();
+
+    if(result){
+        result->dimension = dim;
+        result->dofs_per_component = elastic_problem.get_dofs_per_component();
+        elastic_problem.solution_values (result->solution);
+        elastic_problem.surface_values (result->surface_points, result->surface_displacement);
+    }
+}
+
+template <int dim>
+void run_dim (parameters *par, std::ostream &out, Elastic::Result *result)
+{
+    if(par->dg_pressure)
+        run_problem<Elastic::ElasticCondensed, dim> (par, out, result);
+    else if(par->formulation == fFlags::DISPLACEMENT)
+        run_problem<Elastic::ElasticDisplacement, dim> (par, out, result);
+    else if(par->monolithic_mg)
+        run_problem<Elastic::ElasticMG, dim> (par, out, result);
+    else if(par->precond)
+        run_problem<Elastic::Elastic2Blocks, dim> (par, out, result);
+    else
+        run_problem<Elastic::ElasticProblem, dim> (par, out, result);
+}
+
+// One member of the ensemble, its errors end up in its own output
+void run_member (parameters *par, std::ostringstream *out)
+{
+    try{
+        Elastic::run (par, *out);
+    }catch (std::exception &exc){
+        *out << "Exception on processing Poisson " << par->POISSON << ": "
+             << exc.what() << std::endl;
+    }
+}
+}
+
+Elastic::Configuration::Configuration (const std::vector<std::string> &options)
+    :
+      poisson      (-1),
+      refinements  (-1),
+      output_files (false)
+{
+    // parameters parses options as a command line
+    std::vector<std::string> args (1, "elastic");
+    args.insert (args.end(), options.begin(), options.end());
+
+    std::vector<std::vector<char> > buffers (args.size());
+    std::vector<char*> argv;
+    for(unsigned int i = 0; i < args.size(); ++i){
+        buffers[i].assign (args[i].begin(), args[i].end());
+        buffers[i].push_back ('\0');
+        argv.push_back (&buffers[i][0]);
+    }
+    argv.push_back (0);
+
+    base.reset (new parameters (args.size(), &argv[0], false));
+}
+
+Elastic::Result::Result ()
+    :
+      dimension        (0),
+      iterations       (0),
+      inner_iterations (0),
+      schur_iterations (0)
+{}
+
+void
+Elastic::run (parameters *par, std::ostream &out, Result *result)
+{
+    if(par->dimension == 2)
+        run_dim<2> (par, out, result);
+    else
+        run_dim<3> (par, out, result);
+
+    if(result){
+        result->warnings = par->warnings;
+        result->iterations = par->system_iter;
+        for(unsigned int i = 0; i < par->inv_iterations.size(); ++i){
+            result->inner_iterations += par->inv_iterations[i];
+            result->schur_iterations += par->schur_iterations[i];
+        }
+    }
+}
+
+Elastic::Result
+Elastic::solve (const Configuration &config, std::ostream &out)
+{
+    // A fresh copy, the statistics of this solve start empty
+    parameters par (*config.base);
+    if(config.poisson >= 0)
+        par.set_poisson (config.poisson);
+    if(config.refinements >= 0)
+        par.refinements = config.refinements;
+    par.output_results = config.output_files;
+
+    Result result;
+    run (&par, out, &result);
+    return result;
+}
+
+Elastic::Result
+Elastic::solve (const Configuration &config)
+{
+    // Stream without buffer, the output is discarded
+    std::ostream null_stream (0);
+    return solve (config, null_stream);
+}
+
+/*!
+ * Every member has its own copy of the parameters, so the configuration
+ * and the iteration statistics are not shared, and its own output,
+ * printed in order once all members are done. Checkpoint, AMG tuning
+ * and solution store files get the Poisson ratio in the file name.
+ */
+void
+Elastic::run_ensemble (parameters *par, std::ostream &out)
+{
+    const unsigned int n = par->ensemble.size();
+    std::vector<std_cxx1x::shared_ptr<parameters> > members;
+    std::vector<std_cxx1x::shared_ptr<std::ostringstream> > outputs;
+
+    for(unsigned int i = 0; i < n; ++i){
+        members.push_back (std_cxx1x::shared_ptr<parameters>(new parameters(*par)));
+        members[i]->set_poisson (par->ensemble[i]);
+        // The members write concurrently, every one to its own files
+        members[i]->checkpoint_file = members[i]->str_poisson + "_" + par->checkpoint_file;
+        members[i]->tune_file = members[i]->str_poisson + "_" + par->tune_file;
+        members[i]->store_file = members[i]->str_poisson + "_" + par->store_file;
+        outputs.push_back (std_cxx1x::shared_ptr<std::ostringstream>(new std::ostringstream));
+    }
+
+    Timer timer;
+    timer.start ();
+    Threads::TaskGroup<void> tasks;
+    for(unsigned int i = 0; i < n; ++i)
+        tasks += Threads::new_task (&run_member, members[i].get(), outputs[i].get());
+    tasks.join_all ();
+    timer.stop ();
+
+    for(unsigned int i = 0; i < n; ++i)
+        out << GREEN << "Ensemble member " << i+1 << "/" << n
+            << ", Poisson " << members[i]->POISSON << RESET << std::endl
+            << outputs[i]->str();
+    out << "Ensemble: " << n << " problems, wall time = "
+        << timer.wall_time() << " s" << std::endl;
+}
@@ -1,7 +1,12 @@
-#include "elastic.h"
-#include "elastic_2_block.h"
+#include "elastic_api.h"
 #include "parameters.h"
 
+#include <deal.II/base/logstream.h>
+#include <deal.II/base/mpi.h>
+
+#include <fstream>
+#include <sstream>
+
 int main (int argc, char** argv)
 {
 	using namespace std;
@@ -16,6 +21,8 @@ int main (int argc, char** argv)
 		
         // get instance of parameters
         par = parameters::getInstance(argc, argv);
+        for(unsigned int i = 0; i < par->warnings.size(); ++i)
+            cerr << par->warnings[i] << endl;
 		
         ostringstream filename;
         filename << "iterations" << par->str_poisson << ".log";
@@ -25,23 +32,15 @@ int main (int argc, char** argv)
         deallog.attach(pout);
         deallog.depth_console (0);
 
-        if(par->precond){
-            if(par->dimension == 2){
-                Elastic::Elastic2Blocks<2> elastic_problem(par->degree, par->info);
-                elastic_problem.run ();
-            }else{
-                Elastic::Elastic2Blocks<3> elastic_problem(par->degree, par->info);
-                elastic_problem.run ();
-            }
-        }else{
-            if(par->dimension == 2){
-                Elastic::ElasticProblem<2> elastic_problem(par->degree, par->info);
-                elastic_problem.run ();
-            }else{
-                Elastic::ElasticProblem<3> elastic_problem(par->degree, par->info);
-                elastic_problem.run ();
-            }
-        }
+        if(par->ensemble.size() > 0)
+            Elastic::run_ensemble (par, std::cout);
+        else
+            Elastic::run (par, std::cout);
+    }
+    catch (ParameterException &exc){
+        // Invalid options, or --help and --samplefile
+        (exc.status == 0 ? std::cout : std::cerr) << exc.what();
+        return exc.status;
     }
 	catch (std::exception &exc){
         std::cerr << setw(width) << setfill('-') << "" << std::endl;
@@ -6,8 +6,11 @@ parameters* parameters::singlton = NULL;
 using namespace std;
 namespace po = boost::program_options;
 parameters::~parameters() {
-    instanceFlag = false;
-    singlton = NULL;
+    // Copies made for an ensemble leave the singleton alone
+    if(singlton == this){
+        instanceFlag = false;
+        singlton = NULL;
+    }
 }
 
 parameters* parameters::getInstance() {
@@ -30,19 +33,19 @@ parameters* parameters::getInstance(int _argc, char* _argv[]) {
 // The sequence of this method is important
 // First default file is red, then other file and at last
 // the command line options
-parameters::parameters(int argc, char* argv[]):
-    general("General configurations"),
-    vars("Problem variables"),
-    file_options("All file options"),
-    cmdLine_options("Allowed options")
+parameters::parameters(int argc, char* argv[], const bool require_default)
 {
-    create_options();
+    po::options_description general("General configurations"),
+            vars("Problem variables"),
+            file_options("All file options"),
+            cmdLine_options("Allowed options");
+    create_options(general, vars, file_options, cmdLine_options);
 
     default_file = "default.cfg";
-    if(!fexists(default_file)){
-        std::cerr << "default.cfg file must always be available!\nSample file is created.\n";
+    const bool default_exists = fexists(default_file);
+    if(!default_exists && require_default){
         write_sample_file();
-        exit(1);
+        throw ParameterException ("default.cfg file must always be available!\nSample file is created.\n");
     }
 
     // Command line options setup
@@ -58,13 +61,20 @@ parameters::parameters(int argc, char* argv[]):
         ifsd.close();
     }
 
-    ifsd.open(default_file);
-    po::store(po::parse_config_file(ifsd, file_options), vm);
-    ifsd.close();
+    if(default_exists){
+        ifsd.open(default_file);
+        po::store(po::parse_config_file(ifsd, file_options), vm);
+        ifsd.close();
+    }else{
+        // The sample file holds the built-in defaults
+        std::stringstream sample;
+        sample_file(sample);
+        po::store(po::parse_config_file(sample, file_options), vm);
+    }
 
     po::notify(vm);
 
-    setup_variables(vm);
+    setup_variables(vm, cmdLine_options);
     validate_options();
     compute_additionals();
 
@@ -72,19 +82,18 @@ parameters::parameters(int argc, char* argv[]):
     schur_iterations = std::vector<unsigned int>();
 }
 
-parameters::parameters():
-    general("General configurations"),
-    vars("Problem variables"),
-    file_options("All file options"),
-    cmdLine_options("Allowed options")
+parameters::parameters()
 {
-    create_options();
+    po::options_description general("General configurations"),
+            vars("Problem variables"),
+            file_options("All file options"),
+            cmdLine_options("Allowed options");
+    create_options(general, vars, file_options, cmdLine_options);
     // Other setups.
     default_file = "default.cfg";
     if(!fexists(default_file)){
-        std::cerr << "Default file must always be available!";
         write_sample_file();
-        exit(1);
+        throw ParameterException ("Default file must always be available!\n");
     }
 
     ifstream ifsd(default_file);
@@ -92,7 +101,7 @@ parameters::parameters():
     po::notify(vm);
     ifsd.close();
 
-    setup_variables(vm);
+    setup_variables(vm, cmdLine_options);
     validate_options();
     compute_additionals();
 
@@ -100,7 +109,10 @@ parameters::parameters():
     schur_iterations = std::vector<unsigned int>();
 }
 
-void parameters::create_options() {
+void parameters::create_options(po::options_description &general,
+                                po::options_description &vars,
+                                po::options_description &file_options,
+                                po::options_description &cmdLine_options) {
     // Environment options setup
     general.add_options()
             ("help,h", "Produce help message")
@@ -122,7 +134,35 @@ void parameters::create_options() {
             ("schur_tol,s", po::value<double>(), "Tolerance to compute Schur complement")
             ("system_tol,t", po::value<double>(), "System solver tollerance")
             ("young,y", po::value<double>(&YOUNG), "Set Young's modulus")
-            ("threshold,z", po::value<double>(), "Application threashold");
+            ("threshold,z", po::value<double>(), "Application threashold")
+            ("inner", po::value<std::string>(), "Inner solver {FGMRES|VCYCLE|CHEBYSHEV}")
+            ("schur", po::value<std::string>(), "Schur complement approximation {ELEMENT|MASS|LUMPED|SIMPLE|HMATRIX}")
+            ("cycles", po::value<int>(), "Number of AMG cycles for fixed cost inner solvers")
+            ("concurrent", po::value<bool>(), "Solve the displacement blocks concurrently {1|0}")
+            ("single", po::value<bool>(), "Inner solves in single precision {1|0}")
+            ("direct_dofs", po::value<int>(), "Largest number of DoFs solved with the direct solver")
+            ("mg", po::value<bool>(), "Monolithic geometric multigrid with Vanka smoothers {1|0}")
+            ("checkpoint", po::value<bool>(), "Write checkpoints after each phase and during the solve {1|0}")
+            ("restart", po::value<bool>(), "Restart from the checkpoint file {1|0}")
+            ("ensemble", po::value<std::string>(), "Comma separated Poisson ratios solved concurrently")
+            ("store", po::value<bool>(), "Warm start from the solution store {1|0}")
+            ("disc_stop", po::value<bool>(), "Stop the outer solve at the discretization error {1|0}")
+            ("disc_fraction", po::value<double>(), "Algebraic error as a fraction of the discretization error")
+            ("cgs2", po::value<bool>(), "Outer FGMRES with fused CGS2 orthogonalization {1|0}")
+            ("inner_cgs2", po::value<bool>(), "Inner FGMRES with fused CGS2 orthogonalization {1|0}")
+            ("recycle", po::value<bool>(), "Recycle the outer Krylov subspace between load steps {1|0}")
+            ("recycle_size", po::value<int>(), "Dimension of the recycled subspace")
+            ("steps", po::value<int>(), "Number of load steps")
+            ("adaptive,a", po::value<bool>(), "Relax inner tolerances with the outer residual {1|0}")
+            ("rigid", po::value<bool>(), "Rigid body modes as near null space of the displacement AMG {1|0}")
+            ("share", po::value<bool>(), "Share one AMG hierarchy between the displacement components {1|0}")
+            ("amg_concurrent", po::value<bool>(), "Build the AMG hierarchies concurrently {1|0}")
+            ("tune", po::value<bool>(), "Tune the AMG settings with trial solves {1|0}")
+            ("al", po::value<bool>(), "Augmented Lagrangian preconditioner {1|0}")
+            ("gamma,g", po::value<double>(), "Augmented Lagrangian parameter")
+            ("dgp", po::value<bool>(), "Discontinuous pressure, condensed cell by cell {1|0}")
+            ("formulation", po::value<std::string>(), "Formulation {MIXED|DISPLACEMENT|AUTO}")
+            ("minres", po::value<bool>(), "MINRES with block diagonal preconditioner for symmetric systems {1|0}");
 
     file_options.add_options()
             ("dimension",po::value<int>(&dimension), "Set Problem dimension")
@@ -155,19 +195,115 @@ void parameters::create_options() {
             ("tolerance.inverse",po::value<double>(&InvMatPreTOL), "Tolerance for inverse calculation")
             ("tolerance.schur", po::value<double>(&SchurTOL), "Tolerance to compute Schur complement")
             ("tolerance.system", po::value<double>(&TOL), "System solver tolerance")
-            ("amg.threshold", po::value<double>(&threshold), "AMG preconditioner threshold");
+            ("tolerance.adaptive", po::value<bool>(&adaptive_tol)->default_value(false),
+             "Relax inner tolerances with the outer residual {1|0}")
+            ("tolerance.adaptive_min", po::value<double>(&adaptive_min)->default_value(1e-3),
+             "Lower bound of the adaptive inner tolerances")
+            ("tolerance.adaptive_max", po::value<double>(&adaptive_max)->default_value(0.5),
+             "Upper bound of the adaptive inner tolerances")
+            ("tolerance.discretization", po::value<bool>(&disc_stop)->default_value(false),
+             "Stop the outer solve at a fraction of the discretization error {1|0}")
+            ("tolerance.fraction", po::value<double>(&disc_fraction)->default_value(0.1),
+             "Algebraic error allowed as a fraction of the discretization error")
+            ("amg.threshold", po::value<double>(&threshold), "AMG preconditioner threshold")
+            ("amg.rigid_modes", po::value<bool>(&rigid_modes)->default_value(false),
+             "Rigid body modes as near null space of the displacement AMG {1|0}")
+            ("amg.share", po::value<bool>(&share_amg)->default_value(false),
+             "Share one AMG hierarchy between the displacement components {1|0}")
+            ("amg.concurrent", po::value<bool>(&amg_concurrent)->default_value(false),
+             "Build the AMG hierarchies concurrently {1|0}")
+            ("amg.tune", po::value<bool>(&amg_tune)->default_value(false),
+             "Tune the AMG settings with trial solves {1|0}")
+            ("amg.tune_file", po::value<string>(&tune_file)->default_value("amg_tune.txt"),
+             "Cache of the tuned AMG settings")
+            ("amg.tune_weight", po::value<int>(&tune_weight)->default_value(20),
+             "Expected applications of each AMG, weight of the trial solve")
+            ("al.enabled", po::value<bool>(&al_enabled)->default_value(false),
+             "Augmented Lagrangian preconditioner {1|0}")
+            ("al.gamma", po::value<double>(&al_gamma)->default_value(1.0),
+             "Augmented Lagrangian parameter")
+            ("solver.formulation", po::value<string>()->default_value("MIXED"),
+             "Formulation {MIXED|DISPLACEMENT|AUTO}")
+            ("solver.max_poisson", po::value<double>(&max_poisson)->default_value(0.45),
+             "Largest Poisson ratio solved with the displacement formulation in AUTO")
+            ("solver.minres", po::value<bool>(&minres)->default_value(false),
+             "MINRES with block diagonal preconditioner for symmetric systems {1|0}")
+            ("solver.cgs2", po::value<bool>(&outer_cgs2)->default_value(false),
+             "Outer FGMRES with fused CGS2 orthogonalization {1|0}")
+            ("direct.max_dofs", po::value<int>(&direct_dofs)->default_value(0),
+             "Largest number of DoFs solved with the direct solver")
+            ("direct.fallback", po::value<bool>(&direct_fallback)->default_value(false),
+             "Factorize the system when the outer solver stagnates {1|0}")
+            ("direct.fallback_dofs", po::value<int>(&fallback_dofs)->default_value(200000),
+             "Largest number of DoFs factorized by the fallback")
+            ("direct.window", po::value<int>(&stagnation_window)->default_value(50),
+             "Outer iterations without halving the residual that count as stagnation")
+            ("mg.enabled", po::value<bool>(&monolithic_mg)->default_value(false),
+             "Monolithic geometric multigrid with Vanka smoothers {1|0}")
+            ("mg.smoothing_steps", po::value<int>(&mg_smoothing_steps)->default_value(2),
+             "Pre and post smoothing steps on every level")
+            ("mg.relaxation", po::value<double>(&mg_relaxation)->default_value(0.7),
+             "Relaxation of the cell patch (Vanka) smoother")
+            ("checkpoint.enabled", po::value<bool>(&checkpoint)->default_value(false),
+             "Write checkpoints after each phase and during the solve {1|0}")
+            ("checkpoint.restart", po::value<bool>(&restart)->default_value(false),
+             "Restart from the checkpoint file, skipping completed phases {1|0}")
+            ("checkpoint.file", po::value<string>(&checkpoint_file)->default_value("checkpoint.bin"),
+             "Binary checkpoint file")
+            ("checkpoint.interval", po::value<int>(&checkpoint_interval)->default_value(200),
+             "Outer iterations between checkpoints during the solve, taken at the next FGMRES restart, 0 only after the phases")
+            ("ensemble.poisson", po::value<string>(&ensemble_list)->default_value(""),
+             "Comma separated Poisson ratios solved concurrently, empty for a single run")
+            ("store.enabled", po::value<bool>(&store_enabled)->default_value(false),
+             "Warm start from the solution store and add the new solution {1|0}")
+            ("store.file", po::value<string>(&store_file)->default_value("solutions.bin"),
+             "Binary solution store")
+            ("store.extrapolate", po::value<bool>(&store_extrapolate)->default_value(true),
+             "Extrapolate stored solutions in the Poisson ratio {1|0}")
+            ("recycle.enabled", po::value<bool>(&recycle)->default_value(false),
+             "Recycle the outer Krylov subspace between load steps {1|0}")
+            ("recycle.size", po::value<int>(&recycle_size)->default_value(10),
+             "Dimension of the recycled subspace")
+            ("recycle.steps", po::value<int>(&load_steps)->default_value(1),
+             "Number of load steps, the ice load grows linearly to its full value")
+            ("hmatrix.leaf", po::value<int>(&hmatrix_leaf)->default_value(64),
+             "Largest pressure cluster of the block low-rank Schur complement")
+            ("hmatrix.eta", po::value<double>(&hmatrix_eta)->default_value(1.0),
+             "Admissibility, blocks with min(diam) <= eta*dist are low-rank")
+            ("hmatrix.tol", po::value<double>(&hmatrix_tol)->default_value(1e-3),
+             "Relative accuracy of the low-rank blocks and of the A solves")
+            ("hmatrix.rank", po::value<int>(&hmatrix_rank)->default_value(16),
+             "Largest rank of a low-rank block")
+            ("pressure.discontinuous", po::value<bool>(&dg_pressure)->default_value(false),
+             "Discontinuous pressure, condensed cell by cell {1|0}")
+            ("schur.type", po::value<string>()->default_value("ELEMENT"),
+             "Schur complement approximation {ELEMENT|MASS|LUMPED|SIMPLE|HMATRIX}")
+            ("inner.type", po::value<string>()->default_value("FGMRES"),
+             "Inner solver {FGMRES|VCYCLE|CHEBYSHEV}")
+            ("inner.cgs2", po::value<bool>(&inner_cgs2)->default_value(false),
+             "Inner FGMRES with fused CGS2 orthogonalization {1|0}")
+            ("inner.cycles", po::value<int>(&inner_cycles)->default_value(2),
+             "Number of AMG cycles for fixed cost inner solvers")
+            ("inner.concurrent", po::value<bool>(&inner_concurrent)->default_value(false),
+             "Solve the displacement blocks concurrently {1|0}")
+            ("inner.pool", po::value<int>(&inner_pool)->default_value(16),
+             "Number of Krylov vectors allocated up front per inner solver")
+            ("inner.single", po::value<bool>(&single_precision)->default_value(false),
+             "Inner solves in single precision {1|0}");
 
     cmdLine_options.add(general).add(vars);
 }
 
-void parameters::setup_variables(po::variables_map& vm) {
+void parameters::setup_variables(po::variables_map& vm,
+                                 const po::options_description &cmdLine_options) {
     if(vm.count("help")){
-        cout << cmdLine_options << "\n";
-        exit(0);
+        std::ostringstream help;
+        help << cmdLine_options << "\n";
+        throw ParameterException (help.str(), 0);
     }
     if(vm.count("samplefile")){
         write_sample_file();
-        exit(0);
+        throw ParameterException ("", 0);
     }
     if(vm.count("matrix")){
         print_matrices = true;
@@ -200,6 +336,33 @@ void parameters::setup_variables(po::variables_map& vm) {
     if(vm.count("threshold")){
         threshold = vm["threshold"].as<double>();
     }
+    if(vm.count("adaptive")){
+        adaptive_tol = vm["adaptive"].as<bool>();
+    }
+    if(vm.count("rigid")){
+        rigid_modes = vm["rigid"].as<bool>();
+    }
+    if(vm.count("share")){
+        share_amg = vm["share"].as<bool>();
+    }
+    if(vm.count("amg_concurrent")){
+        amg_concurrent = vm["amg_concurrent"].as<bool>();
+    }
+    if(vm.count("tune")){
+        amg_tune = vm["tune"].as<bool>();
+    }
+    if(vm.count("al")){
+        al_enabled = vm["al"].as<bool>();
+    }
+    if(vm.count("gamma")){
+        al_gamma = vm["gamma"].as<double>();
+    }
+    if(vm.count("dgp")){
+        dg_pressure = vm["dgp"].as<bool>();
+    }
+    if(vm.count("minres")){
+        minres = vm["minres"].as<bool>();
+    }
 
     if(vm.count("boundaries.ice")){
         b_ice =  str2boundary(vm["boundaries.ice"].as<string>());
@@ -216,6 +379,106 @@ void parameters::setup_variables(po::variables_map& vm) {
     if(vm.count("boundaries.bottom")){
         b_bottom =  str2boundary(vm["boundaries.bottom"].as<string>());
     }
+
+    if(vm.count("schur.type")){
+        schur_type = str2schur(vm["schur.type"].as<string>());
+    }
+    if(vm.count("schur")){
+        schur_type = str2schur(vm["schur"].as<string>());
+    }
+    // The augmented Lagrangian is paired with the scaled mass matrix
+    if(al_enabled && schur_type == sFlags::ELEMENT){
+        schur_type = sFlags::MASS;
+    }
+    if(vm.count("solver.formulation")){
+        formulation = str2formulation(vm["solver.formulation"].as<string>());
+    }
+    if(vm.count("formulation")){
+        formulation = str2formulation(vm["formulation"].as<string>());
+    }
+    // Compressible runs without advection and divergence terms
+    // do not need the mixed formulation
+    if(formulation == fFlags::AUTO){
+        if(!adv_enabled && !div_enabled && !dg_pressure && POISSON <= max_poisson)
+            formulation = fFlags::DISPLACEMENT;
+        else
+            formulation = fFlags::MIXED;
+    }
+    // Advection and divergence make the system unsymmetric,
+    // these runs stay with FGMRES
+    if(minres && (adv_enabled || div_enabled)){
+        warnings.push_back("MINRES needs a symmetric system, using FGMRES");
+        minres = false;
+    }
+    if(vm.count("inner.type")){
+        inner_solver = str2inner(vm["inner.type"].as<string>());
+    }
+    if(vm.count("inner")){
+        inner_solver = str2inner(vm["inner"].as<string>());
+    }
+    if(vm.count("cycles")){
+        inner_cycles = vm["cycles"].as<int>();
+    }
+    if(vm.count("concurrent")){
+        inner_concurrent = vm["concurrent"].as<bool>();
+    }
+    if(vm.count("single")){
+        single_precision = vm["single"].as<bool>();
+    }
+    if(vm.count("direct_dofs")){
+        direct_dofs = vm["direct_dofs"].as<int>();
+    }
+    if(vm.count("mg")){
+        monolithic_mg = vm["mg"].as<bool>();
+    }
+    if(vm.count("checkpoint")){
+        checkpoint = vm["checkpoint"].as<bool>();
+    }
+    if(vm.count("restart")){
+        restart = vm["restart"].as<bool>();
+    }
+    if(vm.count("store")){
+        store_enabled = vm["store"].as<bool>();
+    }
+    if(vm.count("ensemble")){
+        ensemble_list = vm["ensemble"].as<string>();
+    }
+    ensemble.clear();
+    std::vector<std::string> ratios = split(ensemble_list, ',');
+    for(unsigned int i = 0; i < ratios.size(); ++i)
+        if(ratios[i].find_first_not_of(" \t") != std::string::npos)
+            ensemble.push_back(atof(ratios[i].c_str()));
+    if(vm.count("disc_stop")){
+        disc_stop = vm["disc_stop"].as<bool>();
+    }
+    if(vm.count("disc_fraction")){
+        disc_fraction = vm["disc_fraction"].as<double>();
+    }
+    if(vm.count("cgs2")){
+        outer_cgs2 = vm["cgs2"].as<bool>();
+    }
+    if(vm.count("inner_cgs2")){
+        inner_cgs2 = vm["inner_cgs2"].as<bool>();
+    }
+    if(vm.count("recycle")){
+        recycle = vm["recycle"].as<bool>();
+    }
+    if(vm.count("recycle_size")){
+        recycle_size = vm["recycle_size"].as<int>();
+    }
+    if(vm.count("steps")){
+        load_steps = vm["steps"].as<int>();
+    }
+    // The Vanka smoothed V-cycle is not symmetric positive definite
+    if(monolithic_mg && minres){
+        warnings.push_back("MINRES is not used with the monolithic multigrid, using FGMRES");
+        minres = false;
+    }
+    // The recycled subspace lives in the flexible outer solver
+    if(recycle && minres){
+        warnings.push_back("MINRES does not recycle Krylov subspaces, using FGMRES");
+        minres = false;
+    }
 }
 
 void parameters::compute_additionals() {
@@ -234,6 +497,15 @@ void parameters::compute_additionals() {
     y2 = y2/L;
     Ix = Ix/L;
 
+    compute_material();
+
+    weight = (weight_enabled)?(scale1*rho_r*gravity):0.0;
+
+    load = (load_enabled)?(scale2*rho_i*gravity*h):0.0;
+}
+
+// Everything that depends on the Poisson ratio, YOUNG is scaled already
+void parameters::compute_material() {
     // converting par.POISSON in a string and removing the '.'
     std::ostringstream strs;
     strs << POISSON;
@@ -254,36 +526,107 @@ void parameters::compute_additionals() {
     scale1 = L*L/(S*U);
     scale2 = L/(S*U);
     scale3 = scale2*rho_r*gravity;
+}
 
-    weight = (weight_enabled)?(scale1*rho_r*gravity):0.0;
-
-    load = (load_enabled)?(scale2*rho_i*gravity*h):0.0;
+void parameters::set_poisson(const double poisson) {
+    POISSON = poisson;
+    compute_material();
+    validate_options();
 }
 
 void parameters::validate_options(){
     using namespace std;
-    bool is_correct = true;
+    // Problems are collected, all of them are reported at once
+    std::ostringstream errors;
+    // Chebyshev needs the spectrum of a symmetric A, advection and
+    // divergence terms make it unsymmetric
+    if(inner_solver == iFlags::CHEBYSHEV && (adv_enabled || div_enabled)){
+        warnings.push_back("Chebyshev needs a symmetric A, using FGMRES inner solvers");
+        inner_solver = iFlags::FGMRES;
+    }
+    // The shared AMG hierarchy is not safe to apply from several
+    // threads at once
+    if(share_amg && inner_concurrent){
+        warnings.push_back("The displacement blocks share one AMG, solving them sequentially");
+        inner_concurrent = false;
+    }
     if(dimension > 3 || dimension < 2){
-        cerr << "Problem dimension is not supported.\n";
-        is_correct = false;
+        errors << "Problem dimension is not supported.\n";
     }
     if(degree <= 0 || xdivisions <= 0 || ydivisions <= 0 ||
             YOUNG <= 0 || ETA <=0 || refinements <= 0 || TOL <= 0 ||
             SchurTOL <= 0 || InvMatPreTOL <= 0 || rho_i <= 0 || rho_r <= 0){
-        cerr << "Invalid or negative value for one of the variables below:\n";
-        cerr << "degree, xdivisions, ydivisions, young, eta, refinements, TOL, schure_tol, InvMatPreTOL, rho_r, rho_i\n";
-        is_correct = false;
+        errors << "Invalid or negative value for one of the variables below:\n";
+        errors << "degree, xdivisions, ydivisions, young, eta, refinements, TOL, schure_tol, InvMatPreTOL, rho_r, rho_i\n";
     }
     if(Ix > x2){
-        cerr << "Ice width is either too small or biger than earth width\n";
-        is_correct = false;
+        errors << "Ice width is either too small or biger than earth width\n";
     }
     if(POISSON < 0 || POISSON > 0.5){
-        cerr << "Poisson's ratio should be in the interval 0-0.5\n";
-        is_correct = false;
+        errors << "Poisson's ratio should be in the interval 0-0.5\n";
+    }
+    if(adaptive_min <= 0 || adaptive_max < adaptive_min){
+        errors << "Adaptive tolerance bounds should satisfy 0 < adaptive_min <= adaptive_max\n";
+    }
+    for(unsigned int i = 0; i < ensemble.size(); ++i)
+        if(ensemble[i] <= 0 || ensemble[i] > 0.5){
+            errors << "Poisson's ratios of the ensemble should be in the interval 0-0.5\n";
+            break;
+        }
+    if(checkpoint_interval < 0){
+        errors << "Checkpoint interval can not be negative\n";
+    }
+    if(disc_fraction <= 0 || disc_fraction >= 1){
+        errors << "Fraction of the discretization error should be in the interval 0-1\n";
+    }
+    if(inner_pool < 0){
+        errors << "Size of the inner vector pool can not be negative\n";
+    }
+    if(formulation == fFlags::DISPLACEMENT && (dg_pressure || POISSON >= 0.5)){
+        errors << "The displacement formulation needs continuous pressure and Poisson's ratio below 0.5\n";
+    }
+    if(dg_pressure && POISSON >= 0.5){
+        errors << "Condensing the discontinuous pressure needs Poisson's ratio below 0.5\n";
+    }
+    if(al_gamma <= 0){
+        errors << "Augmented Lagrangian parameter should be positive\n";
+    }
+    if(direct_dofs < 0 || fallback_dofs < 0 || stagnation_window < 0){
+        errors << "Direct solver thresholds and stagnation window can not be negative\n";
     }
-    if(!is_correct)
-        exit(1);
+    if(monolithic_mg && (dg_pressure || formulation != fFlags::MIXED)){
+        errors << "The monolithic multigrid needs the mixed formulation with continuous pressure\n";
+    }
+    if(schur_type == sFlags::HMATRIX && (!precond || minres || monolithic_mg || adv_enabled || div_enabled
+                                         || dg_pressure || formulation != fFlags::MIXED)){
+        errors << "The HMATRIX Schur complement needs the symmetric mixed 2 block solver (-c 1) without MINRES\n";
+    }
+    if(hmatrix_leaf <= 0 || hmatrix_rank <= 0 || hmatrix_eta <= 0 || hmatrix_tol <= 0){
+        errors << "H-matrix leaf size, rank, admissibility and tolerance should be positive\n";
+    }
+    if(mg_smoothing_steps <= 0 || mg_relaxation <= 0){
+        errors << "Multigrid smoothing steps and relaxation should be positive\n";
+    }
+    if(recycle_size <= 0 || recycle_size >= 100 || load_steps <= 0){
+        errors << "Recycled subspace should be within 1-99 and the number of load steps positive\n";
+    }
+    if(load_steps > 1 && (dg_pressure || formulation != fFlags::MIXED)){
+        errors << "Load steps need the mixed formulation with continuous pressure\n";
+    }
+    if(load_steps > 1 && (checkpoint || restart)){
+        errors << "Checkpoints hold a single solve, they can not be used with load steps\n";
+    }
+    if(disc_stop && (minres || dg_pressure || formulation != fFlags::MIXED)){
+        errors << "Stopping at the discretization error needs the outer FGMRES of the mixed formulation\n";
+    }
+    if(tune_weight < 0){
+        errors << "Weight of the AMG trial solves can not be negative\n";
+    }
+    if(inner_cycles <= 0){
+        errors << "Number of inner cycles should be positive\n";
+    }
+    if(!errors.str().empty())
+        throw ParameterException (errors.str());
 }
 
 // Helper methods
@@ -325,6 +668,109 @@ std::string parameters::boudary2str(bFlags::boundary_Type bt){
     return tempSt;
 }
 
+iFlags::inner_Type parameters::str2inner(std::string tempSt){
+    iFlags::inner_Type it = iFlags::FGMRES;
+    if(tempSt == std::string("FGMRES"))
+        it = iFlags::FGMRES;
+    else if(tempSt == std::string("VCYCLE"))
+        it = iFlags::VCYCLE;
+    else if(tempSt == std::string("CHEBYSHEV"))
+        it = iFlags::CHEBYSHEV;
+    else{
+        throw ParameterException ("Unknown inner solver: " + tempSt + "\n");
+    }
+
+    return it;
+}
+
+sFlags::schur_Type parameters::str2schur(std::string tempSt){
+    sFlags::schur_Type st = sFlags::ELEMENT;
+    if(tempSt == std::string("ELEMENT"))
+        st = sFlags::ELEMENT;
+    else if(tempSt == std::string("MASS"))
+        st = sFlags::MASS;
+    else if(tempSt == std::string("LUMPED"))
+        st = sFlags::LUMPED;
+    else if(tempSt == std::string("SIMPLE"))
+        st = sFlags::SIMPLE;
+    else if(tempSt == std::string("HMATRIX"))
+        st = sFlags::HMATRIX;
+    else{
+        throw ParameterException ("Unknown Schur complement approximation: " + tempSt + "\n");
+    }
+
+    return st;
+}
+
+fFlags::formulation_Type parameters::str2formulation(std::string tempSt){
+    fFlags::formulation_Type ft = fFlags::MIXED;
+    if(tempSt == std::string("MIXED"))
+        ft = fFlags::MIXED;
+    else if(tempSt == std::string("DISPLACEMENT"))
+        ft = fFlags::DISPLACEMENT;
+    else if(tempSt == std::string("AUTO"))
+        ft = fFlags::AUTO;
+    else{
+        throw ParameterException ("Unknown formulation: " + tempSt + "\n");
+    }
+
+    return ft;
+}
+
+std::string parameters::formulation2str(fFlags::formulation_Type ft){
+    std::string tempSt;
+    switch (ft){
+    case fFlags::MIXED:
+        tempSt = "MIXED";
+        break;
+    case fFlags::DISPLACEMENT:
+        tempSt = "DISPLACEMENT";
+        break;
+    case fFlags::AUTO:
+        tempSt = "AUTO";
+        break;
+    }
+    return tempSt;
+}
+
+std::string parameters::schur2str(sFlags::schur_Type st){
+    std::string tempSt;
+    switch (st){
+    case sFlags::ELEMENT:
+        tempSt = "ELEMENT";
+        break;
+    case sFlags::MASS:
+        tempSt = "MASS";
+        break;
+    case sFlags::LUMPED:
+        tempSt = "LUMPED";
+        break;
+    case sFlags::SIMPLE:
+        tempSt = "SIMPLE";
+        break;
+    case sFlags::HMATRIX:
+        tempSt = "HMATRIX";
+        break;
+    }
+    return tempSt;
+}
+
+std::string parameters::inner2str(iFlags::inner_Type it){
+    std::string tempSt;
+    switch (it){
+    case iFlags::FGMRES:
+        tempSt = "FGMRES";
+        break;
+    case iFlags::VCYCLE:
+        tempSt = "VCYCLE";
+        break;
+    case iFlags::CHEBYSHEV:
+        tempSt = "CHEBYSHEV";
+        break;
+    }
+    return tempSt;
+}
+
 bool parameters::fexists(std::string filename){
     struct stat buf;
     if (stat(filename.c_str(), &buf) != -1){
@@ -388,7 +834,54 @@ std::ostream & parameters::print_values(std::ostream &ostr){
     ostr<< setw(c1) << "InvMatPreTOL=" << InvMatPreTOL << endl;
     ostr<< setw(c1) << "SchurTOL=" << SchurTOL << endl;
     ostr<< setw(c1) << "TOL=" << TOL << endl;
+    ostr<< setw(c1) << "adaptive_tol=" << adaptive_tol << endl;
+    ostr<< setw(c1) << "adaptive_min=" << adaptive_min << endl;
+    ostr<< setw(c1) << "disc_stop=" << disc_stop << endl;
+    ostr<< setw(c1) << "disc_fraction=" << disc_fraction << endl;
+    ostr<< setw(c1) << "adaptive_max=" << adaptive_max << endl;
     ostr<< setw(c1) << "threshold=" << threshold << endl;
+    ostr<< setw(c1) << "rigid_modes=" << rigid_modes << endl;
+    ostr<< setw(c1) << "share_amg=" << share_amg << endl;
+    ostr<< setw(c1) << "amg_concurrent=" << amg_concurrent << endl;
+    ostr<< setw(c1) << "amg_tune=" << amg_tune << endl;
+    ostr<< setw(c1) << "tune_file=" << tune_file << endl;
+    ostr<< setw(c1) << "tune_weight=" << tune_weight << endl;
+    ostr<< setw(c1) << "al_enabled=" << al_enabled << endl;
+    ostr<< setw(c1) << "al_gamma=" << al_gamma << endl;
+    ostr<< setw(c1) << "formulation=" << formulation2str(formulation) << endl;
+    ostr<< setw(c1) << "max_poisson=" << max_poisson << endl;
+    ostr<< setw(c1) << "dg_pressure=" << dg_pressure << endl;
+    ostr<< setw(c1) << "minres=" << minres << endl;
+    ostr<< setw(c1) << "outer_cgs2=" << outer_cgs2 << endl;
+    ostr<< setw(c1) << "direct_dofs=" << direct_dofs << endl;
+    ostr<< setw(c1) << "direct_fallback=" << direct_fallback << endl;
+    ostr<< setw(c1) << "fallback_dofs=" << fallback_dofs << endl;
+    ostr<< setw(c1) << "stagnation_window=" << stagnation_window << endl;
+    ostr<< setw(c1) << "monolithic_mg=" << monolithic_mg << endl;
+    ostr<< setw(c1) << "mg_smoothing_steps=" << mg_smoothing_steps << endl;
+    ostr<< setw(c1) << "mg_relaxation=" << mg_relaxation << endl;
+    ostr<< setw(c1) << "checkpoint=" << checkpoint << endl;
+    ostr<< setw(c1) << "restart=" << restart << endl;
+    ostr<< setw(c1) << "checkpoint_file=" << checkpoint_file << endl;
+    ostr<< setw(c1) << "checkpoint_interval=" << checkpoint_interval << endl;
+    ostr<< setw(c1) << "ensemble_list=" << ensemble_list << endl;
+    ostr<< setw(c1) << "store_enabled=" << store_enabled << endl;
+    ostr<< setw(c1) << "store_file=" << store_file << endl;
+    ostr<< setw(c1) << "store_extrapolate=" << store_extrapolate << endl;
+    ostr<< setw(c1) << "recycle=" << recycle << endl;
+    ostr<< setw(c1) << "recycle_size=" << recycle_size << endl;
+    ostr<< setw(c1) << "load_steps=" << load_steps << endl;
+    ostr<< setw(c1) << "schur_type=" << schur2str(schur_type) << endl;
+    ostr<< setw(c1) << "hmatrix_leaf=" << hmatrix_leaf << endl;
+    ostr<< setw(c1) << "hmatrix_eta=" << hmatrix_eta << endl;
+    ostr<< setw(c1) << "hmatrix_tol=" << hmatrix_tol << endl;
+    ostr<< setw(c1) << "hmatrix_rank=" << hmatrix_rank << endl;
+    ostr<< setw(c1) << "inner_solver=" << inner2str(inner_solver) << endl;
+    ostr<< setw(c1) << "inner_cycles=" << inner_cycles << endl;
+    ostr<< setw(c1) << "inner_concurrent=" << inner_concurrent << endl;
+    ostr<< setw(c1) << "inner_pool=" << inner_pool << endl;
+    ostr<< setw(c1) << "single_precision=" << single_precision << endl;
+    ostr<< setw(c1) << "inner_cgs2=" << inner_cgs2 << endl;
     ostr<< setw(c1) << "info=" << info << endl;
     ostr<< setw(c1) << "print_matrices=" << print_matrices << endl;
     ostr<< setw(c1) << "system_iter=" << system_iter << endl;
@@ -423,8 +916,69 @@ std::ostream & parameters::print_variables(std::ostream & outStr){
     outStr << setw(c1) << "\tRefinements: " << refinements << endl;
 
     outStr << setw(c1) << "\tTOL(P_00,Schur): "
-           << TOL << "(" << InvMatPreTOL << ", " << SchurTOL << ")"
-           << endl;
+           << TOL << "(" << InvMatPreTOL << ", " << SchurTOL << ")";
+    if(adaptive_tol)
+        outStr << " adaptive in [" << adaptive_min << ", " << adaptive_max << "]";
+    if(disc_stop)
+        outStr << ", stop at " << disc_fraction << " of the discretization error";
+    outStr << endl;
+
+    if(al_enabled)
+        outStr << setw(c1) << "\tAugmented Lagrangian: " << "gamma = " << al_gamma << endl;
+
+    if(dg_pressure)
+        outStr << setw(c1) << "\tPressure: " << "discontinuous, condensed" << endl;
+    else if(formulation == fFlags::DISPLACEMENT)
+        outStr << setw(c1) << "\tPressure: " << "post-processed, displacement formulation" << endl;
+    else
+        outStr << setw(c1) << "\tSchur: " << schur2str(schur_type) << endl;
+
+    if(minres && !dg_pressure && formulation == fFlags::MIXED)
+        outStr << setw(c1) << "\tOuter solver: " << "MINRES, block diagonal" << endl;
+    else if(outer_cgs2 && !recycle)
+        outStr << setw(c1) << "\tOuter solver: " << "FGMRES, CGS2 orthogonalization" << endl;
+
+    if(monolithic_mg)
+        outStr << setw(c1) << "\tPreconditioner: " << "monolithic multigrid, Vanka("
+               << mg_smoothing_steps << ", " << mg_relaxation << ")" << endl;
+
+    if(direct_dofs > 0 && !dg_pressure && formulation == fFlags::MIXED)
+        outStr << setw(c1) << "\tDirect solver: " << "up to " << direct_dofs << " DoFs" << endl;
+    if(direct_fallback && !dg_pressure && formulation == fFlags::MIXED)
+        outStr << setw(c1) << "\tDirect fallback: " << "up to " << fallback_dofs << " DoFs" << endl;
+
+    if(checkpoint || restart){
+        outStr << setw(c1) << "\tCheckpoint: " << checkpoint_file;
+        if(checkpoint)
+            outStr << ", every " << checkpoint_interval << " outer iterations";
+        if(restart)
+            outStr << ", restart";
+        outStr << endl;
+    }
+
+    if(ensemble.size() > 0)
+        outStr << setw(c1) << "\tEnsemble: " << ensemble.size()
+               << " problems, Poisson " << ensemble_list << endl;
+
+    if(store_enabled)
+        outStr << setw(c1) << "\tWarm start: " << store_file
+               << (store_extrapolate ? ", extrapolated" : ", nearest") << endl;
+
+    if(load_steps > 1 || recycle){
+        outStr << setw(c1) << "\tLoad steps: " << load_steps;
+        if(recycle)
+            outStr << ", recycled subspace " << recycle_size;
+        outStr << endl;
+    }
+
+    outStr << setw(c1) << "\tInner solver: " << inner2str(inner_solver);
+    if(inner_solver != iFlags::FGMRES)
+        outStr << "(" << inner_cycles << " cycles)";
+    if(single_precision && inner_solver != iFlags::CHEBYSHEV)
+        outStr << ", single precision";
+    if(inner_cgs2 && inner_solver == iFlags::FGMRES)
+        outStr << ", CGS2";
+    outStr << endl;
 
     outStr << setw(c1) << "\tAdv/Div: ";
     (adv_enabled) ? outStr << "enabled, " : outStr << RED << "disabled, " << RESET;
@@ -452,9 +1006,13 @@ void parameters::write_sample_file(){
     ofs.open(filename.c_str(), ios::trunc);
 
     if(!ofs.is_open()){
-        cerr << "Could not open sample file\n";
-        exit(1);
+        throw ParameterException ("Could not open sample file\n");
     }
+    sample_file(ofs);
+    ofs.close();
+}
+
+void parameters::sample_file(std::ostream &ofs){
     ofs << "## Problem dimension.\n" <<
            "dimension=2\n" <<
            "## Degree of the polynomial basis functions.\n"
@@ -503,9 +1061,118 @@ void parameters::write_sample_file(){
            "\tinverse=1e-1\n" <<
            "\tschur=1e-1\n" <<
            "\tsystem=1e-7\n" <<
+           "## Relax inner tolerances with the outer residual\n" <<
+           "\tadaptive=0\n" <<
+           "\tadaptive_min=1e-3\n" <<
+           "\tadaptive_max=0.5\n" <<
+           "## Stop the outer FGMRES at the first restart where the algebraic\n" <<
+           "## error is below fraction times the discretization error (exact\n" <<
+           "## L2 error when known, Kelly estimate otherwise); system bounds it\n" <<
+           "\tdiscretization=0\n" <<
+           "\tfraction=0.1\n" <<
            "# AMG options\n" <<
            "[amg]\n"
-           "\tthreshold=0.02\n";
-
-    ofs.close();
+           "\tthreshold=0.02\n" <<
+           "## Rigid body modes as near null space of the displacement AMG\n" <<
+           "\trigid_modes=0\n" <<
+           "## Share one AMG hierarchy between the displacement components\n" <<
+           "\tshare=0\n" <<
+           "## Build the AMG hierarchies of the blocks concurrently\n" <<
+           "\tconcurrent=0\n" <<
+           "## Tune threshold, smoother and sweeps per block with trial solves,\n" <<
+           "## the winners are cached in tune_file for the problem signature\n" <<
+           "\ttune=0\n" <<
+           "\ttune_file=amg_tune.txt\n" <<
+           "\ttune_weight=20\n" <<
+           "# Augmented Lagrangian preconditioner, adds gamma*mu*(div u, div v) to the\n" <<
+           "# A block of the preconditioner and uses a scaled pressure mass matrix as Schur\n" <<
+           "[al]\n"
+           "\tenabled=0\n" <<
+           "\tgamma=1\n" <<
+           "# Formulation {MIXED|DISPLACEMENT|AUTO}. DISPLACEMENT solves the pure\n" <<
+           "# displacement system with CG and AMG and recovers the pressure from\n" <<
+           "# C p = B u. AUTO uses it without advection and divergence terms and\n" <<
+           "# for Poisson's ratio up to max_poisson\n" <<
+           "# minres=1 solves symmetric mixed systems (no advection or divergence)\n" <<
+           "# with MINRES and a block diagonal preconditioner\n" <<
+           "[solver]\n"
+           "\tformulation=MIXED\n" <<
+           "\tmax_poisson=0.45\n" <<
+           "\tminres=0\n" <<
+           "## Outer FGMRES with two fused classical Gram-Schmidt passes (CGS2)\n" <<
+           "## per iteration, overlapped with the preconditioner application\n" <<
+           "\tcgs2=0\n" <<
+           "# Sparse direct solver (UMFPACK) of the whole system for up to max_dofs\n" <<
+           "# degrees of freedom, and with fallback=1 when the outer residual does\n" <<
+           "# not halve within window iterations and the system has at most\n" <<
+           "# fallback_dofs degrees of freedom. 0 disables the threshold or window\n" <<
+           "[direct]\n"
+           "\tmax_dofs=0\n" <<
+           "\tfallback=0\n" <<
+           "\tfallback_dofs=200000\n" <<
+           "\twindow=50\n" <<
+           "# Monolithic geometric multigrid on the refine_global hierarchy, one\n" <<
+           "# V-cycle with cell patch (Vanka) SSOR smoothing per outer iteration\n" <<
+           "[mg]\n"
+           "\tenabled=0\n" <<
+           "\tsmoothing_steps=2\n" <<
+           "\trelaxation=0.7\n" <<
+           "# Checkpoints of triangulation, DoF numbering, assembled system and\n" <<
+           "# solution after each phase and at the first outer restart after every\n" <<
+           "# interval iterations. Not with load steps.\n" <<
+           "# restart=1 continues from file and skips the completed phases\n" <<
+           "[checkpoint]\n"
+           "\tenabled=0\n" <<
+           "\trestart=0\n" <<
+           "\tfile=checkpoint.bin\n" <<
+           "\tinterval=200\n" <<
+           "# Independent problems, one per Poisson ratio, solved concurrently\n" <<
+           "# in one process. Empty runs the single problem above\n" <<
+           "[ensemble]\n"
+           "\tpoisson=\n" <<
+           "# Solution store keyed by the mesh and DoF signature, solves start\n" <<
+           "# from the nearest stored solution in (poisson, load) or, with\n" <<
+           "# extrapolate=1, from a linear extrapolation in the Poisson ratio\n" <<
+           "[store]\n"
+           "\tenabled=0\n" <<
+           "\tfile=solutions.bin\n" <<
+           "\textrapolate=1\n" <<
+           "# The ice load grows linearly over steps load steps, every step starts\n" <<
+           "# from the previous solution. enabled=1 keeps size directions of the\n" <<
+           "# outer Krylov space between the solves (GCRO-DR style recycling)\n" <<
+           "[recycle]\n"
+           "\tenabled=0\n" <<
+           "\tsize=10\n" <<
+           "\tsteps=1\n" <<
+           "# Discontinuous pressure (FE_DGP), eliminated cell by cell. The condensed\n" <<
+           "# displacement system is solved with AMG preconditioned CG or GMRES\n" <<
+           "[pressure]\n"
+           "\tdiscontinuous=0\n" <<
+           "# Schur complement approximation {ELEMENT|MASS|LUMPED|SIMPLE|HMATRIX},\n" <<
+           "# with the augmented Lagrangian ELEMENT is replaced by MASS.\n" <<
+           "# SIMPLE is the sparse product C - B diag(A)^{-1} Bt.\n" <<
+           "# HMATRIX (-c 1, no advection or divergence) approximates C - B A^{-1} Bt\n" <<
+           "# as a block low-rank matrix on the pressure clusters and applies its block LU\n" <<
+           "[schur]\n"
+           "\ttype=ELEMENT\n" <<
+           "# Clusters of at most leaf pressure dofs, blocks with\n" <<
+           "# min(diam) <= eta*dist are stored with rank <= rank to accuracy tol\n" <<
+           "[hmatrix]\n"
+           "\tleaf=64\n" <<
+           "\teta=1\n" <<
+           "\ttol=1e-3\n" <<
+           "\trank=16\n" <<
+           "# Inner solvers of the preconditioner {FGMRES|VCYCLE|CHEBYSHEV}\n" <<
+           "[inner]\n"
+           "\ttype=FGMRES\n" <<
+           "\tcycles=2\n" <<
+           "## Solve the displacement blocks concurrently\n" <<
+           "\tconcurrent=0\n" <<
+           "## Krylov vectors allocated up front per inner solver\n" <<
+           "\tpool=16\n" <<
+           "## Inner FGMRES with fused CGS2 orthogonalization\n" <<
+           "\tcgs2=0\n" <<
+           "## FGMRES and V-cycle inner solves in float on single precision\n" <<
+           "## copies of the blocks, the AMG hierarchies stay in double\n" <<
+           "\tsingle=0\n";
 }